@@ -5,6 +5,7 @@
 #include <list>
 #include <string>
 #include <deque>
+#include <vector>
 #include <pthread.h>
 
 #ifndef __STDC_FORMAT_MACROS
@@ -75,19 +76,139 @@ class Version {
 
 
 
+/**
+ * BinlogIndex
+ * Sparse index of one binlog file, one 4 bytes slot for every
+ * kBinlogIndexInterval bytes, holding the first record begin in it:
+ * 0 for unknown, kBinlogIndexNone for no record begin in the interval,
+ * otherwise offset in the interval plus 1.
+ * Written along with the binlog file, named as it plus kBinlogIndexSuffix
+ */
+const uint32_t kBinlogIndexNone = 0xffffffff;
+
+std::string BinlogIndexFile(const std::string& binlog_file);
+
+// Find the record begin to seek offset from, by the index of binlog file
+// Return NotFound if not indexed,
+//        InvalidArgument if offset is not a record begin for sure
+Status BinlogIndexLookup(const std::string& binlog_file, uint64_t offset,
+    uint64_t* begin);
+
+// Rebuild the index by scanning the whole binlog file,
+// time index is not touched since items are opaque here
+Status RebuildBinlogIndex(const std::string& binlog_file);
+
+/**
+ * BinlogTimeIndex
+ * One 16 bytes entry every time the record time moves forward,
+ * the time in seconds and the offset of the first record with it.
+ * Written along with the binlog file, named as it plus
+ * kBinlogTimeIndexSuffix, records without time are not indexed
+ */
+std::string BinlogTimeIndexFile(const std::string& binlog_file);
+
+// Find the first indexed record not earlier than time
+// Return NotFound if not indexed,
+//        EndFile if all indexed records are earlier
+Status BinlogTimeLookup(const std::string& binlog_file, int64_t time,
+    uint64_t* offset);
+
+// Remove both indexes of binlog file
+void DeleteBinlogIndex(const std::string& binlog_file);
+
+class BinlogIndexWriter {
+public:
+  // Content of binlog file ends at size,
+  // slots after the last complete interval are reset to unknown
+  static Status Open(const std::string& binlog_file, uint64_t size,
+      BinlogIndexWriter** writer);
+  ~BinlogIndexWriter();
+  // A record begins at offset
+  void Add(uint64_t offset);
+  // A record with time begins at offset
+  void AddTime(int64_t time, uint64_t offset);
+
+private:
+  BinlogIndexWriter(int fd, uint64_t next_slot, int time_fd,
+      int64_t last_time);
+  int fd_;
+  uint64_t next_slot_;
+  int time_fd_;
+  int64_t last_time_;
+
+  // No copying allowed
+  BinlogIndexWriter(const BinlogIndexWriter&);
+  void operator=(const BinlogIndexWriter&);
+};
+
+
+
+/**
+ * BinlogCompressedFile
+ * Finished binlog file compressed kBlockSize by kBlockSize with snappy,
+ * and replaced in place with the same name, laid out as:
+ * magic | blocks | file offset of each block and the end (8 bytes each)
+ *       | block count (8 bytes) | uncompressed size (8 bytes)
+ * Magic is not a valid record header, offsets seen by reader and
+ * index are of the uncompressed content
+ */
+class BinlogCompressedFile {
+public:
+  static Status Open(const std::string& path, BinlogCompressedFile** file);
+  ~BinlogCompressedFile();
+
+  uint64_t size() const {
+    return size_;
+  }
+  // Read the uncompressed content like pread, return -1 on error
+  ssize_t Pread(char* buf, size_t n, uint64_t offset);
+
+private:
+  BinlogCompressedFile(int fd, uint64_t size);
+  int fd_;
+  uint64_t size_;
+  std::vector<uint64_t> blocks_;
+  int64_t cached_;  // block in cache_, -1 for none
+  std::string cache_;
+  Status LoadBlock(uint64_t index);
+
+  // No copying allowed
+  BinlogCompressedFile(const BinlogCompressedFile&);
+  void operator=(const BinlogCompressedFile&);
+};
+
+bool BinlogFileCompressed(const std::string& binlog_file);
+
+// Size of the uncompressed content
+Status BinlogFileSize(const std::string& binlog_file, uint64_t* size);
+
+// Open binlog file for BinlogReader, compressed or not
+Status NewBinlogSequentialFile(const std::string& binlog_file,
+    slash::SequentialFile** file);
+
+// Write compressed content of a finished binlog file to dst_file,
+// with the mtime kept for purge
+Status CompressBinlogFile(const std::string& binlog_file,
+    const std::string& dst_file);
+
+
+
 /**
  * BinlogWriter
  */
 class BinlogWriter {
 public:
-  BinlogWriter(slash::WritableFile *queue);
+  // Record begins are added to index if given
+  BinlogWriter(slash::WritableFile *queue, BinlogIndexWriter* index = NULL);
   ~BinlogWriter(); 
   Status Fallback(uint64_t offset);
-  Status Produce(const Slice &item, int64_t *write_size);
+  // time in seconds is added to time index if positive
+  Status Produce(const Slice &item, int64_t *write_size, int64_t time = 0);
   Status AppendBlank(uint64_t len, int64_t* write_size);
 
 private:
   slash::WritableFile *queue_;
+  BinlogIndexWriter* index_;
   int block_offset_;
   Status EmitPhysicalRecord(RecordType t,
       const char *ptr, size_t n, int64_t *write_size);
@@ -108,6 +229,9 @@ public:
   BinlogReader(slash::SequentialFile *queue);
   ~BinlogReader(); 
   Status Seek(uint64_t offset);
+  // Seek with the index of binlog file if any, so that only
+  // a bounded range is read, reader should be at the file begin
+  Status Seek(uint64_t offset, const std::string& binlog_file);
   Status Consume(uint64_t *size, std::string *item);
   void SkipNextBlock(uint64_t* size);
 
@@ -118,6 +242,7 @@ private:
   int last_record_offset_;
   bool last_error_happened_;
   uint32_t ReadPhysicalRecord(uint64_t *size, slash::Slice *result);
+  Status SeekFrom(uint64_t begin, uint64_t offset);
 
   // No copying allowed
   BinlogReader(const BinlogReader&);
@@ -125,6 +250,28 @@ private:
 };
 
 
+/**
+ * BinlogReadahead
+ * Hint kernel to read the binlog file ahead of the reader,
+ * so the reader seldom wait on disk
+ */
+class BinlogReadahead {
+public:
+  explicit BinlogReadahead(const std::string& filename);
+  ~BinlogReadahead();
+  // Called with the current read offset
+  void Advance(uint64_t offset);
+
+private:
+  int fd_;
+  uint64_t ahead_;  // file has been read ahead until here
+
+  // No copying allowed
+  BinlogReadahead(const BinlogReadahead&);
+  void operator=(const BinlogReadahead&);
+};
+
+
 /**
  * Binlog
  */
@@ -144,8 +291,17 @@ public:
     return filename_;
   }
 
-  Status Put(const std::string &item);
+  // time is the coarse time of item in seconds, 0 for unknown
+  Status Put(const std::string &item, int64_t time = 0);
   Status PutBlank(uint64_t len);
+  // Find the first record not earlier than time,
+  // files without time index are taken as a whole
+  void FindOffsetByTime(int64_t time, uint32_t* filenum, uint64_t* offset);
+  // Compress a finished binlog file in place
+  Status CompressFile(uint32_t num);
+  // Create the next binlog file before current one is full,
+  // so that roll in Put is only a rename
+  void PrepareNextFile();
 
   void GetProducerStatus(uint32_t* filenum, uint64_t* pro_offset) {
     slash::MutexLock l(&mutex_);
@@ -165,8 +321,11 @@ private:
   Version* version_;
   slash::WritableFile *queue_;
   BinlogWriter* writer_;
+  BinlogIndexWriter* index_;
+  slash::WritableFile *next_queue_;
 
   Status Init();
+  void OpenWriter(const std::string& binlog_file, uint64_t size);
   void MaybeRoll();
   Status RemoveBetween(int lbound, int rbound);
   
@@ -58,6 +58,12 @@ enum CmdType {
   kSyncCmd,
   kMgetCmd,
   kFlushDBCmd,
+  kIngestCmd,
+  kBackupCmd,
+  kSubscribeCmd,
+  kSyncBatchCmd,
+  kSyncPauseCmd,
+  kConfigCmd,
   // Meta related
   kPingCmd,
   kPullCmd,
@@ -75,6 +81,9 @@ enum CmdType {
   kRemoveNodesCmd,
   kAddMetaNodeCmd,
   kRemoveMetaNodeCmd,
+  kSetQosCmd,
+  kTransferLeaderCmd,
+  kNodeInfosCmd,
 };
 
 const std::string kLBrace = "#ZPLBRACE%#";
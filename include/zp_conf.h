@@ -1,6 +1,8 @@
 #ifndef INCLUDE_ZP_CONF_H_
 #define INCLUDE_ZP_CONF_H_
 
+#include <atomic>
+#include <functional>
 #include <string>
 #include <vector>
 #include <set>
@@ -11,8 +13,86 @@
 #include "slash/include/slash_mutex.h"
 #include "slash/include/base_conf.h"
 
-typedef slash::RWLock RWLock;
+// All config items, never changed once published
+struct ZpConfItems {
+  // Env
+  std::vector<std::string> meta_addr;
+  std::string local_ip;
+  int local_port;
+  int sync_listen_port;  // 0 for local_port + kPortShiftSync
+  int64_t timeout;
+  std::string data_path;
+  std::string log_path;
+  std::string trash_path;
+  bool daemonize;
+  std::string pid_file;
+  std::string lock_file;
+  bool enable_data_delete;
+
+  // Thread Num
+  int meta_thread_num;
+  int data_thread_num;
+  int sync_recv_thread_num;
+  int sync_send_thread_num;
+  int client_loop_num;  // 0 for one dispatch thread
+  int max_background_flushes;
+  int max_background_compactions;
+
+  // Thread placement, cpu list like "0-7,16-23"
+  std::string dispatch_cpus_str;
+  std::string sync_recv_cpus_str;
+  std::string sync_send_cpus_str;
+  std::string bg_cpus_str;
+  std::string db_cpus_str;
+  std::vector<int> dispatch_cpus;
+  std::vector<int> sync_recv_cpus;
+  std::vector<int> sync_send_cpus;
+  std::vector<int> bg_cpus;
+  std::vector<int> db_cpus;
+
+  // Binlog related
+  int binlog_remain_days;
+  int binlog_remain_min_count;
+  int binlog_remain_max_count;
+  int binlog_compress_hours;  // 0 for never
+  int sync_dedup_distance;  // MB, 0 for never
+
+  // DB
+  int db_write_buffer_size; // KB
+  int db_max_write_buffer; // KB
+  int db_target_file_size_base; // KB
+  int db_max_open_files;
+  int db_block_size; //KB
+
+  // Feature
+  int slowlog_slower_than;
+  int stuck_offset_dist;
+  int slowdown_delay_radio;  // Percent
+  int migrate_count_once;
+
+  // Backup
+  std::string backup_path;
+  int backup_speed_limit;  // MB/s
+
+  // Subscribe
+  int subscribe_pin_binlog_count;
 
+  // Floyd options
+  int floyd_check_leader_us;
+  int floyd_heartbeat_us;
+  int floyd_append_entries_size_once;
+  int floyd_append_entries_count_once;
+
+  ZpConfItems();
+};
+
+/**
+ * ZpConf
+ * Getters read the current snapshot by one atomic load, without lock
+ * or allocation. Changes are made on a copy, then published as the new
+ * snapshot. Since changes are rare, old snapshots are kept until ZpConf
+ * is destroyed, so that references returned by getters stay valid
+ */
 class ZpConf {
  public:
   ZpConf(const std::string& path);
@@ -24,209 +104,194 @@ class ZpConf {
 
   bool Rewrite();
 
-  std::string local_ip() {
-    RWLock l(&rwlock_, false);
-    return local_ip_;
+  const std::string& local_ip() const {
+    return items()->local_ip;
   }
 
-  int local_port() {
-    RWLock l(&rwlock_, false);
-    return local_port_;
+  int local_port() const {
+    return items()->local_port;
   }
 
-  int64_t timeout() {
-    RWLock l(&rwlock_, false);
-    return timeout_;
+  // Peers always send binlog to local_port + kPortShiftSync,
+  // listen elsewhere only when a proxy forwards it here
+  int sync_listen_port() const {
+    return items()->sync_listen_port > 0 ? items()->sync_listen_port
+      : items()->local_port + kPortShiftSync;
   }
 
-  std::string data_path() {
-    RWLock l(&rwlock_, false);
-    return data_path_;
+  int64_t timeout() const {
+    return items()->timeout;
   }
 
-  std::string log_path() {
-    RWLock l(&rwlock_, false);
-    return log_path_;
+  const std::string& data_path() const {
+    return items()->data_path;
   }
 
-  std::string trash_path() {
-    RWLock l(&rwlock_, false);
-    return trash_path_;
+  const std::string& log_path() const {
+    return items()->log_path;
   }
 
-  bool daemonize() {
-    RWLock l(&rwlock_, false);
-    return daemonize_;
+  const std::string& trash_path() const {
+    return items()->trash_path;
   }
 
-  std::string pid_file() {
-    RWLock l(&rwlock_, false);
-    return pid_file_;
+  bool daemonize() const {
+    return items()->daemonize;
   }
 
-  std::string lock_file() {
-    RWLock l(&rwlock_, false);
-    return lock_file_;
+  const std::string& pid_file() const {
+    return items()->pid_file;
   }
 
-  bool enable_data_delete() {
-    RWLock l(&rwlock_, false);
-    return enable_data_delete_;
+  const std::string& lock_file() const {
+    return items()->lock_file;
   }
 
-  std::vector<std::string>& meta_addr() {
-    RWLock l(&rwlock_, false);
-    return meta_addr_;
+  bool enable_data_delete() const {
+    return items()->enable_data_delete;
   }
 
-  int meta_thread_num() {
-    RWLock l(&rwlock_, false);
-    return meta_thread_num_;
+  const std::vector<std::string>& meta_addr() const {
+    return items()->meta_addr;
   }
-  int data_thread_num() {
-    RWLock l(&rwlock_, false);
-    return data_thread_num_;
+
+  int meta_thread_num() const {
+    return items()->meta_thread_num;
   }
-  int sync_recv_thread_num() {
-    RWLock l(&rwlock_, false);
-    return sync_recv_thread_num_;
+  int data_thread_num() const {
+    return items()->data_thread_num;
   }
-  int sync_send_thread_num() {
-    RWLock l(&rwlock_, false);
-    return sync_send_thread_num_;
+  int sync_recv_thread_num() const {
+    return items()->sync_recv_thread_num;
   }
-  int max_background_flushes() {
-    RWLock l(&rwlock_, false);
-    return max_background_flushes_;
+  int sync_send_thread_num() const {
+    return items()->sync_send_thread_num;
   }
-  int max_background_compactions() {
-    RWLock l(&rwlock_, false);
-    return max_background_compactions_;
+  int client_loop_num() const {
+    return items()->client_loop_num;
   }
-  int binlog_remain_days() {
-    RWLock l(&rwlock_, false);
-    return binlog_remain_days_;
+  int max_background_flushes() const {
+    return items()->max_background_flushes;
   }
-  int binlog_remain_min_count() {
-    RWLock l(&rwlock_, false);
-    return binlog_remain_min_count_;
+  int max_background_compactions() const {
+    return items()->max_background_compactions;
   }
-  int binlog_remain_max_count() {
-    RWLock l(&rwlock_, false);
-    return binlog_remain_max_count_;
+  int binlog_remain_days() const {
+    return items()->binlog_remain_days;
   }
-  int slowlog_slower_than() {
-    RWLock l(&rwlock_, false);
-    return slowlog_slower_than_;
+  int binlog_remain_min_count() const {
+    return items()->binlog_remain_min_count;
   }
-  int stuck_offset_dist() {
-    RWLock l(&rwlock_, false);
-    return stuck_offset_dist_;
+  int binlog_remain_max_count() const {
+    return items()->binlog_remain_max_count;
   }
-  int slowdown_delay_radio() {
-    RWLock l(&rwlock_, false);
-    return slowdown_delay_radio_;
+  int binlog_compress_hours() const {
+    return items()->binlog_compress_hours;
   }
-  int migrate_count_once() {
-    RWLock l(&rwlock_, false);
-    return migrate_count_once_;
+  int sync_dedup_distance() const {
+    return items()->sync_dedup_distance;
   }
-  int db_write_buffer_size() {
-    RWLock l(&rwlock_, false);
-    return db_write_buffer_size_;
+  int slowlog_slower_than() const {
+    return items()->slowlog_slower_than;
   }
-  int db_max_write_buffer() {
-    RWLock l(&rwlock_, false);
-    return db_max_write_buffer_;
+  int stuck_offset_dist() const {
+    return items()->stuck_offset_dist;
   }
-  int db_target_file_size_base() {
-    RWLock l(&rwlock_, false);
-    return db_target_file_size_base_;
+  int slowdown_delay_radio() const {
+    return items()->slowdown_delay_radio;
   }
-  int db_max_open_files() {
-    RWLock l(&rwlock_, false);
-    return db_max_open_files_;
+  int migrate_count_once() const {
+    return items()->migrate_count_once;
   }
-  int db_block_size() {
-    RWLock l(&rwlock_, false);
-    return db_block_size_;
+  const std::string& backup_path() const {
+    return items()->backup_path;
   }
-  int floyd_check_leader_us() {
-    RWLock l(&rwlock_, false);
-    return floyd_check_leader_us_;
+  int backup_speed_limit() const {
+    return items()->backup_speed_limit;
   }
-
-  int floyd_heartbeat_us() {
-    RWLock l(&rwlock_, false);
-    return floyd_heartbeat_us_;
+  int subscribe_pin_binlog_count() const {
+    return items()->subscribe_pin_binlog_count;
   }
-
-  int floyd_append_entries_size_once() {
-    RWLock l(&rwlock_, false);
-    return floyd_append_entries_size_once_;
+  int db_write_buffer_size() const {
+    return items()->db_write_buffer_size;
   }
-  int floyd_append_entries_count_once() {
-    RWLock l(&rwlock_, false);
-    return floyd_append_entries_count_once_;
+  int db_max_write_buffer() const {
+    return items()->db_max_write_buffer;
   }
-
-  void SetMetaAddr(const std::set<std::string>& new_addrs) {
-    RWLock l(&rwlock_, true);
-    meta_addr_.clear();
-    for (const auto& addr : new_addrs) {
-      meta_addr_.push_back(addr);
-    }
+  int db_target_file_size_base() const {
+    return items()->db_target_file_size_base;
+  }
+  int db_max_open_files() const {
+    return items()->db_max_open_files;
+  }
+  int db_block_size() const {
+    return items()->db_block_size;
+  }
+  // Thread placement, empty for no pinning
+  const std::vector<int>& dispatch_cpus() const {
+    return items()->dispatch_cpus;
+  }
+  const std::vector<int>& sync_recv_cpus() const {
+    return items()->sync_recv_cpus;
+  }
+  const std::vector<int>& sync_send_cpus() const {
+    return items()->sync_send_cpus;
+  }
+  const std::vector<int>& bg_cpus() const {
+    return items()->bg_cpus;
+  }
+  const std::vector<int>& db_cpus() const {
+    return items()->db_cpus;
+  }
+  int floyd_check_leader_us() const {
+    return items()->floyd_check_leader_us;
   }
 
- private:
-  slash::BaseConf conf_adaptor_;
-
-  // Env
-  std::vector<std::string> meta_addr_;
-  std::string local_ip_;
-  int local_port_;
-  int64_t timeout_;
-  std::string data_path_;
-  std::string log_path_;
-  std::string trash_path_;
-  bool daemonize_;
-  std::string pid_file_;
-  std::string lock_file_;
-  bool enable_data_delete_;
-
-  // Thread Num
-  int meta_thread_num_;
-  int data_thread_num_;
-  int sync_recv_thread_num_;
-  int sync_send_thread_num_;
-  int max_background_flushes_;
-  int max_background_compactions_;
+  int floyd_heartbeat_us() const {
+    return items()->floyd_heartbeat_us;
+  }
 
-  // Binlog related
-  int binlog_remain_days_;
-  int binlog_remain_min_count_;
-  int binlog_remain_max_count_;
+  int floyd_append_entries_size_once() const {
+    return items()->floyd_append_entries_size_once;
+  }
+  int floyd_append_entries_count_once() const {
+    return items()->floyd_append_entries_count_once;
+  }
 
-  // DB
-  int db_write_buffer_size_; // KB
-  int db_max_write_buffer_; // KB
-  int db_target_file_size_base_; // KB
-  int db_max_open_files_; 
-  int db_block_size_; //KB
+  // Return false if meta addrs are unchanged
+  bool SetMetaAddr(const std::set<std::string>& new_addrs);
 
-  // Feature
-  int slowlog_slower_than_;
-  int stuck_offset_dist_;
-  int slowdown_delay_radio_;  // Percent
-  int migrate_count_once_;
+  // Items could be changed at runtime
+  static const std::vector<std::string>& DynamicItems();
+  bool ConfigGet(const std::string& name, std::string* value);
+  // Return false on unknown item or value out of range
+  bool ConfigSet(const std::string& name, const std::string& value);
 
-  // Floyd options
-  int floyd_check_leader_us_;
-  int floyd_heartbeat_us_;
-  int floyd_append_entries_size_once_;
-  int floyd_append_entries_count_once_;
+ private:
+  slash::BaseConf conf_adaptor_;
 
-  pthread_rwlock_t rwlock_;
+  std::atomic<const ZpConfItems*> items_;
+  const ZpConfItems* items() const {
+    return items_.load(std::memory_order_acquire);
+  }
+
+  // Serialize changes and conf file access
+  slash::Mutex mutex_;
+  // Snapshots replaced, protected by mutex_
+  std::vector<const ZpConfItems*> retired_;
+  // Required: hold mutex_
+  void Publish(ZpConfItems* new_items);
+  // Modify a copy of current items, publish it if update returns true
+  bool Update(const std::function<bool(ZpConfItems*)>& update);
+
+  struct DynamicItem {
+    const char* name;
+    int ZpConfItems::*field;
+    int floor;
+    int ceil;
+  };
+  static const DynamicItem kDynamicItems[];
+  static const DynamicItem* FindDynamicItem(const std::string& name);
 
   // copy disallowded
   ZpConf(const ZpConf& options);
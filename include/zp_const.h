@@ -27,6 +27,16 @@ const size_t kHeaderSize = 1 + 3;
 const std::string kBinlogPrefix = "binlog";
 const size_t kBinlogPrefixLen = 6;
 const std::string kManifest = "manifest";
+const std::string kBinlogNextFile = "next_binlog";  // created ahead of roll
+const uint64_t kBinlogReadaheadSize = 4 * 1024 * 1024;
+// Sparse index of binlog file, one slot for every interval
+const std::string kBinlogIndexSuffix = ".index";
+const uint64_t kBinlogIndexInterval = 4 * 1024;  // should divide kBlockSize
+// Time index of binlog file, one entry every second with records
+const std::string kBinlogTimeIndexSuffix = ".tindex";
+// Finished binlog compressed in place, told apart by the magic
+const std::string kBinlogCompressMagic = "\xff\xff\xff\xffZPSZ";
+const std::string kBinlogCompressTmpSuffix = ".compress";
 
 /* DBSync related */
 const uint32_t kDBSyncMaxGap = 1000;
@@ -35,6 +45,31 @@ const uint32_t kDBSyncSpeedLimit = 126; //MBPS
 const int kDBSyncRetryTime = 5;    // retry time to send single file for DBSync
 const std::string kBgsaveInfoFile = "info";
 
+/* Ingest related */
+// Record the binlog offset of the last ingest marker in log path
+const std::string kIngestInfoFile = "ingest";
+
+/* Backup related */
+const int kBackupSpeedLimit = 50;  // MBPS
+const int kBackupCopyChunk = 1024 * 1024;
+const std::string kBackupSharedDir = "shared";
+const std::string kBackupBinlogDir = "binlog";
+// Purge binlogs not archived yet beyond binlog_remain_max_count + this
+const int kBinlogArchiveMaxWait = 20;
+
+/* Subscribe related */
+const int kSubscribePinBinlogCount = 10;
+const int kSubscribeBatchCount = 1000;
+const int kSubscribeMaxBatchCount = 10000;
+const int kSubscribeBatchSize = 1024 * 1024;
+const int kSubscribeMaxBatchSize = 16 * 1024 * 1024;
+const int kSubscriberExpire = 600;  // s, unpin binlog after no poll
+
+/* Qos related */
+const int kQosMaxClients = 10000;  // clean idle client buckets beyond
+const int kQosClientExpire = 60;  // s
+const int kQosKeepPercent = 90;  // evict oldest clients to, if still full
+
 /* Purge Log related */
 const uint32_t kBinlogRemainMinCount = 10;
 const uint32_t kBinlogRemainMaxCount = 60;
@@ -49,12 +84,25 @@ const int kConditionCronInterval= 3000; // millisecond
 // TrySync Delay time := kRecoverSyncDelayCronCount * (kNodeCronInterval * kNodeCronWaitCount)
 const int kRecoverSyncDelayCronCount = 7;
 const int kStuckRecoverSyncDelayCronCount = 300; // for slave stuck out of kConnected
-const int kTrySyncInterval = 5000;  // mili seconds
+const int kTrySyncInterval = 5000;  // mili seconds, max retry backoff
+const int kTrySyncMinInterval = 50;  // mili seconds, first retry backoff
+const int kDBSyncPollInterval = 500;  // mili seconds
+const int kDBSyncPollLogCount = 60;  // log once every so many polls
+const int kTrySyncBatchSize = 256;  // partitions in one SYNCBATCH request
+const int kTrySyncBatchTimeout = 5000;  // mili seconds
+const int kSyncBatchWorkers = 8;  // threads handle SYNCBATCH on master
+const int kSyncPauseSlowdown = 200;  // mili seconds, slave db slowdown
+const int kSyncPauseStop = 1000;  // mili seconds, slave db stop
+const int kSyncPauseMax = 5000;  // mili seconds, less than kBinlogMinLease
+const int kBinlogPauseCheckInterval = 100;  // mili seconds
 const int kBinlogSendInterval = 1;
 const int kBinlogRedundantLease = 10;  // some more lease time for redundance
 const int kBinlogMinLease = 20;
 const int kBinlogDefaultLease = 60;
 const int kBinlogTimeSlice = 5;    // should larger than kBinlogSendInterval
+// Records read ahead by the sender of a far behind slave for dedup
+const size_t kBinlogDedupWindowCount = 4096;
+const uint64_t kBinlogDedupWindowSize = 4 * 1024 * 1024;
 const int kBinlogReceiverCronInterval = 6000;
 const int kBinlogReceiveBgWorkerFull = 100;
 
@@ -72,21 +120,45 @@ const int kDispatchQueueSize = 1000;
 const int kMetaDispathCronInterval = 1000;
 const int kMetaDispathQueueSize = 1000;
 const int kKeepAlive = 60;  // seconds
+const int kClientLoopBacklog = 1024;
+const int kClientLoopMaxEvents = 1024;
+const int kClientLoopPollTimeout = 1000;  // mili seconds
+const int kClientLoopAcceptPause = 100;  // mili seconds, when out of fd
 const int kMetacmdInterval = 6;
 
+/* Thread placement */
+const int kMaxCpuNum = 1024;  // CPU_SETSIZE
+
 /* Server cron related */
-// Server cron wait kNodeCronInterval * kNodeCronWaitCount every time
+// Server cron wait kNodeCronInterval every time
 const int kNodeCronInterval = 1000;
 const int kNodeCronWaitCount = 2;
+// Partition timing tasks, millisecond
+const int kPartitionCronInterval = kNodeCronInterval * kNodeCronWaitCount;
+const int kPartitionPurgeInterval = 30000;
+// Meta leader is checked every kMetaCronInterval,
+// other tasks every kMetaCronInterval * kMetaCronWaitCount
 const int kMetaCronInterval = 1000;
 const int kMetaCronWaitCount = 5;
 
 /* Meta elect */
-const int kMetaLeaderLockTimeout = 5;
-const int kMetaLeaderTimeout = 60;
-const int kMetaLeaderRemainThreshold = 10; // Should large than kMetaCronInterval * kMetaCronWaitCount
+const int kMetaLeaderLockTimeout = 2;
+const int kMetaLeaderTimeout = 6;  // Lease of meta leader
+const int kMetaLeaderRemainThreshold = 2; // Should large than kMetaCronInterval
+// Node offsets synced from old leader are dropped on takeover if older than
+const int kMetaNodeInfoStale = 10;
+// Followers pull changed node offsets every kMetaCronInterval,
+// and all of them every kMetaNodeInfosFullCount pulls
+const int kMetaNodeInfosFullCount = 30;
 
 const int kMetaOffsetStuckDist =  1024 * 100;  // when begin to stuck parititon, should small than kBinlogSize
 const int kSlowdownDelayRatio = 60;  // Percent of write request to delay
 
+/* Write stall related */
+const int kWriteStallCheckInterval = 100;  // mili seconds
+const int kWriteStallL0Margin = 2;  // shed before rocksdb L0 trigger
+const int kWriteStallPendingPercent = 90;  // of rocksdb pending limit
+const int kWriteStallMemPercent = 95;  // of write buffer manager size
+const int kWriteStallRetryAfter = 100;  // mili seconds
+
 #endif  // INCLUDE_ZP_CONST_H_
@@ -2,6 +2,8 @@
 #define INCLUDE_ZP_UTIL_H_
 
 #include <string>
+#include <vector>
+#include <pthread.h>
 #include <glog/logging.h>
 
 #include "include/zp_conf.h"
@@ -25,6 +27,9 @@ struct WorkerCronTask {
 void daemonize();
 void close_std();
 void create_pid_file();
+// Pin the index-th thread of one class to one cpu in cpus,
+// or to all of them if index < 0, do nothing if cpus is empty
+bool PinThread(pthread_t tid, const std::vector<int>& cpus, int index = -1);
 class FileLocker {
  public:
   explicit FileLocker(const std::string& file);
@@ -1,8 +1,18 @@
 #include "include/zp_binlog.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <glog/logging.h>
+#include <snappy.h>
+
+#include "slash/include/slash_coding.h"
 
 using slash::RWLock;
 
@@ -79,11 +89,526 @@ void Version::Debug() {
 }
 
 
+/*
+ * BinlogIndex
+ */
+std::string BinlogIndexFile(const std::string& binlog_file) {
+  return binlog_file + kBinlogIndexSuffix;
+}
+
+// Append slots until the one offset falls in
+static void AppendIndexSlots(uint64_t offset, uint64_t* next_slot,
+    std::string* buf) {
+  uint64_t slot = offset / kBinlogIndexInterval;
+  if (slot < *next_slot) {
+    return;
+  }
+  char tmp[sizeof(uint32_t)];
+  slash::EncodeFixed32(tmp, kBinlogIndexNone);
+  for (; *next_slot < slot; (*next_slot)++) {
+    buf->append(tmp, sizeof(tmp));
+  }
+  slash::EncodeFixed32(tmp, offset % kBinlogIndexInterval + 1);
+  buf->append(tmp, sizeof(tmp));
+  *next_slot = slot + 1;
+}
+
+Status BinlogIndexLookup(const std::string& binlog_file, uint64_t offset,
+    uint64_t* begin) {
+  int fd = open(BinlogIndexFile(binlog_file).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::NotFound("Binlog index not exist");
+  }
+  uint64_t slot = offset / kBinlogIndexInterval;
+  char buf[sizeof(uint32_t)];
+  ssize_t n = pread(fd, buf, sizeof(buf), slot * sizeof(buf));
+  close(fd);
+  if (n != static_cast<ssize_t>(sizeof(buf))) {
+    return Status::NotFound("Binlog offset not indexed");
+  }
+
+  uint32_t value = slash::DecodeFixed32(buf);
+  if (value == 0) {
+    return Status::NotFound("Binlog offset not indexed");
+  } else if (value == kBinlogIndexNone) {
+    return Status::InvalidArgument("Binlog offset inside a record");
+  }
+  *begin = slot * kBinlogIndexInterval + value - 1;
+  if (offset < *begin) {
+    return Status::InvalidArgument("Binlog offset inside a record");
+  }
+  return Status::OK();
+}
+
+Status RebuildBinlogIndex(const std::string& binlog_file) {
+  slash::SequentialFile* queue = NULL;
+  Status s = NewBinlogSequentialFile(binlog_file, &queue);
+  if (!s.ok()) {
+    return s;
+  }
+  BinlogReader reader(queue);
+  std::string buf, item;
+  uint64_t offset = 0, next_slot = 0;
+  while (true) {
+    uint64_t size = 0;
+    s = reader.Consume(&size, &item);
+    if (s.IsEndFile()) {
+      break;
+    } else if (s.ok() || s.IsIncomplete()) {
+      // Where an item or blank begins
+      AppendIndexSlots(offset, &next_slot, &buf);
+    } else {
+      reader.SkipNextBlock(&size);
+    }
+    offset += size;
+  }
+  delete queue;
+
+  std::string index_file = BinlogIndexFile(binlog_file);
+  std::string tmp_file = index_file + ".tmp";
+  int fd = open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      0644);
+  if (fd < 0) {
+    return Status::IOError("open binlog index failed", strerror(errno));
+  }
+  bool ok = write(fd, buf.data(), buf.size())
+    == static_cast<ssize_t>(buf.size()) && fsync(fd) == 0;
+  close(fd);
+  if (!ok || rename(tmp_file.c_str(), index_file.c_str()) != 0) {
+    slash::DeleteFile(tmp_file);
+    return Status::IOError("write binlog index failed", strerror(errno));
+  }
+  return Status::OK();
+}
+
+std::string BinlogTimeIndexFile(const std::string& binlog_file) {
+  return binlog_file + kBinlogTimeIndexSuffix;
+}
+
+static const size_t kTimeEntrySize = 2 * sizeof(uint64_t);
+
+static bool ReadTimeIndex(int fd, std::string* buf) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  buf->resize(st.st_size / kTimeEntrySize * kTimeEntrySize);
+  return buf->empty() || pread(fd, &(*buf)[0], buf->size(), 0)
+    == static_cast<ssize_t>(buf->size());
+}
+
+Status BinlogTimeLookup(const std::string& binlog_file, int64_t time,
+    uint64_t* offset) {
+  int fd = open(BinlogTimeIndexFile(binlog_file).c_str(),
+      O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::NotFound("Binlog time index not exist");
+  }
+  std::string buf;
+  bool ok = ReadTimeIndex(fd, &buf);
+  close(fd);
+  if (!ok || buf.empty()) {
+    return Status::NotFound("Binlog time not indexed");
+  }
+
+  // Times are increasing, find the first one not earlier
+  size_t lo = 0, hi = buf.size() / kTimeEntrySize;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int64_t t = slash::DecodeFixed64(buf.data() + mid * kTimeEntrySize);
+    if (t < time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == buf.size() / kTimeEntrySize) {
+    return Status::EndFile("All records are earlier");
+  }
+  *offset = slash::DecodeFixed64(buf.data() + lo * kTimeEntrySize
+      + sizeof(uint64_t));
+  return Status::OK();
+}
+
+void DeleteBinlogIndex(const std::string& binlog_file) {
+  slash::DeleteFile(BinlogIndexFile(binlog_file));
+  slash::DeleteFile(BinlogTimeIndexFile(binlog_file));
+}
+
+BinlogIndexWriter::BinlogIndexWriter(int fd, uint64_t next_slot,
+    int time_fd, int64_t last_time)
+  : fd_(fd),
+  next_slot_(next_slot),
+  time_fd_(time_fd),
+  last_time_(last_time) {
+  }
+
+BinlogIndexWriter::~BinlogIndexWriter() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  if (time_fd_ >= 0) {
+    close(time_fd_);
+  }
+}
+
+// Drop entries of records not before size, return the fd
+// or -1 on failure, last_time is the time of the last entry kept
+static int OpenTimeIndex(const std::string& binlog_file, uint64_t size,
+    int64_t* last_time) {
+  *last_time = 0;
+  int fd = open(BinlogTimeIndexFile(binlog_file).c_str(),
+      O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  std::string buf;
+  if (!ReadTimeIndex(fd, &buf)) {
+    close(fd);
+    return -1;
+  }
+  size_t keep = buf.size() / kTimeEntrySize;
+  while (keep > 0 && slash::DecodeFixed64(buf.data()
+        + (keep - 1) * kTimeEntrySize + sizeof(uint64_t)) >= size) {
+    keep--;
+  }
+  if (ftruncate(fd, keep * kTimeEntrySize) != 0
+      || lseek(fd, 0, SEEK_END) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (keep > 0) {
+    *last_time = slash::DecodeFixed64(buf.data()
+        + (keep - 1) * kTimeEntrySize);
+  }
+  return fd;
+}
+
+Status BinlogIndexWriter::Open(const std::string& binlog_file, uint64_t size,
+    BinlogIndexWriter** writer) {
+  *writer = NULL;
+  int fd = open(BinlogIndexFile(binlog_file).c_str(),
+      O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return Status::IOError("open binlog index failed", strerror(errno));
+  }
+
+  // Keep slots of the complete intervals, which are not changed,
+  // the rest is extended with zero, as unknown
+  struct stat st;
+  uint64_t keep = 0;
+  if (fstat(fd, &st) == 0) {
+    keep = std::min(static_cast<uint64_t>(st.st_size) / sizeof(uint32_t),
+        size / kBinlogIndexInterval);
+  }
+  uint64_t next_slot = (size + kBinlogIndexInterval - 1)
+    / kBinlogIndexInterval;
+  if (ftruncate(fd, keep * sizeof(uint32_t)) != 0
+      || ftruncate(fd, next_slot * sizeof(uint32_t)) != 0
+      || lseek(fd, 0, SEEK_END) < 0) {
+    Status s = Status::IOError("reset binlog index failed", strerror(errno));
+    close(fd);
+    return s;
+  }
+
+  int64_t last_time = 0;
+  int time_fd = OpenTimeIndex(binlog_file, size, &last_time);
+  if (time_fd < 0) {
+    // Lookup by time will take the whole file
+    LOG(WARNING) << "Open binlog time index of " << binlog_file
+      << " failed: " << strerror(errno);
+    slash::DeleteFile(BinlogTimeIndexFile(binlog_file));
+  }
+  *writer = new BinlogIndexWriter(fd, next_slot, time_fd, last_time);
+  return Status::OK();
+}
+
+void BinlogIndexWriter::Add(uint64_t offset) {
+  if (fd_ < 0) {
+    return;
+  }
+  std::string buf;
+  AppendIndexSlots(offset, &next_slot_, &buf);
+  if (!buf.empty()
+      && write(fd_, buf.data(), buf.size())
+      != static_cast<ssize_t>(buf.size())) {
+    // Slots not written are unknown for reader
+    LOG(WARNING) << "Write binlog index failed: " << strerror(errno)
+      << ", stop indexing";
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void BinlogIndexWriter::AddTime(int64_t time, uint64_t offset) {
+  if (time_fd_ < 0 || time <= last_time_) {
+    return;
+  }
+  char buf[kTimeEntrySize];
+  slash::EncodeFixed64(buf, time);
+  slash::EncodeFixed64(buf + sizeof(uint64_t), offset);
+  if (write(time_fd_, buf, sizeof(buf))
+      != static_cast<ssize_t>(sizeof(buf))) {
+    LOG(WARNING) << "Write binlog time index failed: " << strerror(errno)
+      << ", stop time indexing";
+    close(time_fd_);
+    time_fd_ = -1;
+    return;
+  }
+  last_time_ = time;
+}
+
+
+/*
+ * BinlogCompressedFile
+ */
+static bool HasCompressMagic(int fd) {
+  char magic[8];
+  return pread(fd, magic, kBinlogCompressMagic.size(), 0)
+    == static_cast<ssize_t>(kBinlogCompressMagic.size())
+    && kBinlogCompressMagic.compare(0, std::string::npos,
+        magic, kBinlogCompressMagic.size()) == 0;
+}
+
+bool BinlogFileCompressed(const std::string& binlog_file) {
+  int fd = open(binlog_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool compressed = HasCompressMagic(fd);
+  close(fd);
+  return compressed;
+}
+
+BinlogCompressedFile::BinlogCompressedFile(int fd, uint64_t size)
+  : fd_(fd),
+  size_(size),
+  cached_(-1) {
+  }
+
+BinlogCompressedFile::~BinlogCompressedFile() {
+  close(fd_);
+}
+
+Status BinlogCompressedFile::Open(const std::string& path,
+    BinlogCompressedFile** file) {
+  *file = NULL;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::IOError("open compressed binlog failed", strerror(errno));
+  }
+  struct stat st;
+  char footer[2 * sizeof(uint64_t)];
+  if (!HasCompressMagic(fd) || fstat(fd, &st) != 0
+      || static_cast<uint64_t>(st.st_size)
+      < kBinlogCompressMagic.size() + 3 * sizeof(uint64_t)
+      || pread(fd, footer, sizeof(footer), st.st_size - sizeof(footer))
+      != static_cast<ssize_t>(sizeof(footer))) {
+    close(fd);
+    return Status::Corruption("bad compressed binlog: " + path);
+  }
+  uint64_t count = slash::DecodeFixed64(footer);
+  uint64_t size = slash::DecodeFixed64(footer + sizeof(uint64_t));
+  uint64_t table_size = (count + 1) * sizeof(uint64_t);
+  if (count != (size + kBlockSize - 1) / kBlockSize
+      || table_size + sizeof(footer) + kBinlogCompressMagic.size()
+      > static_cast<uint64_t>(st.st_size)) {
+    close(fd);
+    return Status::Corruption("bad compressed binlog: " + path);
+  }
+  std::string table(table_size, '\0');
+  if (pread(fd, &table[0], table_size,
+        st.st_size - sizeof(footer) - table_size)
+      != static_cast<ssize_t>(table_size)) {
+    close(fd);
+    return Status::IOError("read compressed binlog failed", strerror(errno));
+  }
+
+  BinlogCompressedFile* cfile = new BinlogCompressedFile(fd, size);
+  for (uint64_t i = 0; i <= count; i++) {
+    cfile->blocks_.push_back(
+        slash::DecodeFixed64(table.data() + i * sizeof(uint64_t)));
+  }
+  *file = cfile;
+  return Status::OK();
+}
+
+Status BinlogCompressedFile::LoadBlock(uint64_t index) {
+  if (cached_ == static_cast<int64_t>(index)) {
+    return Status::OK();
+  }
+  cached_ = -1;
+  if (blocks_[index + 1] < blocks_[index]) {
+    return Status::Corruption("bad compressed binlog block");
+  }
+  std::string compressed(blocks_[index + 1] - blocks_[index], '\0');
+  if (pread(fd_, &compressed[0], compressed.size(), blocks_[index])
+      != static_cast<ssize_t>(compressed.size())) {
+    return Status::IOError("read compressed binlog failed", strerror(errno));
+  }
+  if (!snappy::Uncompress(compressed.data(), compressed.size(), &cache_)) {
+    return Status::Corruption("uncompress binlog block failed");
+  }
+  cached_ = index;
+  return Status::OK();
+}
+
+ssize_t BinlogCompressedFile::Pread(char* buf, size_t n, uint64_t offset) {
+  size_t done = 0;
+  while (done < n && offset < size_) {
+    uint64_t index = offset / kBlockSize;
+    if (!LoadBlock(index).ok()) {
+      return -1;
+    }
+    uint64_t in_block = offset % kBlockSize;
+    if (in_block >= cache_.size()) {
+      break;
+    }
+    size_t len = std::min(n - done,
+        static_cast<size_t>(cache_.size() - in_block));
+    memcpy(buf + done, cache_.data() + in_block, len);
+    done += len;
+    offset += len;
+  }
+  return done;
+}
+
+// Behave as the posix one of slash, EndFile on short read
+class CompressedSequentialFile : public slash::SequentialFile {
+ public:
+  explicit CompressedSequentialFile(BinlogCompressedFile* file)
+    : file_(file),
+    offset_(0) {
+    }
+  virtual ~CompressedSequentialFile() {
+    delete file_;
+  }
+
+  virtual Status Read(size_t n, Slice* result, char* scratch) {
+    ssize_t r = file_->Pread(scratch, n, offset_);
+    if (r < 0) {
+      *result = Slice(scratch, 0);
+      return Status::IOError("read compressed binlog failed");
+    }
+    offset_ += r;
+    *result = Slice(scratch, r);
+    if (static_cast<size_t>(r) < n) {
+      return Status::EndFile("end file");
+    }
+    return Status::OK();
+  }
+
+  virtual Status Skip(uint64_t n) {
+    offset_ += n;
+    return Status::OK();
+  }
+
+  virtual char* ReadLine(char* buf, int n) {
+    return NULL;
+  }
+
+ private:
+  BinlogCompressedFile* file_;
+  uint64_t offset_;
+};
+
+Status BinlogFileSize(const std::string& binlog_file, uint64_t* size) {
+  if (!BinlogFileCompressed(binlog_file)) {
+    return slash::GetFileSize(binlog_file, size);
+  }
+  BinlogCompressedFile* cfile = NULL;
+  Status s = BinlogCompressedFile::Open(binlog_file, &cfile);
+  if (s.ok()) {
+    *size = cfile->size();
+    delete cfile;
+  }
+  return s;
+}
+
+Status NewBinlogSequentialFile(const std::string& binlog_file,
+    slash::SequentialFile** file) {
+  if (!BinlogFileCompressed(binlog_file)) {
+    return slash::NewSequentialFile(binlog_file, file);
+  }
+  BinlogCompressedFile* cfile = NULL;
+  Status s = BinlogCompressedFile::Open(binlog_file, &cfile);
+  if (s.ok()) {
+    *file = new CompressedSequentialFile(cfile);
+  }
+  return s;
+}
+
+Status CompressBinlogFile(const std::string& binlog_file,
+    const std::string& dst_file) {
+  int fd = open(binlog_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::IOError("open binlog failed", strerror(errno));
+  }
+  struct stat st;
+  if (HasCompressMagic(fd) || fstat(fd, &st) != 0) {
+    close(fd);
+    return Status::InvalidArgument("binlog compressed already");
+  }
+
+  int out = open(dst_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      0644);
+  if (out < 0) {
+    close(fd);
+    return Status::IOError("open compress file failed", strerror(errno));
+  }
+
+  // Write every block right away, only the table is kept in memory
+  std::string block(kBlockSize, '\0'), compressed, table;
+  char tmp[sizeof(uint64_t)];
+  uint64_t size = 0, pos = kBinlogCompressMagic.size();
+  bool ok = write(out, kBinlogCompressMagic.data(),
+      kBinlogCompressMagic.size())
+    == static_cast<ssize_t>(kBinlogCompressMagic.size());
+  while (ok) {
+    ssize_t n = pread(fd, &block[0], kBlockSize, size);
+    if (n <= 0) {
+      ok = (n == 0);
+      break;
+    }
+    snappy::Compress(block.data(), n, &compressed);
+    slash::EncodeFixed64(tmp, pos);
+    table.append(tmp, sizeof(tmp));
+    ok = write(out, compressed.data(), compressed.size())
+      == static_cast<ssize_t>(compressed.size());
+    pos += compressed.size();
+    size += n;
+  }
+  slash::EncodeFixed64(tmp, pos);
+  table.append(tmp, sizeof(tmp));
+  slash::EncodeFixed64(tmp, table.size() / sizeof(tmp) - 1);
+  table.append(tmp, sizeof(tmp));
+  slash::EncodeFixed64(tmp, size);
+  table.append(tmp, sizeof(tmp));
+  close(fd);
+
+  // Keep mtime, which binlog_remain_days counts from
+  struct timespec times[2] = {st.st_atim, st.st_mtim};
+  ok = ok && size == static_cast<uint64_t>(st.st_size)
+    && write(out, table.data(), table.size())
+    == static_cast<ssize_t>(table.size())
+    && fsync(out) == 0
+    && futimens(out, times) == 0;
+  close(out);
+  if (!ok) {
+    slash::DeleteFile(dst_file);
+    return Status::IOError("compress binlog failed: " + binlog_file);
+  }
+  return Status::OK();
+}
+
+
 /**
  * BinlogWriter
  */
-BinlogWriter::BinlogWriter(slash::WritableFile *queue)
+BinlogWriter::BinlogWriter(slash::WritableFile *queue,
+    BinlogIndexWriter* index)
   :queue_(queue),
+  index_(index),
   block_offset_(0) {
     Load();
   }
@@ -109,12 +634,15 @@ Status BinlogWriter::Fallback(uint64_t offset) {
   return s;
 }
  
-Status BinlogWriter::Produce(const Slice &item, int64_t *write_size) {
+Status BinlogWriter::Produce(const Slice &item, int64_t *write_size,
+    int64_t time) {
   Status s;
   const char *ptr = item.data();
   size_t left = item.size();
   bool begin = true;
 
+  // Item begins before the padding, same as where the last one ends
+  uint64_t item_begin = queue_->Filesize();
   *write_size = 0;
   do {
     const int leftover = static_cast<int>(kBlockSize) - block_offset_;
@@ -142,6 +670,12 @@ Status BinlogWriter::Produce(const Slice &item, int64_t *write_size) {
     }
 
     s = EmitPhysicalRecord(type, ptr, fragment_length, write_size);
+    if (s.ok() && begin && index_ != NULL) {
+      index_->Add(item_begin);
+      if (time > 0) {
+        index_->AddTime(time, item_begin);
+      }
+    }
     ptr += fragment_length;
     left -= fragment_length;
     begin = false;
@@ -175,33 +709,51 @@ Status BinlogWriter::EmitPhysicalRecord(RecordType t, const char *ptr, size_t n,
     return s;
 }
 
+// Fill exactly len bytes with blank records and the block trailers
+// among them, so that any range of records could be replaced by it
 Status BinlogWriter::AppendBlank(uint64_t len, int64_t* write_size) {
-  Status s;
+  *write_size = 0;
   if (len < kHeaderSize) {
     return Status::InvalidArgument("Blank len too small");
   }
+  // Check first, never leave a partial blank
+  uint64_t pos = block_offset_;
+  uint64_t left = len;
+  while (left > 0) {
+    const uint64_t leftover = kBlockSize - pos;
+    const uint64_t n = std::min(left, leftover);
+    if (leftover <= kHeaderSize ? n < leftover : n < kHeaderSize) {
+      return Status::InvalidArgument("Blank end inside a header or trailer");
+    }
+    left -= n;
+    pos = (pos + n) % kBlockSize;
+  }
 
-  size_t left = len - kHeaderSize;
-
-  *write_size = 0;
+  Status s;
+  left = len;
   char tmp[kBlockSize] = {'\x00'};
-  do {
+  while (s.ok() && left > 0) {
+    // Every blank fragment could be seeked to
+    uint64_t fragment_begin = queue_->Filesize();
     const int leftover = static_cast<int>(kBlockSize) - block_offset_;
     assert(leftover >= 0);
     if (static_cast<size_t>(leftover) <= kHeaderSize) {
       if (leftover > 0) {
-        queue_->Append(Slice("\x00\x00\x00\x00\x00\x00\x00", leftover));
+        s = queue_->Append(Slice("\x00\x00\x00\x00\x00\x00\x00", leftover));
         *write_size += leftover;
+        left -= leftover;
       }
       block_offset_ = 0;
+      continue;
     }
 
-    const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
-    const size_t fragment_length = (left < avail) ? left : avail;
-
-    s = EmitPhysicalRecord(kEmptyType, tmp, fragment_length, write_size);
-    left -= fragment_length;
-  } while (s.ok() && left > 0);
+    const size_t n = std::min(left, static_cast<uint64_t>(leftover));
+    s = EmitPhysicalRecord(kEmptyType, tmp, n - kHeaderSize, write_size);
+    if (s.ok() && index_ != NULL) {
+      index_->Add(fragment_begin);
+    }
+    left -= n;
+  }
 
   return s;
 }
@@ -286,14 +838,28 @@ Status BinlogReader::Consume(uint64_t* size, std::string* scratch) {
 // pre_item_offset record the nearest item begin
 // Seek to a offset larger than the filesize will return Status::EOF
 Status BinlogReader::Seek(uint64_t offset) {
-  uint64_t start_block = BinlogBlockStart(offset);
-  Status s = queue_->Skip(start_block);
+  return SeekFrom(BinlogBlockStart(offset), offset);
+}
+
+Status BinlogReader::Seek(uint64_t offset, const std::string& binlog_file) {
+  uint64_t begin = 0;
+  Status s = BinlogIndexLookup(binlog_file, offset, &begin);
+  if (s.IsInvalidArgument()) {
+    return s;
+  }
+  return s.ok() ? SeekFrom(begin, offset) : Seek(offset);
+}
+
+// Consume from begin, which is a block start or a record begin
+Status BinlogReader::SeekFrom(uint64_t begin, uint64_t offset) {
+  Status s = queue_->Skip(begin);
   if (!s.ok()) {
     return s;
   }
-  int64_t block_offset = offset % kBlockSize;
+  last_record_offset_ = begin % kBlockSize;
+  int64_t left = offset - begin;
 
-  while (block_offset > 0) {
+  while (left > 0) {
     uint64_t size = 0;
     std::string tmp;
     s = Consume(&size, &tmp);
@@ -304,9 +870,9 @@ Status BinlogReader::Seek(uint64_t offset) {
     } else {
       SkipNextBlock(&size);
     }
-    block_offset -= size;
+    left -= size;
   }
-  if (block_offset != 0) {
+  if (left != 0) {
     // offset not availible
     return Status::InvalidArgument("Binlog offset not available");
   }
@@ -361,6 +927,37 @@ unsigned int BinlogReader::ReadPhysicalRecord(uint64_t *size, slash::Slice *resu
 }
 
 
+/*
+ * BinlogReadahead
+ */
+BinlogReadahead::BinlogReadahead(const std::string& filename)
+  : ahead_(0) {
+  fd_ = open(filename.c_str(), O_RDONLY);
+  if (fd_ >= 0 && HasCompressMagic(fd_)) {
+    // Offsets are not of the file
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+BinlogReadahead::~BinlogReadahead() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void BinlogReadahead::Advance(uint64_t offset) {
+  if (fd_ < 0 || offset + kBinlogReadaheadSize / 2 < ahead_) {
+    return;
+  }
+  // Page cache is shared, the hint on our fd also serve the reader
+  uint64_t begin = std::max(offset, ahead_);
+  posix_fadvise(fd_, begin, offset + kBinlogReadaheadSize - begin,
+      POSIX_FADV_WILLNEED);
+  ahead_ = offset + kBinlogReadaheadSize;
+}
+
+
 /*
  * Binlog
  */
@@ -380,6 +977,11 @@ Status Binlog::Create(const std::string& binlog_path,
 Status Binlog::Init() {
   // Create env need
   slash::CreateDir(binlog_path_);
+
+  // Left by last run
+  if (slash::FileExists(binlog_path_ + kBinlogNextFile)) {
+    slash::DeleteFile(binlog_path_ + kBinlogNextFile);
+  }
   
   Status s;
   std::string binlog_name;
@@ -404,7 +1006,7 @@ Status Binlog::Init() {
         << binlog_name << " " << s.ToString();
       return s;
     }
-    writer_ = new BinlogWriter(queue_);
+    OpenWriter(binlog_name, 0);
 
   } else {
     // Manifest exist
@@ -430,7 +1032,7 @@ Status Binlog::Init() {
         << binlog_name << " " << s.ToString();
       return s;
     }
-    writer_ = new BinlogWriter(queue_);
+    OpenWriter(binlog_name, file_offset);
   }
   return Status::OK();
 }
@@ -441,7 +1043,9 @@ Binlog::Binlog(const std::string& binlog_path, const int file_size)
   manifest_(NULL),
   version_(NULL),
   queue_(NULL),
-  writer_(NULL) {
+  writer_(NULL),
+  index_(NULL),
+  next_queue_(NULL) {
     if (binlog_path_.back() != '/') {
       binlog_path_.append(1, '/');
     }
@@ -450,11 +1054,30 @@ Binlog::Binlog(const std::string& binlog_path, const int file_size)
 
 Binlog::~Binlog() {
   delete writer_;
+  delete index_;
   delete queue_;
+  if (next_queue_ != NULL) {
+    delete next_queue_;
+    slash::DeleteFile(binlog_path_ + kBinlogNextFile);
+  }
   delete version_;
   delete manifest_;
 }
 
+// Required hold mutex_, queue_ is opened on binlog_file
+void Binlog::OpenWriter(const std::string& binlog_file, uint64_t size) {
+  delete index_;
+  index_ = NULL;
+  Status s = BinlogIndexWriter::Open(binlog_file, size, &index_);
+  if (!s.ok()) {
+    // No index is better than a stale one
+    LOG(WARNING) << "Failed to open binlog index of " << binlog_file
+      << ", " << s.ToString();
+    DeleteBinlogIndex(binlog_file);
+  }
+  writer_ = new BinlogWriter(queue_, index_);
+}
+
 // Required hold mutex_
 void Binlog::MaybeRoll() {
   /* Check to roll log file */
@@ -465,17 +1088,46 @@ void Binlog::MaybeRoll() {
 
     uint32_t pro_num = version_->pro_num() + 1;
     std::string profile = NewFileName(filename_, pro_num);
-    slash::NewWritableFile(profile, &queue_);
-    writer_ = new BinlogWriter(queue_);
+    if (next_queue_ != NULL
+        && rename((binlog_path_ + kBinlogNextFile).c_str(),
+          profile.c_str()) == 0) {
+      queue_ = next_queue_;
+    } else {
+      delete next_queue_;
+      slash::NewWritableFile(profile, &queue_);
+    }
+    next_queue_ = NULL;
+    OpenWriter(profile, 0);
     version_->Save(pro_num, 0);
   }
 }
 
-Status Binlog::Put(const std::string &item) {
+// Only called by one thread, file creation is out of mutex_
+void Binlog::PrepareNextFile() {
+  {
+    slash::MutexLock l(&mutex_);
+    if (next_queue_ != NULL
+        || queue_->Filesize() < file_size_ / 2) {
+      return;
+    }
+  }
+  slash::WritableFile* next = NULL;
+  Status s = slash::NewWritableFile(binlog_path_ + kBinlogNextFile, &next);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to create next binlog file in "
+      << binlog_path_ << ", " << s.ToString();
+    return;
+  }
+  slash::MutexLock l(&mutex_);
+  next_queue_ = next;
+}
+
+Status Binlog::Put(const std::string &item, int64_t time) {
   slash::MutexLock l(&mutex_);
 
   int64_t go_ahead = 0;
-  Status s = writer_->Produce(Slice(item.data(), item.size()), &go_ahead);
+  Status s = writer_->Produce(Slice(item.data(), item.size()), &go_ahead,
+      time);
   version_->Inc(go_ahead);
   MaybeRoll();
   if (!s.ok()) {
@@ -498,6 +1150,64 @@ Status Binlog::PutBlank(uint64_t len) {
   return s;
 }
 
+void Binlog::FindOffsetByTime(int64_t time, uint32_t* filenum,
+    uint64_t* offset) {
+  uint32_t pro_num = 0;
+  uint64_t pro_offset = 0;
+  GetProducerStatus(&pro_num, &pro_offset);
+  uint32_t num = pro_num;
+  while (num > 0 && slash::FileExists(NewFileName(filename_, num - 1))) {
+    num--;
+  }
+  for (; num <= pro_num; num++) {
+    Status s = BinlogTimeLookup(NewFileName(filename_, num), time, offset);
+    if (s.IsEndFile()) {
+      continue;
+    }
+    if (!s.ok()) {
+      *offset = 0;
+    }
+    *filenum = num;
+    return;
+  }
+  // All records are earlier, start from the end
+  GetProducerStatus(filenum, offset);
+}
+
+// Compress out of mutex_, and replace the file in it only if
+// the file is not removed meanwhile
+Status Binlog::CompressFile(uint32_t num) {
+  std::string file = NewFileName(filename_, num);
+  std::string tmp_file = file + kBinlogCompressTmpSuffix;
+  struct stat before;
+  {
+    slash::MutexLock l(&mutex_);
+    if (num >= version_->pro_num()) {
+      return Status::InvalidArgument("binlog not finished");
+    }
+    if (stat(file.c_str(), &before) != 0) {
+      return Status::NotFound("binlog not exist");
+    }
+  }
+  Status s = CompressBinlogFile(file, tmp_file);
+  if (!s.ok()) {
+    return s;
+  }
+
+  slash::MutexLock l(&mutex_);
+  struct stat after;
+  if (stat(file.c_str(), &after) != 0 || after.st_ino != before.st_ino) {
+    slash::DeleteFile(tmp_file);
+    return Status::NotFound("binlog removed while compressing");
+  }
+  if (rename(tmp_file.c_str(), file.c_str()) != 0) {
+    slash::DeleteFile(tmp_file);
+    return Status::IOError("rename compressed binlog failed",
+        strerror(errno));
+  }
+  return Status::OK();
+}
+
 // Required hold mutex_
 // Remove Binlog file in the range [lboud, rbound]
 // Notice it's closed interval
@@ -506,6 +1216,7 @@ Status Binlog::RemoveBetween(int lbound, int rbound) {
   std::string target_name;
   for (int i = lbound; i <= rbound; i++) {
     target_name =  NewFileName(filename_, i);
+    DeleteBinlogIndex(target_name);
     if (!slash::FileExists(target_name)) {
       continue;
     }
@@ -552,7 +1263,7 @@ Status Binlog::SetProducerStatus(uint32_t pro_num, uint64_t pro_offset,
   // Create binlog file
   std::string profile = NewFileName(filename_, pro_num);
   slash::NewWritableFile(profile, &queue_);
-  writer_ = new BinlogWriter(queue_);
+  OpenWriter(profile, 0);
   
   // TODO(wangk) Optimize, actual_offset should be as close as the pro_offset 
   // with writer_->Fallback();
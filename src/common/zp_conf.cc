@@ -9,193 +9,392 @@ static int64_t BoundaryLimit(int64_t target, int64_t floor, int64_t ceil) {
   return target;
 }
 
+// Parse cpu list like "0-7,16-23", empty list on invalid one
+static std::vector<int> ParseCpuList(const std::string& name,
+    const std::string& str) {
+  std::vector<int> cpus;
+  std::vector<std::string> elems;
+  slash::StringSplit(str, ',', elems);
+  for (auto& elem : elems) {
+    int64_t begin = 0, end = 0;
+    size_t pos = elem.find('-');
+    bool valid = (pos == std::string::npos)
+      ? slash::string2l(elem.data(), elem.size(), &begin)
+      : (slash::string2l(elem.data(), pos, &begin)
+          && slash::string2l(elem.data() + pos + 1,
+            elem.size() - pos - 1, &end));
+    if (pos == std::string::npos) {
+      end = begin;
+    }
+    if (!valid || begin < 0 || end < begin || end >= kMaxCpuNum) {
+      fprintf(stderr, "Invalid cpu list %s : %s, ignored\n",
+          name.c_str(), str.c_str());
+      return std::vector<int>();
+    }
+    for (int64_t i = begin; i <= end; i++) {
+      cpus.push_back(i);
+    }
+  }
+  return cpus;
+}
+
+static std::string CpuListString(const std::vector<int>& cpus) {
+  std::string str;
+  for (size_t i = 0; i < cpus.size(); i++) {
+    str.append(i == 0 ? "" : ",").append(std::to_string(cpus[i]));
+  }
+  return str;
+}
+
+ZpConfItems::ZpConfItems()
+  : local_ip("127.0.0.1"),
+  local_port(9999),
+  sync_listen_port(0),
+  timeout(100),
+  data_path("data"),
+  log_path("log"),
+  trash_path("trash"),
+  daemonize(false),
+  pid_file(log_path + "/" + kZpPidFile),
+  lock_file(log_path + "/" + kZpLockFile),
+  enable_data_delete(true),
+  meta_thread_num(4),
+  data_thread_num(6),
+  sync_recv_thread_num(4),
+  sync_send_thread_num(4),
+  client_loop_num(0),
+  max_background_flushes(24),
+  max_background_compactions(24),
+  binlog_remain_days(kBinlogRemainMaxDay),
+  binlog_remain_min_count(kBinlogRemainMinCount),
+  binlog_remain_max_count(kBinlogRemainMaxCount),
+  binlog_compress_hours(0),
+  sync_dedup_distance(0),
+  db_write_buffer_size(256 * 1024), // 256KB
+  db_max_write_buffer(20 * 1024 * 1024), // 20MB
+  db_target_file_size_base(256 * 1024), // 256KB
+  db_max_open_files(4096),
+  db_block_size(16), // 16 B
+  slowlog_slower_than(-1),
+  stuck_offset_dist(kMetaOffsetStuckDist), // 100KB
+  slowdown_delay_radio(kSlowdownDelayRatio),  // 60%
+  migrate_count_once(kMetaMigrateOnceCount),  // 2
+  backup_path("backup"),
+  backup_speed_limit(kBackupSpeedLimit),
+  subscribe_pin_binlog_count(kSubscribePinBinlogCount),
+  floyd_check_leader_us(3000000),
+  floyd_heartbeat_us(1000000),
+  floyd_append_entries_size_once(1024000),
+  floyd_append_entries_count_once(128) {
+  }
+
 ZpConf::ZpConf(const std::string& path)
   : conf_adaptor_(path),
-  local_ip_("127.0.0.1"),
-  local_port_(9999),
-  timeout_(100),
-  data_path_("data"),
-  log_path_("log"),
-  trash_path_("trash"),
-  daemonize_(false),
-  pid_file_(log_path_ + "/" + kZpPidFile),
-  lock_file_(log_path_ + "/" + kZpLockFile),
-  enable_data_delete_(true),
-  meta_thread_num_(4),
-  data_thread_num_(6),
-  sync_recv_thread_num_(4),
-  sync_send_thread_num_(4),
-  max_background_flushes_(24),
-  max_background_compactions_(24),
-  binlog_remain_days_(kBinlogRemainMaxDay),
-  binlog_remain_min_count_(kBinlogRemainMinCount),
-  binlog_remain_max_count_(kBinlogRemainMaxCount),
-  db_write_buffer_size_(256 * 1024), // 256KB
-  db_max_write_buffer_(20 * 1024 * 1024), // 20MB
-  db_target_file_size_base_(256 * 1024), // 256KB
-  db_max_open_files_(4096),
-  db_block_size_(16), // 16 B
-  slowlog_slower_than_(-1),
-  stuck_offset_dist_(kMetaOffsetStuckDist), // 100KB
-  slowdown_delay_radio_(kSlowdownDelayRatio),  // 60%
-  migrate_count_once_(kMetaMigrateOnceCount),  // 2
-  floyd_check_leader_us_(15000000),
-  floyd_heartbeat_us_(6000000),
-  floyd_append_entries_size_once_(1024000),
-  floyd_append_entries_count_once_(128) {
-    pthread_rwlock_init(&rwlock_, NULL);
+  items_(new ZpConfItems()) {
   }
 
 ZpConf::~ZpConf() {
-  pthread_rwlock_destroy(&rwlock_);
+  for (auto old : retired_) {
+    delete old;
+  }
+  delete items();
+}
+
+void ZpConf::Publish(ZpConfItems* new_items) {
+  retired_.push_back(items_.exchange(new_items, std::memory_order_acq_rel));
+}
+
+bool ZpConf::Update(const std::function<bool(ZpConfItems*)>& update) {
+  slash::MutexLock l(&mutex_);
+  ZpConfItems* new_items = new ZpConfItems(*items());
+  if (!update(new_items)) {
+    delete new_items;
+    return false;
+  }
+  Publish(new_items);
+  return true;
+}
+
+bool ZpConf::SetMetaAddr(const std::set<std::string>& new_addrs) {
+  return Update([&new_addrs](ZpConfItems* c) {
+    std::vector<std::string> addrs(new_addrs.begin(), new_addrs.end());
+    if (addrs == c->meta_addr) {
+      return false;
+    }
+    c->meta_addr.swap(addrs);
+    return true;
+  });
 }
 
 void ZpConf::Dump() const {
-  auto iter = meta_addr_.begin();
-  while (iter != meta_addr_.end()) {
+  const ZpConfItems* c = items();
+  auto iter = c->meta_addr.begin();
+  while (iter != c->meta_addr.end()) {
     fprintf(stderr, "    Config.meta_addr         : %s\n", iter->c_str());
     iter++;
   }
-  fprintf (stderr, "    Config.local_ip           : %s\n", local_ip_.c_str());
-  fprintf (stderr, "    Config.local_port         : %d\n", local_port_);
-  fprintf (stderr, "    Config.data_path          : %s\n", data_path_.c_str());
-  fprintf (stderr, "    Config.log_path           : %s\n", log_path_.c_str());
-  fprintf (stderr, "    Config.trash_path         : %s\n", trash_path_.c_str());
-  fprintf (stderr, "    Config.daemonize          : %s\n", daemonize_? "true":"false");
-  fprintf (stderr, "    Config.pid_file           : %s\n", pid_file_.c_str());
-  fprintf (stderr, "    Config.lock_file          : %s\n", lock_file_.c_str());
-  fprintf (stderr, "    Config.enable_data_delete : %s\n", enable_data_delete_ ? "true":"false");
-
-  fprintf (stderr, "    Config.meta_thread_num            : %d\n", meta_thread_num_);
-  fprintf (stderr, "    Config.data_thread_num            : %d\n", data_thread_num_);
-  fprintf (stderr, "    Config.sync_recv_thread_num       : %d\n", sync_recv_thread_num_);
-  fprintf (stderr, "    Config.sync_send_thread_num       : %d\n", sync_send_thread_num_);
-  fprintf (stderr, "    Config.max_background_flushes     : %d\n", max_background_flushes_);
-  fprintf (stderr, "    Config.max_background_compactions : %d\n", max_background_compactions_);
-
-  fprintf (stderr, "    Config.binlog_remain_days       : %d\n", binlog_remain_days_);
-  fprintf (stderr, "    Config.binlog_remain_min_count  : %d\n", binlog_remain_min_count_);
-  fprintf (stderr, "    Config.binlog_remain_max_count  : %d\n", binlog_remain_max_count_);
-
-  fprintf (stderr, "    Config.db_write_buffer_size     : %dKB\n", db_write_buffer_size_ / 1024);
-  fprintf (stderr, "    Config.db_max_write_buffer      : %dMB\n", db_max_write_buffer_ / 1024 / 1024);
-  fprintf (stderr, "    Config.db_target_file_size_base : %dKB\n", db_target_file_size_base_ / 1024);
-  fprintf (stderr, "    Config.db_max_open_files        : %d\n", db_max_open_files_);
-  fprintf (stderr, "    Config.db_block_size            : %dB\n", db_block_size_);
-  fprintf (stderr, "    Config.slowlog_slower_than      : %d\n", slowlog_slower_than_);
-  fprintf (stderr, "    Config.stuck_offset_dist        : %dKB\n", stuck_offset_dist_ / 1024);
-  fprintf (stderr, "    Config.slowdown_delay_radio     : %d%%\n", slowdown_delay_radio_);
-  fprintf (stderr, "    Config.migrate_count_once     : %d\n", migrate_count_once_);
-
-  fprintf (stderr, "    Config.floyd_check_leader_us            : %d\n", floyd_check_leader_us_);
-  fprintf (stderr, "    Config.floyd_heartbeat_us               : %d\n", floyd_heartbeat_us_);
-  fprintf (stderr, "    Config.floyd_append_entries_size_once_  : %d\n", floyd_append_entries_size_once_);
-  fprintf (stderr, "    Config.floyd_append_entries_count_once_ : %d\n", floyd_append_entries_count_once_);
+  fprintf (stderr, "    Config.local_ip           : %s\n", c->local_ip.c_str());
+  fprintf (stderr, "    Config.local_port         : %d\n", c->local_port);
+  fprintf (stderr, "    Config.sync_listen_port   : %d\n", c->sync_listen_port);
+  fprintf (stderr, "    Config.data_path          : %s\n", c->data_path.c_str());
+  fprintf (stderr, "    Config.log_path           : %s\n", c->log_path.c_str());
+  fprintf (stderr, "    Config.trash_path         : %s\n", c->trash_path.c_str());
+  fprintf (stderr, "    Config.daemonize          : %s\n", c->daemonize? "true":"false");
+  fprintf (stderr, "    Config.pid_file           : %s\n", c->pid_file.c_str());
+  fprintf (stderr, "    Config.lock_file          : %s\n", c->lock_file.c_str());
+  fprintf (stderr, "    Config.enable_data_delete : %s\n", c->enable_data_delete ? "true":"false");
+
+  fprintf (stderr, "    Config.meta_thread_num            : %d\n", c->meta_thread_num);
+  fprintf (stderr, "    Config.data_thread_num            : %d\n", c->data_thread_num);
+  fprintf (stderr, "    Config.sync_recv_thread_num       : %d\n", c->sync_recv_thread_num);
+  fprintf (stderr, "    Config.sync_send_thread_num       : %d\n", c->sync_send_thread_num);
+  fprintf (stderr, "    Config.client_loop_num            : %d\n", c->client_loop_num);
+  fprintf (stderr, "    Config.max_background_flushes     : %d\n", c->max_background_flushes);
+  fprintf (stderr, "    Config.max_background_compactions : %d\n", c->max_background_compactions);
+  fprintf (stderr, "    Config.dispatch_cpus              : %s\n", CpuListString(c->dispatch_cpus).c_str());
+  fprintf (stderr, "    Config.sync_recv_cpus             : %s\n", CpuListString(c->sync_recv_cpus).c_str());
+  fprintf (stderr, "    Config.sync_send_cpus             : %s\n", CpuListString(c->sync_send_cpus).c_str());
+  fprintf (stderr, "    Config.bg_cpus                    : %s\n", CpuListString(c->bg_cpus).c_str());
+  fprintf (stderr, "    Config.db_cpus                    : %s\n", CpuListString(c->db_cpus).c_str());
+
+  fprintf (stderr, "    Config.binlog_remain_days       : %d\n", c->binlog_remain_days);
+  fprintf (stderr, "    Config.binlog_remain_min_count  : %d\n", c->binlog_remain_min_count);
+  fprintf (stderr, "    Config.binlog_remain_max_count  : %d\n", c->binlog_remain_max_count);
+  fprintf (stderr, "    Config.binlog_compress_hours    : %d\n", c->binlog_compress_hours);
+  fprintf (stderr, "    Config.sync_dedup_distance      : %dMB\n", c->sync_dedup_distance);
+
+  fprintf (stderr, "    Config.db_write_buffer_size     : %dKB\n", c->db_write_buffer_size / 1024);
+  fprintf (stderr, "    Config.db_max_write_buffer      : %dMB\n", c->db_max_write_buffer / 1024 / 1024);
+  fprintf (stderr, "    Config.db_target_file_size_base : %dKB\n", c->db_target_file_size_base / 1024);
+  fprintf (stderr, "    Config.db_max_open_files        : %d\n", c->db_max_open_files);
+  fprintf (stderr, "    Config.db_block_size            : %dB\n", c->db_block_size);
+  fprintf (stderr, "    Config.slowlog_slower_than      : %d\n", c->slowlog_slower_than);
+  fprintf (stderr, "    Config.stuck_offset_dist        : %dKB\n", c->stuck_offset_dist / 1024);
+  fprintf (stderr, "    Config.slowdown_delay_radio     : %d%%\n", c->slowdown_delay_radio);
+  fprintf (stderr, "    Config.migrate_count_once     : %d\n", c->migrate_count_once);
+  fprintf (stderr, "    Config.backup_path              : %s\n", c->backup_path.c_str());
+  fprintf (stderr, "    Config.backup_speed_limit       : %dMB/s\n", c->backup_speed_limit);
+  fprintf (stderr, "    Config.subscribe_pin_binlog_count : %d\n", c->subscribe_pin_binlog_count);
+
+  fprintf (stderr, "    Config.floyd_check_leader_us            : %d\n", c->floyd_check_leader_us);
+  fprintf (stderr, "    Config.floyd_heartbeat_us               : %d\n", c->floyd_heartbeat_us);
+  fprintf (stderr, "    Config.floyd_append_entries_size_once  : %d\n", c->floyd_append_entries_size_once);
+  fprintf (stderr, "    Config.floyd_append_entries_count_once : %d\n", c->floyd_append_entries_count_once);
 }
 
 bool ZpConf::Rewrite() {
-  conf_adaptor_.SetConfStr("local_ip", local_ip_);
-  conf_adaptor_.SetConfInt("local_port", local_port_);
-  conf_adaptor_.SetConfStr("data_path", data_path_);
-  conf_adaptor_.SetConfStr("log_path", log_path_);
-  conf_adaptor_.SetConfStr("trash_path", trash_path_);
-  conf_adaptor_.SetConfBool("daemonize", daemonize_);
-  conf_adaptor_.SetConfStrVec("meta_addr", meta_addr_);
-  conf_adaptor_.SetConfBool("enable_data_delete", enable_data_delete_);
-  conf_adaptor_.SetConfInt("meta_thread_num", meta_thread_num_);
-  conf_adaptor_.SetConfInt("data_thread_num", data_thread_num_);
-  conf_adaptor_.SetConfInt("sync_recv_thread_num", sync_recv_thread_num_);
-  conf_adaptor_.SetConfInt("sync_send_thread_num", sync_send_thread_num_);
-  conf_adaptor_.SetConfInt("max_background_flushes", max_background_flushes_);
-  conf_adaptor_.SetConfInt("max_background_compactions", max_background_compactions_);
-  conf_adaptor_.SetConfInt("binlog_remain_days", binlog_remain_days_);
-  conf_adaptor_.SetConfInt("binlog_remain_min_count", binlog_remain_min_count_);
-  conf_adaptor_.SetConfInt("binlog_remain_max_count", binlog_remain_max_count_);
-  conf_adaptor_.SetConfInt("db_write_buffer_size", db_write_buffer_size_);
-  conf_adaptor_.SetConfInt("db_max_write_buffer", db_max_write_buffer_);
-  conf_adaptor_.SetConfInt("db_target_file_size_base", db_target_file_size_base_);
-  conf_adaptor_.SetConfInt("db_max_open_files", db_max_open_files_);
-  conf_adaptor_.SetConfInt("db_block_size", db_block_size_);
-  conf_adaptor_.SetConfInt("slowlog_slower_than", slowlog_slower_than_);
-  conf_adaptor_.SetConfInt("stuck_offset_dist", stuck_offset_dist_);
-  conf_adaptor_.SetConfInt("slowdown_delay_radio", slowdown_delay_radio_);
-  conf_adaptor_.SetConfInt("migrate_count_once", migrate_count_once_);
-  conf_adaptor_.SetConfInt("floyd_check_leader_us", floyd_check_leader_us_);
-  conf_adaptor_.SetConfInt("floyd_heartbeat_us", floyd_heartbeat_us_);
-  conf_adaptor_.SetConfInt("floyd_append_entries_size_once", floyd_append_entries_size_once_);
-  conf_adaptor_.SetConfInt("floyd_append_entries_count_once", floyd_append_entries_count_once_);
+  slash::MutexLock l(&mutex_);
+  const ZpConfItems* c = items();
+  conf_adaptor_.SetConfStr("local_ip", c->local_ip);
+  conf_adaptor_.SetConfInt("local_port", c->local_port);
+  conf_adaptor_.SetConfInt("sync_listen_port", c->sync_listen_port);
+  conf_adaptor_.SetConfStr("data_path", c->data_path);
+  conf_adaptor_.SetConfStr("log_path", c->log_path);
+  conf_adaptor_.SetConfStr("trash_path", c->trash_path);
+  conf_adaptor_.SetConfBool("daemonize", c->daemonize);
+  conf_adaptor_.SetConfStrVec("meta_addr", c->meta_addr);
+  conf_adaptor_.SetConfBool("enable_data_delete", c->enable_data_delete);
+  conf_adaptor_.SetConfInt("meta_thread_num", c->meta_thread_num);
+  conf_adaptor_.SetConfInt("data_thread_num", c->data_thread_num);
+  conf_adaptor_.SetConfInt("sync_recv_thread_num", c->sync_recv_thread_num);
+  conf_adaptor_.SetConfInt("sync_send_thread_num", c->sync_send_thread_num);
+  conf_adaptor_.SetConfInt("client_loop_num", c->client_loop_num);
+  conf_adaptor_.SetConfInt("max_background_flushes", c->max_background_flushes);
+  conf_adaptor_.SetConfInt("max_background_compactions", c->max_background_compactions);
+  conf_adaptor_.SetConfStr("dispatch_cpus", c->dispatch_cpus_str);
+  conf_adaptor_.SetConfStr("sync_recv_cpus", c->sync_recv_cpus_str);
+  conf_adaptor_.SetConfStr("sync_send_cpus", c->sync_send_cpus_str);
+  conf_adaptor_.SetConfStr("bg_cpus", c->bg_cpus_str);
+  conf_adaptor_.SetConfStr("db_cpus", c->db_cpus_str);
+  conf_adaptor_.SetConfInt("binlog_remain_days", c->binlog_remain_days);
+  conf_adaptor_.SetConfInt("binlog_remain_min_count", c->binlog_remain_min_count);
+  conf_adaptor_.SetConfInt("binlog_remain_max_count", c->binlog_remain_max_count);
+  conf_adaptor_.SetConfInt("binlog_compress_hours", c->binlog_compress_hours);
+  conf_adaptor_.SetConfInt("sync_dedup_distance", c->sync_dedup_distance);
+  conf_adaptor_.SetConfInt("db_write_buffer_size", c->db_write_buffer_size);
+  conf_adaptor_.SetConfInt("db_max_write_buffer", c->db_max_write_buffer);
+  conf_adaptor_.SetConfInt("db_target_file_size_base", c->db_target_file_size_base);
+  conf_adaptor_.SetConfInt("db_max_open_files", c->db_max_open_files);
+  conf_adaptor_.SetConfInt("db_block_size", c->db_block_size);
+  conf_adaptor_.SetConfInt("slowlog_slower_than", c->slowlog_slower_than);
+  conf_adaptor_.SetConfInt("stuck_offset_dist", c->stuck_offset_dist);
+  conf_adaptor_.SetConfInt("slowdown_delay_radio", c->slowdown_delay_radio);
+  conf_adaptor_.SetConfInt("migrate_count_once", c->migrate_count_once);
+  conf_adaptor_.SetConfStr("backup_path", c->backup_path);
+  conf_adaptor_.SetConfInt("backup_speed_limit", c->backup_speed_limit);
+  conf_adaptor_.SetConfInt("subscribe_pin_binlog_count", c->subscribe_pin_binlog_count);
+  conf_adaptor_.SetConfInt("floyd_check_leader_us", c->floyd_check_leader_us);
+  conf_adaptor_.SetConfInt("floyd_heartbeat_us", c->floyd_heartbeat_us);
+  conf_adaptor_.SetConfInt("floyd_append_entries_size_once", c->floyd_append_entries_size_once);
+  conf_adaptor_.SetConfInt("floyd_append_entries_count_once", c->floyd_append_entries_count_once);
   return conf_adaptor_.WriteBack();
 }
 
 int ZpConf::Load() {
+  slash::MutexLock l(&mutex_);
   int res = conf_adaptor_.LoadConf();
   if (res != 0) {
     return res;
   }
 
+  ZpConfItems* c = new ZpConfItems(*items());
+
   bool ret = false;
-  ret = conf_adaptor_.GetConfStr("local_ip", &local_ip_);
-  ret = conf_adaptor_.GetConfInt("local_port", &local_port_);
-  ret = conf_adaptor_.GetConfStr("data_path", &data_path_);
-  ret = conf_adaptor_.GetConfStr("log_path", &log_path_);
-  ret = conf_adaptor_.GetConfStr("trash_path", &trash_path_);
-  ret = conf_adaptor_.GetConfBool("daemonize", &daemonize_);
-  ret = conf_adaptor_.GetConfStrVec("meta_addr", &meta_addr_);
-  ret = conf_adaptor_.GetConfBool("enable_data_delete", &enable_data_delete_);
-  ret = conf_adaptor_.GetConfInt("meta_thread_num", &meta_thread_num_);
-  ret = conf_adaptor_.GetConfInt("data_thread_num", &data_thread_num_);
-  ret = conf_adaptor_.GetConfInt("sync_recv_thread_num", &sync_recv_thread_num_);
-  ret = conf_adaptor_.GetConfInt("sync_send_thread_num", &sync_send_thread_num_);
-  ret = conf_adaptor_.GetConfInt("max_background_flushes", &max_background_flushes_);
-  ret = conf_adaptor_.GetConfInt("max_background_compactions", &max_background_compactions_);
-  ret = conf_adaptor_.GetConfInt("binlog_remain_days", &binlog_remain_days_);
-  ret = conf_adaptor_.GetConfInt("binlog_remain_min_count", &binlog_remain_min_count_);
-  ret = conf_adaptor_.GetConfInt("binlog_remain_max_count", &binlog_remain_max_count_);
-  ret = conf_adaptor_.GetConfInt("db_write_buffer_size", &db_write_buffer_size_);
-  ret = conf_adaptor_.GetConfInt("db_max_write_buffer", &db_max_write_buffer_);
-  ret = conf_adaptor_.GetConfInt("db_target_file_size_base", &db_target_file_size_base_);
-  ret = conf_adaptor_.GetConfInt("db_max_open_files", &db_max_open_files_);
-  ret = conf_adaptor_.GetConfInt("db_block_size", &db_block_size_);
-  ret = conf_adaptor_.GetConfInt("slowlog_slower_than", &slowlog_slower_than_);
-  ret = conf_adaptor_.GetConfInt("stuck_offset_dist", &stuck_offset_dist_);
-  ret = conf_adaptor_.GetConfInt("slowdown_delay_radio", &slowdown_delay_radio_);
-  ret = conf_adaptor_.GetConfInt("migrate_count_once", &migrate_count_once_);
-  ret = conf_adaptor_.GetConfInt("floyd_check_leader_us", &floyd_check_leader_us_);
-  ret = conf_adaptor_.GetConfInt("floyd_heartbeat_us", &floyd_heartbeat_us_);
-  ret = conf_adaptor_.GetConfInt("floyd_append_entries_size_once", &floyd_append_entries_size_once_);
-  ret = conf_adaptor_.GetConfInt("floyd_append_entries_count_once", &floyd_append_entries_count_once_);
+  ret = conf_adaptor_.GetConfStr("local_ip", &c->local_ip);
+  ret = conf_adaptor_.GetConfInt("local_port", &c->local_port);
+  ret = conf_adaptor_.GetConfInt("sync_listen_port", &c->sync_listen_port);
+  ret = conf_adaptor_.GetConfStr("data_path", &c->data_path);
+  ret = conf_adaptor_.GetConfStr("log_path", &c->log_path);
+  ret = conf_adaptor_.GetConfStr("trash_path", &c->trash_path);
+  ret = conf_adaptor_.GetConfBool("daemonize", &c->daemonize);
+  ret = conf_adaptor_.GetConfStrVec("meta_addr", &c->meta_addr);
+  ret = conf_adaptor_.GetConfBool("enable_data_delete", &c->enable_data_delete);
+  ret = conf_adaptor_.GetConfInt("meta_thread_num", &c->meta_thread_num);
+  ret = conf_adaptor_.GetConfInt("data_thread_num", &c->data_thread_num);
+  ret = conf_adaptor_.GetConfInt("sync_recv_thread_num", &c->sync_recv_thread_num);
+  ret = conf_adaptor_.GetConfInt("sync_send_thread_num", &c->sync_send_thread_num);
+  ret = conf_adaptor_.GetConfInt("client_loop_num", &c->client_loop_num);
+  ret = conf_adaptor_.GetConfInt("max_background_flushes", &c->max_background_flushes);
+  ret = conf_adaptor_.GetConfInt("max_background_compactions", &c->max_background_compactions);
+  ret = conf_adaptor_.GetConfStr("dispatch_cpus", &c->dispatch_cpus_str);
+  ret = conf_adaptor_.GetConfStr("sync_recv_cpus", &c->sync_recv_cpus_str);
+  ret = conf_adaptor_.GetConfStr("sync_send_cpus", &c->sync_send_cpus_str);
+  ret = conf_adaptor_.GetConfStr("bg_cpus", &c->bg_cpus_str);
+  ret = conf_adaptor_.GetConfStr("db_cpus", &c->db_cpus_str);
+  ret = conf_adaptor_.GetConfInt("binlog_remain_days", &c->binlog_remain_days);
+  ret = conf_adaptor_.GetConfInt("binlog_remain_min_count", &c->binlog_remain_min_count);
+  ret = conf_adaptor_.GetConfInt("binlog_remain_max_count", &c->binlog_remain_max_count);
+  ret = conf_adaptor_.GetConfInt("binlog_compress_hours", &c->binlog_compress_hours);
+  ret = conf_adaptor_.GetConfInt("sync_dedup_distance", &c->sync_dedup_distance);
+  ret = conf_adaptor_.GetConfInt("db_write_buffer_size", &c->db_write_buffer_size);
+  ret = conf_adaptor_.GetConfInt("db_max_write_buffer", &c->db_max_write_buffer);
+  ret = conf_adaptor_.GetConfInt("db_target_file_size_base", &c->db_target_file_size_base);
+  ret = conf_adaptor_.GetConfInt("db_max_open_files", &c->db_max_open_files);
+  ret = conf_adaptor_.GetConfInt("db_block_size", &c->db_block_size);
+  ret = conf_adaptor_.GetConfInt("slowlog_slower_than", &c->slowlog_slower_than);
+  ret = conf_adaptor_.GetConfInt("stuck_offset_dist", &c->stuck_offset_dist);
+  ret = conf_adaptor_.GetConfInt("slowdown_delay_radio", &c->slowdown_delay_radio);
+  ret = conf_adaptor_.GetConfInt("migrate_count_once", &c->migrate_count_once);
+  ret = conf_adaptor_.GetConfStr("backup_path", &c->backup_path);
+  ret = conf_adaptor_.GetConfInt("backup_speed_limit", &c->backup_speed_limit);
+  ret = conf_adaptor_.GetConfInt("subscribe_pin_binlog_count", &c->subscribe_pin_binlog_count);
+  ret = conf_adaptor_.GetConfInt("floyd_check_leader_us", &c->floyd_check_leader_us);
+  ret = conf_adaptor_.GetConfInt("floyd_heartbeat_us", &c->floyd_heartbeat_us);
+  ret = conf_adaptor_.GetConfInt("floyd_append_entries_size_once", &c->floyd_append_entries_size_once);
+  ret = conf_adaptor_.GetConfInt("floyd_append_entries_count_once", &c->floyd_append_entries_count_once);
   
-  if (data_path_.back() != '/') {
-    data_path_.append("/");
+  if (c->data_path.back() != '/') {
+    c->data_path.append("/");
+  }
+  if (c->log_path.back() != '/') {
+    c->log_path.append("/");
   }
-  if (log_path_.back() != '/') {
-    log_path_.append("/");
+  if (c->trash_path.back() != '/') {
+    c->trash_path.append("/");
   }
-  if (trash_path_.back() != '/') {
-    trash_path_.append("/");
+  if (c->backup_path.back() != '/') {
+    c->backup_path.append("/");
   }
-  std::string lock_path = log_path_;
-  pid_file_ = lock_path + "pid";
-  lock_file_ = lock_path + "lock";
-
-  meta_thread_num_ = BoundaryLimit(meta_thread_num_, 1, 100);
-  data_thread_num_ = BoundaryLimit(data_thread_num_, 1, 100);
-  sync_recv_thread_num_ = BoundaryLimit(sync_recv_thread_num_, 1, 100);
-  sync_send_thread_num_ = BoundaryLimit(sync_send_thread_num_, 1, 100);
-  max_background_flushes_ = BoundaryLimit(max_background_flushes_, 10, 100);
-  max_background_compactions_ = BoundaryLimit(max_background_compactions_, 10, 100);
-  binlog_remain_days_ = BoundaryLimit(binlog_remain_days_, 0, 30);
-  binlog_remain_min_count_ = BoundaryLimit(binlog_remain_min_count_, 10, 60);
-  binlog_remain_max_count_ = BoundaryLimit(binlog_remain_max_count_, 10, 60);
-  binlog_remain_min_count_ = binlog_remain_min_count_ > binlog_remain_max_count_ ?
-    binlog_remain_max_count_ : binlog_remain_min_count_;
-  slowlog_slower_than_ = BoundaryLimit(slowlog_slower_than_, -1, 10000000);
-  stuck_offset_dist_ = BoundaryLimit(stuck_offset_dist_, 1, 100 * 1024 * 1024);
-  slowdown_delay_radio_ = BoundaryLimit(slowdown_delay_radio_, 1, 100);
-  migrate_count_once_ = BoundaryLimit(migrate_count_once_, 1, 100);
-  db_write_buffer_size_ = BoundaryLimit(db_write_buffer_size_, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
-  db_max_write_buffer_ = BoundaryLimit(db_max_write_buffer_, 1024 * 1024, 500 * 1024 * 1024); // 1G ~ 500G
-  db_target_file_size_base_ = BoundaryLimit(db_target_file_size_base_, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
-  db_block_size_ = BoundaryLimit(db_block_size_, 4, 1024 * 1024); // 14K ~ 1G
+  std::string lock_path = c->log_path;
+  c->pid_file = lock_path + "pid";
+  c->lock_file = lock_path + "lock";
+
+  c->sync_listen_port = BoundaryLimit(c->sync_listen_port, 0, 65535);
+  c->meta_thread_num = BoundaryLimit(c->meta_thread_num, 1, 100);
+  c->data_thread_num = BoundaryLimit(c->data_thread_num, 1, 100);
+  c->sync_recv_thread_num = BoundaryLimit(c->sync_recv_thread_num, 1, 100);
+  c->sync_send_thread_num = BoundaryLimit(c->sync_send_thread_num, 1, 100);
+  c->client_loop_num = BoundaryLimit(c->client_loop_num, 0, 100);
+  c->max_background_flushes = BoundaryLimit(c->max_background_flushes, 10, 100);
+  c->max_background_compactions = BoundaryLimit(c->max_background_compactions, 10, 100);
+  c->dispatch_cpus = ParseCpuList("dispatch_cpus", c->dispatch_cpus_str);
+  c->sync_recv_cpus = ParseCpuList("sync_recv_cpus", c->sync_recv_cpus_str);
+  c->sync_send_cpus = ParseCpuList("sync_send_cpus", c->sync_send_cpus_str);
+  c->bg_cpus = ParseCpuList("bg_cpus", c->bg_cpus_str);
+  c->db_cpus = ParseCpuList("db_cpus", c->db_cpus_str);
+  c->binlog_remain_days = BoundaryLimit(c->binlog_remain_days, 0, 30);
+  c->binlog_remain_min_count = BoundaryLimit(c->binlog_remain_min_count, 10, 60);
+  c->binlog_remain_max_count = BoundaryLimit(c->binlog_remain_max_count, 10, 60);
+  c->binlog_remain_min_count = c->binlog_remain_min_count > c->binlog_remain_max_count ?
+    c->binlog_remain_max_count : c->binlog_remain_min_count;
+  c->binlog_compress_hours = BoundaryLimit(c->binlog_compress_hours, 0, 720);
+  c->sync_dedup_distance = BoundaryLimit(c->sync_dedup_distance, 0, 10240);
+  c->slowlog_slower_than = BoundaryLimit(c->slowlog_slower_than, -1, 10000000);
+  c->stuck_offset_dist = BoundaryLimit(c->stuck_offset_dist, 1, 100 * 1024 * 1024);
+  c->slowdown_delay_radio = BoundaryLimit(c->slowdown_delay_radio, 1, 100);
+  c->migrate_count_once = BoundaryLimit(c->migrate_count_once, 1, 100);
+  c->backup_speed_limit = BoundaryLimit(c->backup_speed_limit, 1, 1024);
+  c->subscribe_pin_binlog_count = BoundaryLimit(c->subscribe_pin_binlog_count, 0, 60);
+  c->db_write_buffer_size = BoundaryLimit(c->db_write_buffer_size, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
+  c->db_max_write_buffer = BoundaryLimit(c->db_max_write_buffer, 1024 * 1024, 500 * 1024 * 1024); // 1G ~ 500G
+  c->db_target_file_size_base = BoundaryLimit(c->db_target_file_size_base, 4 * 1024, 10 * 1024 * 1024); // 4M ~ 10G
+  c->db_block_size = BoundaryLimit(c->db_block_size, 4, 1024 * 1024); // 14K ~ 1G
+  Publish(c);
   return ret;
 }
+
+// In the same range as Load
+const ZpConf::DynamicItem ZpConf::kDynamicItems[] = {
+  {"sync_send_thread_num", &ZpConfItems::sync_send_thread_num, 1, 100},
+  {"max_background_flushes", &ZpConfItems::max_background_flushes, 10, 100},
+  {"max_background_compactions", &ZpConfItems::max_background_compactions,
+    10, 100},
+  {"binlog_remain_days", &ZpConfItems::binlog_remain_days, 0, 30},
+  {"binlog_remain_min_count", &ZpConfItems::binlog_remain_min_count, 10, 60},
+  {"binlog_remain_max_count", &ZpConfItems::binlog_remain_max_count, 10, 60},
+  {"binlog_compress_hours", &ZpConfItems::binlog_compress_hours, 0, 720},
+  {"sync_dedup_distance", &ZpConfItems::sync_dedup_distance, 0, 10240},
+  {"db_write_buffer_size", &ZpConfItems::db_write_buffer_size,
+    4 * 1024, 10 * 1024 * 1024},
+  {"db_target_file_size_base", &ZpConfItems::db_target_file_size_base,
+    4 * 1024, 10 * 1024 * 1024},
+  {"slowlog_slower_than", &ZpConfItems::slowlog_slower_than, -1, 10000000},
+  {"slowdown_delay_radio", &ZpConfItems::slowdown_delay_radio, 1, 100},
+  {"backup_speed_limit", &ZpConfItems::backup_speed_limit, 1, 1024},
+  {"subscribe_pin_binlog_count", &ZpConfItems::subscribe_pin_binlog_count,
+    0, 60},
+};
+
+const ZpConf::DynamicItem* ZpConf::FindDynamicItem(const std::string& name) {
+  for (const DynamicItem& item : kDynamicItems) {
+    if (name == item.name) {
+      return &item;
+    }
+  }
+  return NULL;
+}
+
+const std::vector<std::string>& ZpConf::DynamicItems() {
+  static const std::vector<std::string> names = []() {
+    std::vector<std::string> res;
+    for (const DynamicItem& item : kDynamicItems) {
+      res.push_back(item.name);
+    }
+    return res;
+  }();
+  return names;
+}
+
+bool ZpConf::ConfigGet(const std::string& name, std::string* value) {
+  const DynamicItem* item = FindDynamicItem(name);
+  if (item == NULL) {
+    return false;
+  }
+  *value = std::to_string((*items()).*(item->field));
+  return true;
+}
+
+bool ZpConf::ConfigSet(const std::string& name, const std::string& value) {
+  const DynamicItem* item = FindDynamicItem(name);
+  int64_t ival = 0;
+  if (item == NULL
+      || !slash::string2l(value.data(), value.size(), &ival)
+      || ival < item->floor || ival > item->ceil) {
+    return false;
+  }
+
+  return Update([item, ival](ZpConfItems* c) {
+    c->*(item->field) = static_cast<int>(ival);
+    return c->binlog_remain_min_count <= c->binlog_remain_max_count;
+  });
+}
@@ -4,6 +4,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <string.h>
 
 #include "include/zp_const.h"
 
@@ -44,6 +46,28 @@ void create_pid_file() {
   }
 }
 
+bool PinThread(pthread_t tid, const std::vector<int>& cpus, int index) {
+  if (cpus.empty()) {
+    return true;
+  }
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  if (index < 0) {
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &cpuset);
+    }
+  } else {
+    CPU_SET(cpus[index % cpus.size()], &cpuset);
+  }
+  int ret = pthread_setaffinity_np(tid, sizeof(cpuset), &cpuset);
+  if (ret != 0) {
+    LOG(WARNING) << "Pin thread " << tid << " failed, index: " << index
+      << ", error: " << strerror(ret);
+    return false;
+  }
+  return true;
+}
+
 FileLocker::FileLocker(const std::string& file)
   : file_(file) {
 }
@@ -230,6 +230,30 @@ void DropTableCmd::Do(const google::protobuf::Message *req,
   }
 }
 
+void SetQosCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const ZPMeta::MetaCmd* request = static_cast<const ZPMeta::MetaCmd*>(req);
+  ZPMeta::MetaCmdResponse* response
+    = static_cast<ZPMeta::MetaCmdResponse*>(res);
+  response->set_type(ZPMeta::Type::SETQOS);
+
+  const std::string& table_name = request->set_qos().name();
+  if (table_name.empty()) {
+    response->set_code(ZPMeta::StatusCode::ERROR);
+    response->set_msg("TableName cannot be empty");
+    return;
+  }
+
+  Status s = g_meta_server->SetTableQos(table_name, request->set_qos().qos());
+  if (s.ok()) {
+    response->set_code(ZPMeta::StatusCode::OK);
+    response->set_msg("SetQos OK!");
+  } else {
+    response->set_code(ZPMeta::StatusCode::ERROR);
+    response->set_msg(s.ToString());
+  }
+}
+
 void ListNodeCmd::Do(const google::protobuf::Message *req,
     google::protobuf::Message *res, void* partition) const {
   ZPMeta::MetaCmdResponse* response
@@ -444,3 +468,44 @@ void RemoveMetaNodeCmd::Do(const google::protobuf::Message *req,
     response->set_msg(s.ToString());
   }
 }
+
+void TransferLeaderCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const ZPMeta::MetaCmd* request = static_cast<const ZPMeta::MetaCmd*>(req);
+  ZPMeta::MetaCmdResponse* response
+    = static_cast<ZPMeta::MetaCmdResponse*>(res);
+
+  response->set_type(ZPMeta::Type::TRANSFERLEADER);
+
+  if (!request->has_transfer_leader()) {
+    response->set_code(ZPMeta::StatusCode::ERROR);
+    response->set_msg("no target meta node");
+    return;
+  }
+  Status s = g_meta_server->TransferLeader(request->transfer_leader());
+  if (s.ok()) {
+    response->set_code(ZPMeta::StatusCode::OK);
+    response->set_msg("TransferLeader OK!");
+  } else {
+    response->set_code(ZPMeta::StatusCode::ERROR);
+    response->set_msg(s.ToString());
+  }
+}
+
+void NodeInfosCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const ZPMeta::MetaCmd* request = static_cast<const ZPMeta::MetaCmd*>(req);
+  ZPMeta::MetaCmdResponse* response
+    = static_cast<ZPMeta::MetaCmdResponse*>(res);
+
+  response->set_type(ZPMeta::Type::NODEINFOS);
+  Status s = g_meta_server->GetNodeInfos(request->node_infos().since(),
+      response->mutable_node_infos());
+  if (s.ok()) {
+    response->set_code(ZPMeta::StatusCode::OK);
+    response->set_msg("NodeInfos OK!");
+  } else {
+    response->set_code(ZPMeta::StatusCode::ERROR);
+    response->set_msg(s.ToString());
+  }
+}
@@ -127,6 +127,16 @@ class DropTableCmd : public Cmd  {
       google::protobuf::Message *res, void* partition = NULL) const;
 };
 
+class SetQosCmd : public Cmd  {
+ public:
+  explicit SetQosCmd(int flag) : Cmd(flag, kSetQosCmd) {}
+  virtual std::string name() const  {
+    return "SetQos";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
 class MigrateCmd : public Cmd  {
  public:
   explicit MigrateCmd(int flag) : Cmd(flag, kMigrateCmd) {}
@@ -177,4 +187,24 @@ class RemoveMetaNodeCmd : public Cmd  {
       google::protobuf::Message *res, void* partition = NULL) const;
 };
 
+class TransferLeaderCmd : public Cmd  {
+ public:
+  explicit TransferLeaderCmd(int flag) : Cmd(flag, kTransferLeaderCmd) {}
+  virtual std::string name() const  {
+    return "TransferLeader";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
+class NodeInfosCmd : public Cmd  {
+ public:
+  explicit NodeInfosCmd(int flag) : Cmd(flag, kNodeInfosCmd) {}
+  virtual std::string name() const  {
+    return "NodeInfos";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
 #endif  // SRC_META_ZP_META_COMMAND_H_
@@ -61,8 +61,7 @@ bool ZPMetaElection::Jeopardy(std::string* ip, int* port) {
     return false;
   }
   uint64_t timeout = kMetaLeaderTimeout;
-  if (last_leader_.leader().ip() == g_zp_conf->local_ip()
-      && last_leader_.leader().port() == g_zp_conf->local_port()) {
+  if (IsMine(last_leader_)) {
     // Smaller timeout for leader so that it could give up leadership on time
     // before any follower think it could be leader
     timeout -= kMetaLeaderRemainThreshold;
@@ -76,10 +75,23 @@ bool ZPMetaElection::Jeopardy(std::string* ip, int* port) {
   return true;
 }
 
+bool ZPMetaElection::IsMine(const ZPMeta::MetaLeader& cleader) {
+  return cleader.leader().ip() == g_zp_conf->local_ip()
+    && cleader.leader().port() == g_zp_conf->local_port();
+}
+
+bool ZPMetaElection::IsFloydLeader() {
+  std::string ip;
+  int port = 0;
+  return floyd_->GetLeader(&ip, &port)
+    && ip == g_zp_conf->local_ip()
+    && port == g_zp_conf->local_port() + kMetaPortShiftFY;
+}
+
 // Check leader ip and port
 // return false means faled to check leader for some time
 bool ZPMetaElection::GetLeader(std::string* ip, int* port) {
-  std::string local_ip = g_zp_conf->local_ip();
+  const std::string& local_ip = g_zp_conf->local_ip();
   int local_port = g_zp_conf->local_port();
   std::string mine = slash::IpPortString(local_ip, local_port);
 
@@ -95,8 +107,7 @@ bool ZPMetaElection::GetLeader(std::string* ip, int* port) {
     slash::RWLock l(&last_leader_rw_, true);
     last_leader_.CopyFrom(cleader);
     }
-    if ((local_ip != cleader.leader().ip()
-          || local_port != cleader.leader().port())
+    if (!IsMine(cleader)
         && !IsLeaderTimeout(cleader.last_active(), kMetaLeaderTimeout)) {
       // I'm not leader and current leader is not timeout
       *ip = cleader.leader().ip();
@@ -105,6 +116,11 @@ bool ZPMetaElection::GetLeader(std::string* ip, int* port) {
     }
   }
 
+  // Leadership is vacant, only floyd leader could take over
+  if ((s.IsNotFound() || !IsMine(cleader)) && !IsFloydLeader()) {
+    return Jeopardy(ip, port);
+  }
+
   // Lock and update
   s = floyd_->TryLock(kElectLockKey, mine,
       kMetaLeaderLockTimeout * 1000);
@@ -116,10 +132,8 @@ bool ZPMetaElection::GetLeader(std::string* ip, int* port) {
   cleader.Clear();
   s = ReadLeaderRecord(&cleader);
   if (!s.ok() && !s.IsNotFound()) {
-    LOG(WARNING) << "ReadLeaderRecord after lock failed, Jeopardy then. Error:"
-      << s.ToString();
     floyd_->UnLock(kElectLockKey, mine);
-    LOG(WARNING) << "ReadLeaderRecord failed: " << s.ToString()
+    LOG(WARNING) << "ReadLeaderRecord after lock failed: " << s.ToString()
       << ", check jeopardy";
     return Jeopardy(ip, port);  
   } else if (s.ok()) {
@@ -128,16 +142,14 @@ bool ZPMetaElection::GetLeader(std::string* ip, int* port) {
   }
 
   // 1. NotFound
-  // 2, Ok, leader need refresh timeout
-  // 3, Ok, follwer try elect
+  // 2, Ok, leader need refresh lease
+  // 3, Ok, floyd leader try elect
   if (s.IsNotFound()  // No leader yet
-      || (cleader.leader().ip() == local_ip
-        && cleader.leader().port() == local_port)     // I'm Leader
+      || IsMine(cleader)  // I'm Leader
       || IsLeaderTimeout(cleader.last_active(),
         kMetaLeaderTimeout)) {  // Old leader timeout
-    if (cleader.leader().ip() != local_ip
-        || cleader.leader().port() != local_port) {
-      LOG(INFO) << "Take over the leadership, since: "
+    if (!IsMine(cleader)) {
+      LOG(INFO) << "Take over the leadership as floyd leader, since: "
         << (s.IsNotFound() ? "no leader record" : "old leader timeout"); 
     }
 
@@ -153,9 +165,48 @@ bool ZPMetaElection::GetLeader(std::string* ip, int* port) {
       last_leader_.CopyFrom(cleader);
     }
   }
+  floyd_->UnLock(kElectLockKey, mine);
 
+  if (!s.ok()) {
+    // Lease not renewed, keep it until my smaller timeout
+    return Jeopardy(ip, port);
+  }
   *ip = cleader.leader().ip();
   *port = cleader.leader().port();
-  floyd_->UnLock(kElectLockKey, mine);
   return true;
 }
+
+// The new leader renews the lease on its next check,
+// the old one should step down once this returns ok
+Status ZPMetaElection::Transfer(const std::string& ip, int port) {
+  std::string mine = slash::IpPortString(g_zp_conf->local_ip(),
+      g_zp_conf->local_port());
+  Status s = floyd_->TryLock(kElectLockKey, mine,
+      kMetaLeaderLockTimeout * 1000);
+  if (!s.ok()) {
+    LOG(WARNING) << "TryLock ElectLock for transfer failed." << s.ToString();
+    return s;
+  }
+
+  ZPMeta::MetaLeader cleader; 
+  s = ReadLeaderRecord(&cleader);
+  if (s.ok()
+      && (!IsMine(cleader)
+        || IsLeaderTimeout(cleader.last_active(),
+          kMetaLeaderTimeout - kMetaLeaderRemainThreshold))) {
+    s = Status::Incomplete("Not leader");
+  }
+  if (s.ok()) {
+    cleader.mutable_leader()->set_ip(ip);
+    cleader.mutable_leader()->set_port(port);
+    cleader.set_last_active(slash::NowMicros());
+    s = WriteLeaderRecord(cleader);
+  }
+  if (s.ok()) {
+    LOG(INFO) << "Transfer leadership to " << ip << ":" << port;
+    slash::RWLock l(&last_leader_rw_, true);
+    last_leader_.CopyFrom(cleader);
+  }
+  floyd_->UnLock(kElectLockKey, mine);
+  return s;
+}
@@ -22,6 +22,9 @@
 
 using slash::Status;
 
+// Leader holds a short lease record in floyd and renews it on every check,
+// a vacant lease is only taken by the floyd leader,
+// so that meta leadership follows floyd leadership
 class ZPMetaElection {
  public:
   ZPMetaElection(floyd::Floyd* f);
@@ -32,12 +35,16 @@ class ZPMetaElection {
     return Jeopardy(ip, port);
   }
   bool GetLeader(std::string* ip, int* port);
+  // Hand current lease to another meta node, only by leader
+  Status Transfer(const std::string& ip, int port);
 
  private:
   floyd::Floyd* floyd_;
   pthread_rwlock_t last_leader_rw_;
   ZPMeta::MetaLeader last_leader_;
   bool Jeopardy(std::string* ip, int* port);
+  bool IsMine(const ZPMeta::MetaLeader& cleader);
+  bool IsFloydLeader();
   Status ReadLeaderRecord(ZPMeta::MetaLeader* cleader);
   Status WriteLeaderRecord(const ZPMeta::MetaLeader& cleader);
 };
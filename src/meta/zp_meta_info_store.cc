@@ -15,6 +15,7 @@
 
 #include <glog/logging.h>
 #include <google/protobuf/text_format.h>
+#include <algorithm>
 #include <map>
 #include <ctime>
 #include <utility>
@@ -302,6 +303,16 @@ Status ZPMetaInfoStoreSnap::RemoveTable(const std::string& table) {
   return Status::OK();
 }
 
+Status ZPMetaInfoStoreSnap::SetQos(const std::string& table,
+    const ZPMeta::Qos& qos) {
+  if (tables_.find(table) == tables_.end()) {
+    return Status::NotFound("Table not exist");
+  }
+  tables_[table].mutable_qos()->CopyFrom(qos);
+  table_changed_[table] = true;
+  return Status::OK();
+}
+
 Status ZPMetaInfoStoreSnap::MembersChange(std::string node, bool is_add) {
   if (!members_change_.empty()) {
     // limited by the floyd implemetation,
@@ -396,7 +407,9 @@ inline bool ZPMetaInfoStoreSnap::IsNodeUp(const ZPMeta::Node& node) const {
 
 ZPMetaInfoStore::ZPMetaInfoStore(floyd::Floyd* floyd)
   : floyd_(floyd),
-  epoch_(-2) {
+  epoch_(-2),
+  node_infos_merged_us_(0),
+  node_infos_version_(slash::NowMicros()) {
     // We prefer write for nodes_info_
     // since its on the critical path of Ping, which is latency sensitive
     pthread_rwlockattr_t attr;
@@ -448,9 +461,8 @@ Status ZPMetaInfoStore::LoadMembers() {
     if (members_.find(my_addr) == members_.end()) {
       // Log and exist
       LOG(FATAL) << "Remove from cluster, floyd addr: " << my_addr;
-    } else {
+    } else if (g_zp_conf->SetMetaAddr(members_)) {
       // Rewrite log
-      g_zp_conf->SetMetaAddr(members_);
       g_zp_conf->Rewrite();
       LOG(INFO) << "Rewrite conf after membership changed, members size: "
         << members_.size();
@@ -597,11 +609,31 @@ Status ZPMetaInfoStore::GetMembers(std::set<std::string> *ms) {
 }
 
 Status ZPMetaInfoStore::RestoreNodeInfos() {
-  {
-    slash::RWLock l(&nodes_rw_, true);
-    node_infos_.clear();
+  Status s = RefreshNodeInfos();
+  if (!s.ok()) {
+    return s;
   }
-  return RefreshNodeInfos();
+
+  // Node infos merged from old leader recently could be used right now,
+  // with alive time shifted by the gap without leader,
+  // otherwise every up node has a full timeout to ping the new leader
+  slash::RWLock l(&nodes_rw_, true);
+  uint64_t now = slash::NowMicros();
+  bool stale = node_infos_merged_us_ + kMetaNodeInfoStale * 1000 * 1000 < now;
+  for (auto& n : node_infos_) {
+    if (stale) {
+      n.second.offsets.clear();
+    }
+    TouchNodeInfo(&n.second);
+    if (n.second.last_alive_time > 0) {
+      n.second.last_alive_time = stale ? now
+        : std::min(now, n.second.last_alive_time + now - node_infos_merged_us_);
+    }
+  }
+  node_infos_merged_us_ = 0;
+  LOG(INFO) << "Restore node infos, " << (stale ? "drop stale" : "keep")
+    << " offsets from old leader";
+  return Status::OK();
 }
 
 Status ZPMetaInfoStore::RefreshNodeInfos() {
@@ -637,6 +669,7 @@ Status ZPMetaInfoStore::RefreshNodeInfos() {
         || !(node_infos_.at(ip_port).StateEqual(node_s.status()))) {
       // node state changed
       node_infos_[ip_port] = NodeInfo(node_s.status());
+      TouchNodeInfo(&node_infos_[ip_port]);
     }
   }
   for (const auto& m : miss) {
@@ -672,6 +705,7 @@ Status ZPMetaInfoStore::UpdateNodeInfo(const ZPMeta::MetaCmd_Ping &ping) {
       if (!has_clear
           && node_infos_.find(node) != node_infos_.end()) {
         node_infos_.at(node).offsets.clear();
+        TouchNodeInfo(&node_infos_.at(node));
         LOG(INFO) << "Clear all node offsets: "
           << " node: " << node;
         // Traverse offset list from the beginning
@@ -685,16 +719,23 @@ Status ZPMetaInfoStore::UpdateNodeInfo(const ZPMeta::MetaCmd_Ping &ping) {
       LOG(INFO) << "Node not in charge any more: "
         << "node: " << node
         << ", table partiton: " << offset_key;
-      if (node_infos_.find(node) != node_infos_.end()) {
-        node_infos_.at(node).offsets.erase(offset_key);
+      if (node_infos_.find(node) != node_infos_.end()
+          && node_infos_.at(node).offsets.erase(offset_key) > 0) {
+        TouchNodeInfo(&node_infos_.at(node));
       }
     } else {
       DLOG(INFO) << "update offset"
         << "node: " << node
         << ", table partition: " << offset_key
         << ", offset: " << po.filenum() << "_" << po.offset();
-      node_infos_[node].offsets[offset_key] = NodeOffset(po.filenum(),
-          po.offset());
+      // Ping carries all offsets, only changes are counted
+      NodeInfo& info = node_infos_[node];
+      NodeOffset noffset(po.filenum(), po.offset());
+      auto iter = info.offsets.find(offset_key);
+      if (iter == info.offsets.end() || iter->second != noffset) {
+        info.offsets[offset_key] = noffset;
+        TouchNodeInfo(&info);
+      }
     }
   }
 
@@ -709,6 +750,67 @@ Status ZPMetaInfoStore::UpdateNodeInfo(const ZPMeta::MetaCmd_Ping &ping) {
   return Status::OK();
 }
 
+void ZPMetaInfoStore::SerializeNodeInfos(int64_t since,
+    ZPMeta::MetaCmdResponse_NodeInfos* infos) {
+  slash::RWLock l(&nodes_rw_, false);
+  uint64_t now = slash::NowMicros();
+  infos->set_version(node_infos_version_);
+  for (const auto& n : node_infos_) {
+    ZPMeta::MetaCmdResponse_NodeInfo* info = infos->add_infos();
+    if (!AssignPbNode(n.first, info->mutable_node())) {
+      infos->mutable_infos()->RemoveLast();
+      continue;
+    }
+    uint64_t last_alive = n.second.last_alive_time;
+    info->set_alive_age(last_alive == 0 ? -1
+        : (now > last_alive ? now - last_alive : 0));
+    if (since > 0 && n.second.version <= static_cast<uint64_t>(since)) {
+      continue;
+    }
+    info->set_offset_changed(true);
+    for (const auto& o : n.second.offsets) {
+      // Offset key is table_partition
+      size_t pos = o.first.rfind('_');
+      if (pos == std::string::npos) {
+        continue;
+      }
+      ZPMeta::SyncOffset* offset = info->add_offset();
+      offset->set_table_name(o.first.substr(0, pos));
+      offset->set_partition(std::stoi(o.first.substr(pos + 1)));
+      offset->set_filenum(o.second.filenum);
+      offset->set_offset(o.second.offset);
+    }
+  }
+}
+
+// Node state is still decided by what in floyd, see RefreshNodeInfos
+void ZPMetaInfoStore::MergeNodeInfos(
+    const ZPMeta::MetaCmdResponse_NodeInfos& infos) {
+  slash::RWLock l(&nodes_rw_, true);
+  uint64_t now = slash::NowMicros();
+  for (const auto& info : infos.infos()) {
+    auto iter = node_infos_.find(
+        slash::IpPortString(info.node().ip(), info.node().port()));
+    if (iter == node_infos_.end()) {
+      continue;
+    }
+    NodeInfo& ninfo = iter->second;
+    if (ninfo.last_alive_time > 0 && info.alive_age() >= 0
+        && static_cast<uint64_t>(info.alive_age()) < now) {
+      ninfo.last_alive_time = now - info.alive_age();
+    }
+    if (!info.offset_changed()) {
+      continue;
+    }
+    ninfo.offsets.clear();
+    for (const auto& po : info.offset()) {
+      ninfo.offsets[NodeOffsetKey(po.table_name(), po.partition())] =
+        NodeOffset(po.filenum(), po.offset());
+    }
+  }
+  node_infos_merged_us_ = now;
+}
+
 bool ZPMetaInfoStore::GetNodeInfo(const ZPMeta::Node& node, NodeInfo* info) {
   if (!initialed()) {
     return false;
@@ -38,6 +38,7 @@ struct NodeInfo {
   uint64_t last_alive_time;
   // table_partition -> offset
   std::map<std::string, NodeOffset> offsets;
+  uint64_t version;  // when offsets changed last time
 
   bool StateEqual(const ZPMeta::NodeState& n) {
     return (n == ZPMeta::NodeState::UP)   // new is up
@@ -45,10 +46,12 @@ struct NodeInfo {
   }
 
   NodeInfo()
-    : last_alive_time(0) {}
+    : last_alive_time(0),
+    version(0) {}
 
   explicit NodeInfo(const ZPMeta::NodeState& s)
-    : last_alive_time(0) {
+    : last_alive_time(0),
+    version(0) {
       if (s == ZPMeta::NodeState::UP) {
         last_alive_time = slash::NowMicros();
       }
@@ -78,6 +81,7 @@ class ZPMetaInfoStoreSnap   {
         const ZPMeta::PState& target_s);
     Status AddTable(const ZPMeta::Table& table);
     Status RemoveTable(const std::string& table);
+    Status SetQos(const std::string& table, const ZPMeta::Qos& qos);
     void RefreshTableWithNodeAlive();
     Status MembersChange(std::string node, bool is_add);
 
@@ -112,9 +116,14 @@ class ZPMetaInfoStore {
     Status GetMembers(std::set<std::string> *ms);
 
     // node_infos_ related
-    Status RestoreNodeInfos();  // clean and refresh
+    Status RestoreNodeInfos();  // refresh and keep fresh offsets, on takeover
     Status RefreshNodeInfos();
     Status UpdateNodeInfo(const ZPMeta::MetaCmd_Ping &ping);
+    // Leader serializes node infos for followers to merge,
+    // with offsets only of nodes changed after since
+    void SerializeNodeInfos(int64_t since,
+        ZPMeta::MetaCmdResponse_NodeInfos* infos);
+    void MergeNodeInfos(const ZPMeta::MetaCmdResponse_NodeInfos& infos);
     bool GetNodeInfo(const ZPMeta::Node& node, NodeInfo* info);
     void FetchExpiredNode(std::set<std::string>* nodes);
     bool GetAllNodes(std::unordered_map<std::string, NodeInfo>* all_nodes);
@@ -175,8 +184,16 @@ class ZPMetaInfoStore {
     // Nodes releated
     pthread_rwlock_t nodes_rw_;
     // node => alive time + offset set, 0 means already down node
-    // only valid for leader
+    // leader updates it by ping, followers keep it warm by MergeNodeInfos
     std::unordered_map<std::string, NodeInfo> node_infos_;
+    uint64_t node_infos_merged_us_;  // last MergeNodeInfos on follower
+    // Increase on every offsets change, start from now to
+    // keep increasing after restart
+    uint64_t node_infos_version_;
+    // Required: hold nodes_rw_ for write
+    void TouchNodeInfo(NodeInfo* info) {
+      info->version = ++node_infos_version_;
+    }
 
     // No copying allowed
     ZPMetaInfoStore(const ZPMetaInfoStore&);
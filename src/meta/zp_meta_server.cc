@@ -35,7 +35,11 @@
 ZPMetaServer::ZPMetaServer()
   : should_exit_(false),
   server_thread_(NULL),
-  role_(MetaRole::kNone) {
+  role_(MetaRole::kNone),
+  leader_thread_(NULL),
+  nodeinfos_thread_(NULL),
+  nodeinfos_since_(0),
+  nodeinfos_count_(0) {
   LOG(INFO) << "ZPMetaServer start initialization";
 
   // Init Command
@@ -76,6 +80,14 @@ ZPMetaServer::ZPMetaServer()
       nullptr);
   server_thread_->set_thread_name("ZPMetaDispatch");
   server_thread_->set_keepalive_timeout(kKeepAlive);
+
+  // Init Leader thread
+  leader_thread_ = new pink::BGThread();
+  leader_thread_->set_thread_name("ZPMetaLeader");
+
+  // Init NodeInfos thread
+  nodeinfos_thread_ = new pink::BGThread();
+  nodeinfos_thread_->set_thread_name("ZPMetaNodeInfos");
 }
 
 ZPMetaServer::~ZPMetaServer() {
@@ -85,6 +97,12 @@ ZPMetaServer::~ZPMetaServer() {
   delete server_thread_;
   delete conn_factory_;
 
+  leader_thread_->StopThread();
+  delete leader_thread_;
+  nodeinfos_thread_->StopThread();
+  delete nodeinfos_thread_;
+  nodeinfos_joint_.CleanLeader();
+
   delete condition_cron_;
   delete update_thread_;
   delete migrate_register_;
@@ -129,16 +147,57 @@ void ZPMetaServer::Start() {
   LOG(INFO) << "Start server thread succ: " << std::hex
     << server_thread_->thread_id(); 
 
+  if (0 != leader_thread_->StartThread()) {
+    LOG(FATAL) << "Leader thread start failed";
+    return;
+  }
+  leader_thread_->Schedule(&LeaderCronFunc, static_cast<void*>(this));
+
+  if (0 != nodeinfos_thread_->StartThread()) {
+    LOG(FATAL) << "NodeInfos thread start failed";
+    return;
+  }
+  nodeinfos_thread_->Schedule(&NodeInfosCronFunc, static_cast<void*>(this));
+
   while (!should_exit_) {
     DoTimingTask();
-    int sleep_count = kMetaCronWaitCount;
-    while (!should_exit_ && sleep_count-- > 0) {
-      usleep(kMetaCronInterval * 1000);
-    }
+    usleep(kMetaCronInterval * kMetaCronWaitCount * 1000);
   }
   return;
 }
 
+// Check leader every interval for fast failover
+void ZPMetaServer::LeaderCronFunc(void* arg) {
+  ZPMetaServer* server = static_cast<ZPMetaServer*>(arg);
+  uint64_t start = slash::NowMicros();
+  Status s = server->RefreshLeader();
+  if (!s.ok()) {
+    LOG(WARNING) << "Refresh Leader failed: " << s.ToString();
+  }
+  if (server->should_exit_) {
+    return;
+  }
+  uint64_t cost_ms = (slash::NowMicros() - start) / 1000;
+  uint64_t delay_ms = cost_ms < static_cast<uint64_t>(kMetaCronInterval)
+    ? kMetaCronInterval - cost_ms : 0;
+  server->leader_thread_->DelaySchedule(delay_ms, &LeaderCronFunc, arg);
+}
+
+void ZPMetaServer::NodeInfosCronFunc(void* arg) {
+  ZPMetaServer* server = static_cast<ZPMetaServer*>(arg);
+  if (server->role_ == MetaRole::kFollower) {
+    // Keep warm for takeover
+    server->SyncNodeInfos();
+  } else {
+    server->nodeinfos_joint_.CleanLeader();
+  }
+  if (server->should_exit_) {
+    return;
+  }
+  server->nodeinfos_thread_->DelaySchedule(kMetaCronInterval,
+      &NodeInfosCronFunc, arg);
+}
+
 Cmd* ZPMetaServer::GetCmd(const int op) {
   return GetCmdFromTable(op, cmds_);
 }
@@ -255,6 +314,31 @@ Status ZPMetaServer::DropTable(const std::string& table) {
   return Status::OK();
 }
 
+Status ZPMetaServer::SetTableQos(const std::string& table,
+    const ZPMeta::Qos& qos) {
+  if (!TableExist(table)) {
+    return Status::InvalidArgument("Table not exist");
+  }
+
+  UpdateTask task;
+  task.op = kOpSetQos;
+  std::string qos_text = qos.ShortDebugString();
+  task.print_args_text = [table, qos_text]() {
+    return "task: SetQos, when: SetTableQos, table: " + table
+      + ", qos: " + qos_text;
+  };
+  task.sargs[0] = table;
+  qos.SerializeToString(&task.sargs[1]);
+
+  Status s = update_thread_->PendingUpdate(task);
+  if (!s.ok()) {
+    LOG(WARNING) << "Pending task failed, " << s.ToString() << ", "
+      << task.print_args_text();
+    return s;
+  }
+  return Status::OK();
+}
+
 Status ZPMetaServer::AddPartitionSlave(const std::string& table, int pnum,
     const ZPMeta::Node& target) {
   // Check node is already slave
@@ -854,6 +938,7 @@ Status ZPMetaServer::RedirectToLeader(const ZPMeta::MetaCmd &request,
 }
 
 Status ZPMetaServer::RefreshLeader() {
+  slash::MutexLock ll(&leader_mutex_);
   std::string leader_ip;
   int leader_port = 0, leader_cmd_port = 0;
   if (!election_->GetLeader(&leader_ip, &leader_port)) {
@@ -995,6 +1080,114 @@ Status ZPMetaServer::MembershipChange(const std::string& node, bool is_add) {
   return Status::OK();
 }
 
+// For planned maintenance of the leader
+Status ZPMetaServer::TransferLeader(const ZPMeta::Node& target) {
+  std::set<std::string> meta_nodes;
+  Status s = info_store_->GetMembers(&meta_nodes);
+  if (!s.ok()) {
+    return s;
+  }
+  if (meta_nodes.find(slash::IpPortString(target.ip(), target.port()))
+      == meta_nodes.end()) {
+    return Status::NotFound("target is not a meta node");
+  }
+  if (target.ip() == g_zp_conf->local_ip()
+      && target.port() == g_zp_conf->local_port()) {
+    return Status::OK();
+  }
+
+  slash::MutexLock ll(&leader_mutex_);
+  s = election_->Transfer(target.ip(), target.port());
+  if (!s.ok()) {
+    LOG(WARNING) << "Transfer leadership failed: " << s.ToString()
+      << ", target: " << target.ip() << ":" << target.port();
+    return s;
+  }
+
+  // The lease belongs to target now, step down at once.
+  // Become follower on next leader check,
+  // not refresh here since it kills all conns including this one
+  slash::MutexLock l(&(leader_joint_.mutex));
+  condition_cron_->Abandon();
+  update_thread_->Abandon();
+  leader_joint_.CleanLeader();
+  role_ = MetaRole::kNone;
+  LOG(INFO) << "Step down after transfer leadership to "
+    << target.ip() << ":" << target.port();
+  return Status::OK();
+}
+
+Status ZPMetaServer::GetNodeInfos(int64_t since,
+    ZPMeta::MetaCmdResponse_NodeInfos* infos) {
+  if (role_ != MetaRole::kLeader) {
+    return Status::Incomplete("Not leader");
+  }
+  info_store_->SerializeNodeInfos(since, infos);
+  return Status::OK();
+}
+
+// Not through RedirectToLeader, to keep leader_joint_ free for users
+Status ZPMetaServer::SyncNodeInfos() {
+  std::string leader_ip;
+  int leader_port = 0;
+  {
+    slash::MutexLock l(&(leader_joint_.mutex));
+    leader_ip = leader_joint_.ip;
+    leader_port = leader_joint_.port;
+  }
+  LeaderJoint& joint = nodeinfos_joint_;
+  if (leader_ip != joint.ip || leader_port != joint.port) {
+    // Versions only make sense to the same leader
+    joint.CleanLeader();
+    joint.ip = leader_ip;
+    joint.port = leader_port;
+    nodeinfos_since_ = 0;
+  }
+  if (joint.NoLeader()) {
+    return Status::Incomplete("Leader electing");
+  }
+
+  Status s;
+  if (joint.cli == NULL) {
+    joint.cli = pink::NewPbCli();
+    s = joint.cli->Connect(joint.ip, joint.port);
+    if (!s.ok()) {
+      joint.Disconnect();
+      LOG(WARNING) << "Connect to leader for node infos failed: "
+        << s.ToString();
+      return s;
+    }
+    joint.cli->set_send_timeout(1000);
+    joint.cli->set_recv_timeout(1000);
+  }
+
+  // Pull all offsets sometimes, in case some change is missed,
+  // such as node state changed on follower before leader
+  if (nodeinfos_count_++ % kMetaNodeInfosFullCount == 0) {
+    nodeinfos_since_ = 0;
+  }
+  ZPMeta::MetaCmd request;
+  ZPMeta::MetaCmdResponse response;
+  request.set_type(ZPMeta::Type::NODEINFOS);
+  request.mutable_node_infos()->set_since(nodeinfos_since_);
+  s = joint.cli->Send(&request);
+  if (s.ok()) {
+    s = joint.cli->Recv(&response);
+  }
+  if (!s.ok()) {
+    joint.Disconnect();
+  } else if (response.code() != ZPMeta::StatusCode::OK) {
+    s = Status::Corruption(response.msg());
+  }
+  if (!s.ok()) {
+    LOG(WARNING) << "Sync node infos from leader failed: " << s.ToString();
+    return s;
+  }
+  info_store_->MergeNodeInfos(response.node_infos());
+  nodeinfos_since_ = response.node_infos().version();
+  return Status::OK();
+}
+
 void ZPMetaServer::InitClientCmdTable() {
   // Ping Command
   Cmd* pingptr = new PingCmd(kCmdFlagsRead | kCmdFlagsRedirect);
@@ -1051,6 +1244,11 @@ void ZPMetaServer::InitClientCmdTable() {
   cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::DROPTABLE),
         droptableptr));
 
+  // SetQos Command
+  Cmd* setqosptr = new SetQosCmd(kCmdFlagsWrite | kCmdFlagsRedirect);
+  cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::SETQOS),
+        setqosptr));
+
   // Migrate Command
   Cmd* migrateptr = new MigrateCmd(kCmdFlagsWrite | kCmdFlagsRedirect);
   cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::MIGRATE),
@@ -1079,6 +1277,17 @@ void ZPMetaServer::InitClientCmdTable() {
       | kCmdFlagsRedirect);
   cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::REMOVEMETANODE),
         remove_meta_node_ptr));
+
+  // Transfer Leader Command
+  Cmd* transfer_leader_ptr = new TransferLeaderCmd(kCmdFlagsAdmin
+      | kCmdFlagsRedirect);
+  cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::TRANSFERLEADER),
+        transfer_leader_ptr));
+
+  // Node Infos Command
+  Cmd* node_infos_ptr = new NodeInfosCmd(kCmdFlagsRead);
+  cmds_.insert(std::pair<int, Cmd*>(static_cast<int>(ZPMeta::Type::NODEINFOS),
+        node_infos_ptr));
 }
 
 void ZPMetaServer::ResetLastSecQueryNum() {
@@ -1091,11 +1300,7 @@ void ZPMetaServer::ResetLastSecQueryNum() {
 }
 
 void ZPMetaServer::DoTimingTask() {
-  Status s = RefreshLeader();
-  if (!s.ok()) {
-    LOG(WARNING) << "Refresh Leader failed: " << s.ToString();
-  }
-
+  Status s;
   if (role_ == MetaRole::kLeader) {  // Is Leader
     // Check alive
     CheckNodeAlive();
@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "pink/include/server_thread.h"
+#include "pink/include/bg_thread.h"
 #include "pink/include/pink_cli.h"
 #include "slash/include/slash_status.h"
 #include "slash/include/slash_mutex.h"
@@ -141,6 +142,7 @@ class ZPMetaServer  {
       const ZPMeta::Node& node);
   Status CreateTable(const ZPMeta::Table& table);
   Status DropTable(const std::string& table);
+  Status SetTableQos(const std::string& table, const ZPMeta::Qos& qos);
   
   // Meta info related
   Status GetAllMetaNodes(std::vector<ZPMeta::Node> *nodes);
@@ -148,6 +150,9 @@ class ZPMetaServer  {
   Status RedirectToLeader(const ZPMeta::MetaCmd &request,
       ZPMeta::MetaCmdResponse *response);
   Status MembershipChange(const std::string& node, bool is_add);
+  Status TransferLeader(const ZPMeta::Node& target);
+  Status GetNodeInfos(int64_t since,
+      ZPMeta::MetaCmdResponse_NodeInfos* infos);
   bool IsLeader() {
     return role_ == MetaRole::kLeader;
   }
@@ -176,11 +181,25 @@ class ZPMetaServer  {
   // Leader related
   ZPMetaElection* election_;
   std::atomic<int> role_;
+  // Serialize leader check and leadership transfer
   slash::Mutex leader_mutex_;
   LeaderJoint leader_joint_;
+  // Lease is renewed on its own thread,
+  // so that slow timing tasks could not let it expire
+  pink::BGThread* leader_thread_;
+  static void LeaderCronFunc(void* arg);
   bool GetLeader(std::string *ip, int *port, bool is_retry = false);
   Status RefreshLeader();
 
+  // Followers keep node infos warm on their own thread and connection,
+  // nodeinfos_* are only accessed by it
+  pink::BGThread* nodeinfos_thread_;
+  LeaderJoint nodeinfos_joint_;
+  int64_t nodeinfos_since_;
+  int nodeinfos_count_;
+  static void NodeInfosCronFunc(void* arg);
+  Status SyncNodeInfos();
+
   // Cmd related
   std::unordered_map<int, Cmd*> cmds_;
   void InitClientCmdTable();
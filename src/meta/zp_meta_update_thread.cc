@@ -107,6 +107,7 @@ Status ZPMetaUpdateThread::ApplyUpdates(
   std::string left_node;
   ZPMeta::Table table;
   ZPMeta::MetaCmd_RemoveNodes remove_nodes_cmd;
+  ZPMeta::Qos qos;
   int partition;
 
   for (const auto cur_task : task_deque) {
@@ -185,6 +186,11 @@ Status ZPMetaUpdateThread::ApplyUpdates(
         node = cur_task.sargs[0];
         s = info_store_snap.MembersChange(node, false);
         break;
+      case ZPMetaUpdateOP::kOpSetQos:
+        table_name = cur_task.sargs[0];
+        qos.ParseFromString(cur_task.sargs[1]);
+        s = info_store_snap.SetQos(table_name, qos);
+        break;
       default:
         s = Status::Corruption("Unknown task type");
     }
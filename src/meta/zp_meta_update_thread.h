@@ -41,7 +41,8 @@ enum ZPMetaUpdateOP : unsigned int {
   kOpSetStuck,  // Stuck the partition
   kOpSetSlowdown,  // Slowdown the partition
   kOpAddMeta,
-  kOpRemoveMeta
+  kOpRemoveMeta,
+  kOpSetQos
 };
 
 const int MAX_ARGS = 8;
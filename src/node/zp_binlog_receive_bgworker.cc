@@ -23,7 +23,9 @@
 
 extern ZPDataServer* zp_data_server;
 
-ZPBinlogReceiveBgWorker::ZPBinlogReceiveBgWorker(int full) {
+ZPBinlogReceiveBgWorker::ZPBinlogReceiveBgWorker(int full, int index)
+  : index_(index),
+  pinned_(false) {
   bg_thread_ = new pink::BGThread(full);
   bg_thread_->set_thread_name("ZPDataSyncWorker");
 }
@@ -35,8 +37,15 @@ ZPBinlogReceiveBgWorker::~ZPBinlogReceiveBgWorker() {
     << " exit!!!";
 }
 
+// Only called by the sync receiver thread
 void ZPBinlogReceiveBgWorker::AddTask(ZPBinlogReceiveTask *task) {
   bg_thread_->StartThread();
+  if (!pinned_) {
+    // Partition always apply on the same worker, so does its memtable
+    // allocations, keep them on one numa node
+    pinned_ = true;
+    PinThread(bg_thread_->thread_id(), g_zp_conf->sync_recv_cpus(), index_);
+  }
   bg_thread_->Schedule(&DoBinlogReceiveTask, static_cast<void*>(task));
 }
 
@@ -38,11 +38,13 @@ struct ZPBinlogReceiveTask {
 
 class ZPBinlogReceiveBgWorker {
  public:
-    explicit ZPBinlogReceiveBgWorker(int full);
+    ZPBinlogReceiveBgWorker(int full, int index);
     ~ZPBinlogReceiveBgWorker();
     void AddTask(ZPBinlogReceiveTask *task);
  private:
     pink::BGThread* bg_thread_;
+    int index_;
+    bool pinned_;
     static void DoBinlogReceiveTask(void* arg);
 };
 
@@ -17,6 +17,8 @@
 #include <google/protobuf/text_format.h>
 #include <limits>
 #include <memory>
+#include <unordered_set>
+#include <utility>
 
 #include "slash/include/env.h"
 
@@ -69,7 +71,8 @@ ZPBinlogSendTask::ZPBinlogSendTask(uint64_t seq, const std::string &table,
   pre_has_content_(false),
   binlog_filename_(binlog_prefix),
   queue_(NULL),
-  reader_(NULL) {
+  reader_(NULL),
+  readahead_(NULL) {
     name_ = ZPBinlogSendTaskName(table, partition_id_, target);
     pre_content_.reserve(1024 * 1024);
   }
@@ -77,15 +80,18 @@ ZPBinlogSendTask::ZPBinlogSendTask(uint64_t seq, const std::string &table,
 ZPBinlogSendTask::~ZPBinlogSendTask() {
   delete reader_;
   delete queue_;
+  delete readahead_;
 }
 
 Status ZPBinlogSendTask::Init() {
   std::string confile = NewFileName(binlog_filename_, filenum_);
-  if (!slash::NewSequentialFile(confile, &queue_).ok()) {
+  if (!NewBinlogSequentialFile(confile, &queue_).ok()) {
     return Status::IOError("ZPBinlogSendTask Init new sequtial file failed");
   }
   reader_ = new BinlogReader(queue_);
-  Status s = reader_->Seek(offset_);
+  readahead_ = new BinlogReadahead(confile);
+  readahead_->Advance(offset_);
+  Status s = reader_->Seek(offset_, confile);
   if (!s.ok()) {
     return s;
   }
@@ -115,6 +121,14 @@ Status ZPBinlogSendTask::ProcessTask() {
   // << "parititon: " << partition_id_;
   RecordPreOffset();
 
+  if (window_.empty() && NeedDedup(boffset)) {
+    FillWindow(boffset);
+  }
+  if (!window_.empty()) {
+    PopWindow();
+    return Status::OK();
+  }
+
   uint64_t consume_len = 0;
   Status s = reader_->Consume(&consume_len, &pre_content_);
   if (s.IsEndFile()) {
@@ -129,7 +143,7 @@ Status ZPBinlogSendTask::ProcessTask() {
       delete queue_;
       queue_ = NULL;
 
-      s = slash::NewSequentialFile(confile, &(queue_));
+      s = NewBinlogSequentialFile(confile, &(queue_));
       if (!s.ok()) {
         LOG(WARNING) << "Failed to roll to next binlog file:" << (filenum_ + 1)
           << " Error:" << s.ToString() << ", Partition: " << table_name_
@@ -137,6 +151,8 @@ Status ZPBinlogSendTask::ProcessTask() {
         return s;
       }
       reader_ = new BinlogReader(queue_);
+      delete readahead_;
+      readahead_ = new BinlogReadahead(confile);
       filenum_++;
       offset_ = 0;
       return ProcessTask();
@@ -160,6 +176,7 @@ Status ZPBinlogSendTask::ProcessTask() {
   pre_has_content_ = s.ok();
 
   offset_ += consume_len;
+  readahead_->Advance(offset_);
 
   // Return OK even Incomplete or something wrong when consume
   // So that the caller could do the later sendtopeer
@@ -167,6 +184,87 @@ Status ZPBinlogSendTask::ProcessTask() {
   return Status::OK();
 }
 
+bool ZPBinlogSendTask::NeedDedup(const BinlogOffset& end) const {
+  int64_t distance = g_zp_conf->sync_dedup_distance();
+  if (distance <= 0) {
+    return false;
+  }
+  int64_t behind = (static_cast<int64_t>(end.filenum) - filenum_) * kBinlogSize
+    + static_cast<int64_t>(end.offset) - static_cast<int64_t>(offset_);
+  return behind >= distance * 1024 * 1024;
+}
+
+// Never roll in it, the normal path does once window drained
+void ZPBinlogSendTask::FillWindow(const BinlogOffset& end) {
+  uint64_t offset = offset_;
+  uint64_t bytes = 0;
+  while (window_.size() < kBinlogDedupWindowCount
+      && bytes < kBinlogDedupWindowSize
+      && (filenum_ < end.filenum || offset < end.offset)) {
+    WindowItem item;
+    uint64_t consume_len = 0;
+    Status s = reader_->Consume(&consume_len, &item.content);
+    if (s.IsEndFile()) {
+      break;
+    } else if (!s.ok() && !s.IsIncomplete()) {
+      LOG(WARNING) << "ZPBinlogSendTask failed to Consume: " << s.ToString()
+        << ", table: " << table_name_ << ", partition:" << partition_id_
+        << ", Send to " << node_ << ", skip to next block";
+      reader_->SkipNextBlock(&consume_len);
+    }
+    item.has_content = s.ok();
+    if (!item.has_content) {
+      item.content.clear();
+    }
+    offset += consume_len;
+    item.end = offset;
+    bytes += consume_len;
+    window_.push_back(std::move(item));
+  }
+  readahead_->Advance(offset);
+
+  // Keep the last Set or Del of each key
+  std::unordered_set<std::string> keys;
+  client::CmdRequest req;
+  int skipped = 0;
+  for (auto it = window_.rbegin(); it != window_.rend(); ++it) {
+    if (!it->has_content || !req.ParseFromString(it->content)) {
+      continue;
+    }
+    const std::string* key = NULL;
+    if (req.type() == client::Type::SET && req.has_set()) {
+      key = &req.set().key();
+    } else if (req.type() == client::Type::DEL && req.has_del()) {
+      key = &req.del().key();
+    } else {
+      continue;
+    }
+    if (!keys.insert(*key).second) {
+      it->has_content = false;
+      it->content.clear();
+      skipped++;
+    }
+  }
+  DLOG(INFO) << "BinlogSender to " << node_ << " skip " << skipped
+    << " of " << window_.size() << " records ahead of "
+    << filenum_ << "_" << offset_ << ", Partition: " << table_name_
+    << "_" << partition_id_;
+}
+
+// Successive items without content are sent as one SKIP
+void ZPBinlogSendTask::PopWindow() {
+  WindowItem& front = window_.front();
+  pre_has_content_ = front.has_content;
+  pre_content_.swap(front.content);
+  offset_ = front.end;
+  window_.pop_front();
+  while (!pre_has_content_
+      && !window_.empty() && !window_.front().has_content) {
+    offset_ = window_.front().end;
+    window_.pop_front();
+  }
+}
+
 // Build LEASE SyncRequest
 void ZPBinlogSendTask::BuildLeaseSyncRequest(int64_t lease_time,
     client::SyncRequest* msg) const {
@@ -277,6 +375,7 @@ Status ZPBinlogSendTaskPool::AddTask(ZPBinlogSendTask* task) {
   --(task_ptrs_[task->name()].iter);
   task_ptrs_[task->name()].sequence = task->sequence();  // the latest one
   task_ptrs_[task->name()].filenum_snap = task->filenum();  // current filenum
+  task_ptrs_[task->name()].pause_until = 0;
   return Status::OK();
 }
 
@@ -312,16 +411,45 @@ int32_t ZPBinlogSendTaskPool::TaskFilenum(const std::string &name) {
   return (*(it->second.iter))->filenum();
 }
 
+// Pause the task until the given time, keep the larger one
+Status ZPBinlogSendTaskPool::PauseTask(const std::string &name,
+    uint64_t until) {
+  slash::RWLock l(&tasks_rwlock_, true);
+  ZPBinlogSendTaskIndex::iterator it = task_ptrs_.find(name);
+  if (it == task_ptrs_.end()) {
+    return Status::NotFound("Task not exist");
+  }
+  if (until > it->second.pause_until) {
+    it->second.pause_until = until;
+  }
+  return Status::OK();
+}
+
+bool ZPBinlogSendTaskPool::TaskPaused(const std::string &name) {
+  slash::RWLock l(&tasks_rwlock_, false);
+  ZPBinlogSendTaskIndex::iterator it = task_ptrs_.find(name);
+  return it != task_ptrs_.end()
+    && it->second.pause_until > slash::NowMicros();
+}
+
 // Fetch one task out from the front of tasks_ list
 // and live the its ptr point to the tasks_.end()
-// to distinguish from task has been removed
+// to distinguish from task has been removed,
+// paused tasks are skipped
 Status ZPBinlogSendTaskPool::FetchOut(ZPBinlogSendTask** task_ptr) {
   slash::RWLock l(&tasks_rwlock_, true);
-  if (tasks_.size() == 0) {
+  uint64_t now = slash::NowMicros();
+  std::list<ZPBinlogSendTask*>::iterator iter = tasks_.begin();
+  for (; iter != tasks_.end(); ++iter) {
+    if (task_ptrs_[(*iter)->name()].pause_until <= now) {
+      break;
+    }
+  }
+  if (iter == tasks_.end()) {
     return Status::NotFound("No more task");
   }
-  *task_ptr = tasks_.front();
-  tasks_.pop_front();
+  *task_ptr = *iter;
+  tasks_.erase(iter);
   // Do not remove from the task_ptrs_ map
   // When the same task put back we need to know it is a old one
   task_ptrs_[(*task_ptr)->name()].iter = tasks_.end();
@@ -482,6 +610,7 @@ void* ZPBinlogSendThread::ThreadMain() {
     // Fetched one task, process it
     Status item_s = Status::OK();
     uint64_t time_begin = slash::NowMicros();
+    uint64_t pause_check_time = time_begin;
     while (!should_stop()) {
       if (task->send_next) {
         // Process ProcessTask
@@ -534,14 +663,20 @@ void* ZPBinlogSendThread::ThreadMain() {
         }
       }
 
-      // Check if need to switch task
-      if (slash::NowMicros() - time_begin > kBinlogTimeSlice * 1000000) {
-        // Switch Task
-        if (!task->send_next) {
-          // Binlog items read last time hasn't be sent successfully
-          // So fallback to the pre offset to wait until next timeslice
-          task->Fallback2PreOffset();
+      // Slave db is about to stall, switch task
+      // Item not sent yet is kept, and sent first next time,
+      // since send_next is false
+      uint64_t now = slash::NowMicros();
+      if (now - pause_check_time > kBinlogPauseCheckInterval * 1000) {
+        pause_check_time = now;
+        if (pool_->TaskPaused(task->name())) {
+          RenewPeerLease(task);
+          break;
         }
+      }
+
+      // Check if need to switch task
+      if (now - time_begin > kBinlogTimeSlice * 1000000) {
         RenewPeerLease(task);
         break;
       }
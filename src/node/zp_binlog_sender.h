@@ -12,6 +12,7 @@
 // limitations under the License.
 #ifndef SRC_NODE_ZP_BINLOG_SENDER_H_
 #define SRC_NODE_ZP_BINLOG_SENDER_H_
+#include <deque>
 #include <list>
 #include <string>
 #include <unordered_map>
@@ -29,11 +30,13 @@
 using slash::Status;
 using slash::Slice;
 
+struct BinlogOffset;
 class ZPBinlogSendTask;
 struct ZPBinlogSendTaskHandle {
   std::list< ZPBinlogSendTask* >::iterator iter;
   uint64_t sequence;  // use squence to distinguish task with same name
   uint32_t filenum_snap;
+  uint64_t pause_until;  // slave ask to pause sending until, micro seconds
 };
 
 typedef std::unordered_map< std::string,
@@ -100,10 +103,6 @@ class ZPBinlogSendTask  {
   void BuildLeaseSyncRequest(int64_t lease_time,
       client::SyncRequest* msg) const;
   void BuildCommonSyncRequest(client::SyncRequest *msg) const;
-  void Fallback2PreOffset() {
-    filenum_ = pre_filenum_;
-    offset_ = pre_offset_;
-  }
 
  private:
   uint64_t sequence_;
@@ -124,6 +123,7 @@ class ZPBinlogSendTask  {
   std::string binlog_filename_;  // Name of the binlog file
   slash::SequentialFile *queue_;
   BinlogReader *reader_;
+  BinlogReadahead *readahead_;
   Status Init();
   // Record current filenum and offset in the pre one
   // So that we can know where the last binlog item begin
@@ -132,6 +132,20 @@ class ZPBinlogSendTask  {
     pre_offset_ = offset_;
   }
 
+  // Dedup related
+  // Task far behind reads a window of records ahead in current file,
+  // Set and Del overwritten by a later one on the same key in it
+  // are sent as SKIP, so that offsets keep aligned with master
+  struct WindowItem {
+    uint64_t end;
+    bool has_content;
+    std::string content;
+  };
+  std::deque<WindowItem> window_;
+  bool NeedDedup(const BinlogOffset& end) const;
+  void FillWindow(const BinlogOffset& end);
+  void PopWindow();
+
 };
 
 //
@@ -149,6 +163,8 @@ class ZPBinlogSendTaskPool  {
       uint32_t ifilenum, uint64_t ioffset, bool force);
   Status RemoveTask(const std::string &name);
   int32_t TaskFilenum(const std::string &name);
+  Status PauseTask(const std::string &name, uint64_t until);
+  bool TaskPaused(const std::string &name);
   size_t Size() {
     slash::RWLock l(&tasks_rwlock_, false);
     return task_ptrs_.size();
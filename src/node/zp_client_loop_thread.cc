@@ -0,0 +1,263 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_client_loop_thread.h"
+
+#include <glog/logging.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <vector>
+
+#include "slash/include/env.h"
+#include "slash/include/slash_string.h"
+
+#include "include/zp_const.h"
+
+ZPClientLoopThread::ZPClientLoopThread(int port,
+    pink::ConnFactory* conn_factory, const pink::ServerHandle* handle)
+  : port_(port),
+  conn_factory_(conn_factory),
+  handle_(handle),
+  listen_fd_(-1),
+  epfd_(-1),
+  conn_num_(0),
+  last_cron_(0),
+  accept_paused_until_(0) {
+    set_thread_name("ZPDataClientLoop");
+  }
+
+ZPClientLoopThread::~ZPClientLoopThread() {
+  StopThread();
+  for (auto& kv : conns_) {
+    close(kv.first);
+    delete kv.second.conn;
+  }
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+  }
+  if (epfd_ >= 0) {
+    close(epfd_);
+  }
+}
+
+Status ZPClientLoopThread::Listen() {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (listen_fd_ < 0) {
+    return Status::IOError("socket failed", strerror(errno));
+  }
+  int yes = 1;
+  if (setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0
+      || setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT,
+        &yes, sizeof(yes)) < 0) {
+    return Status::NotSupported("SO_REUSEPORT", strerror(errno));
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port_);
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+        sizeof(addr)) < 0
+      || listen(listen_fd_, kClientLoopBacklog) < 0) {
+    return Status::IOError("bind or listen failed", strerror(errno));
+  }
+
+  epfd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd_ < 0) {
+    return Status::IOError("epoll_create failed", strerror(errno));
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = listen_fd_;
+  if (epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0) {
+    return Status::IOError("epoll_ctl failed", strerror(errno));
+  }
+  return Status::OK();
+}
+
+void* ZPClientLoopThread::ThreadMain() {
+  std::vector<struct epoll_event> events(kClientLoopMaxEvents);
+  while (!should_stop()) {
+    int timeout = kClientLoopPollTimeout;
+    if (accept_paused_until_ > 0) {
+      timeout = kClientLoopAcceptPause;
+    }
+    int n = epoll_wait(epfd_, &events[0], kClientLoopMaxEvents, timeout);
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.fd == listen_fd_) {
+        Accept();
+      } else {
+        HandleConn(events[i].data.fd, events[i].events);
+      }
+    }
+
+    uint64_t now = slash::NowMicros();
+    if (accept_paused_until_ > 0 && now >= accept_paused_until_) {
+      ResumeAccept();
+    }
+    if (now - last_cron_ > kDispatchCronInterval * 1000) {
+      last_cron_ = now;
+      CloseIdleConns();
+      if (handle_ != NULL) {
+        handle_->CronHandle();
+      }
+    }
+  }
+  return NULL;
+}
+
+// Accept all pending connections, helpful on reconnect storm
+void ZPClientLoopThread::Accept() {
+  while (true) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = accept4(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+        &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOG(WARNING) << "Client loop accept failed: " << strerror(errno);
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EMFILE || errno == ENFILE) {
+        PauseAccept();
+      }
+      return;
+    }
+
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    std::string ip_port = slash::IpPortString(ip, ntohs(addr.sin_port));
+    // The loop is not a pink::ServerThread, so no server thread is given,
+    // neither PbConn nor ZPDataClientConn ever uses it
+    pink::PinkConn* conn = conn_factory_->NewPinkConn(fd, ip_port,
+        NULL, NULL);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      LOG(WARNING) << "Client loop add conn " << ip_port << " failed: "
+        << strerror(errno);
+      close(fd);
+      delete conn;
+      continue;
+    }
+    conns_[fd] = ConnItem{conn, slash::NowMicros()};
+    conn_num_++;
+  }
+}
+
+// Pending connections wait in backlog until fds are freed
+void ZPClientLoopThread::PauseAccept() {
+  struct epoll_event ev;
+  ev.events = 0;
+  ev.data.fd = listen_fd_;
+  if (epoll_ctl(epfd_, EPOLL_CTL_MOD, listen_fd_, &ev) == 0) {
+    accept_paused_until_ = slash::NowMicros() + kClientLoopAcceptPause * 1000;
+  }
+}
+
+void ZPClientLoopThread::ResumeAccept() {
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = listen_fd_;
+  if (epoll_ctl(epfd_, EPOLL_CTL_MOD, listen_fd_, &ev) == 0) {
+    accept_paused_until_ = 0;
+  }
+}
+
+void ZPClientLoopThread::HandleConn(int fd, uint32_t events) {
+  auto iter = conns_.find(fd);
+  if (iter == conns_.end()) {
+    return;
+  }
+  pink::PinkConn* conn = iter->second.conn;
+  iter->second.last_active = slash::NowMicros();
+
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    CloseConn(fd);
+    return;
+  }
+
+  // Finish the pending reply first, then read the next request
+  // in the same pass if readable too
+  if ((events & EPOLLOUT) && conn->is_reply() && !Reply(fd, conn)) {
+    CloseConn(fd);
+    return;
+  }
+
+  if ((events & EPOLLIN) && !conn->is_reply()) {
+    pink::ReadStatus rs = conn->GetRequest();
+    if (rs == pink::kReadHalf) {
+      return;
+    } else if (rs != pink::kReadAll) {
+      CloseConn(fd);
+      return;
+    }
+    if (conn->is_reply() && !Reply(fd, conn)) {
+      CloseConn(fd);
+    }
+  }
+}
+
+// Write reply directly, wait for EPOLLOUT only when socket is full
+bool ZPClientLoopThread::Reply(int fd, pink::PinkConn* conn) {
+  pink::WriteStatus ws = conn->SendReply();
+  struct epoll_event ev;
+  ev.data.fd = fd;
+  if (ws == pink::kWriteAll) {
+    conn->set_is_reply(false);
+    ev.events = EPOLLIN;
+  } else if (ws == pink::kWriteHalf) {
+    ev.events = EPOLLOUT;
+  } else {
+    return false;
+  }
+  return epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void ZPClientLoopThread::CloseConn(int fd) {
+  auto iter = conns_.find(fd);
+  if (iter == conns_.end()) {
+    return;
+  }
+  epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+  delete iter->second.conn;
+  conns_.erase(iter);
+  conn_num_--;
+}
+
+void ZPClientLoopThread::CloseIdleConns() {
+  uint64_t now = slash::NowMicros();
+  std::vector<int> idle;
+  for (auto& kv : conns_) {
+    if (now - kv.second.last_active
+        > static_cast<uint64_t>(kKeepAlive) * 1000000) {
+      idle.push_back(kv.first);
+    }
+  }
+  for (int fd : idle) {
+    DLOG(INFO) << "Client loop close idle conn "
+      << conns_[fd].conn->ip_port();
+    CloseConn(fd);
+  }
+}
@@ -0,0 +1,72 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_CLIENT_LOOP_THREAD_H_
+#define SRC_NODE_ZP_CLIENT_LOOP_THREAD_H_
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+#include "slash/include/slash_status.h"
+#include "pink/include/pink_thread.h"
+#include "pink/include/pink_conn.h"
+#include "pink/include/server_thread.h"
+
+using slash::Status;
+
+/**
+ * ZPClientLoopThread
+ * One of the event loops serving client port, every loop listens
+ * on the same port with SO_REUSEPORT and owns the connections it accepts,
+ * so that no single acceptor becomes the bottleneck
+ */
+class ZPClientLoopThread : public pink::Thread  {
+ public:
+  // Handle's CronHandle is called by the loop if given
+  ZPClientLoopThread(int port, pink::ConnFactory* conn_factory,
+      const pink::ServerHandle* handle = NULL);
+  virtual ~ZPClientLoopThread();
+
+  Status Listen();
+  int conn_num() const {
+    return conn_num_;
+  }
+
+ private:
+  struct ConnItem {
+    pink::PinkConn* conn;
+    uint64_t last_active;  // micro seconds
+  };
+
+  int port_;
+  pink::ConnFactory* conn_factory_;
+  const pink::ServerHandle* handle_;
+  int listen_fd_;
+  int epfd_;
+  std::atomic<int> conn_num_;
+  std::unordered_map<int, ConnItem> conns_;  // only accessed by the loop
+  uint64_t last_cron_;
+  uint64_t accept_paused_until_;  // micro seconds, 0 if not paused
+
+  virtual void* ThreadMain();
+  void Accept();
+  // Listen fd stays readable when out of fd, stop polling it for a while
+  void PauseAccept();
+  void ResumeAccept();
+  void HandleConn(int fd, uint32_t events);
+  bool Reply(int fd, pink::PinkConn* conn);
+  void CloseConn(int fd);
+  void CloseIdleConns();
+};
+
+#endif  // SRC_NODE_ZP_CLIENT_LOOP_THREAD_H_
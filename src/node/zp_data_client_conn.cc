@@ -14,15 +14,32 @@
 #include "src/node/zp_data_client_conn.h"
 
 #include <glog/logging.h>
+#include <atomic>
 #include <memory>
 #include "src/node/zp_data_server.h"
 
 extern ZPDataServer* zp_data_server;
 
+// Conn is created in its worker thread, pin the worker on first conn
+static void PinDispatchWorker() {
+  static std::atomic<int> next_index(0);
+  static thread_local bool pinned = false;
+  if (!pinned) {
+    pinned = true;
+    PinThread(pthread_self(), g_zp_conf->dispatch_cpus(), next_index++);
+  }
+}
+
 ////// ZPDataClientConn ///// /
 ZPDataClientConn::ZPDataClientConn(int fd, std::string ip_port,
     pink::ServerThread* server_thread) :
-  PbConn(fd, ip_port, server_thread) {
+  PbConn(fd, ip_port, server_thread),
+  tables_version_(0) {
+  int port = 0;
+  if (!slash::ParseIpPortString(ip_port, client_ip_, port)) {
+    client_ip_ = ip_port;
+  }
+  PinDispatchWorker();
 }
 
 ZPDataClientConn::~ZPDataClientConn() {
@@ -68,20 +85,33 @@ int ZPDataClientConn::DealMessageInternal() {
     << ", table=" << cmd->ExtractTable(&request_)
     << " key=" << cmd->ExtractKey(&request_);
 
+  Table* table = ResolveTable(cmd->ExtractTable(&request_));
+
+  // Admission control, admin commands are never limited
+  if (!cmd->is_admin() && table != NULL && table->qos()->enable()) {
+    uint64_t wait_us = table->qos()->Admit(client_ip_, cmd->is_write(),
+        header_len_);
+    if (wait_us > 0) {
+      response_.set_type(request_.type());
+      response_.set_code(client::StatusCode::kWait);
+      response_.set_msg("qos limited");
+      response_.set_retry_after(wait_us / 1000 + 1);
+      return 0;
+    }
+  }
+
   if (!cmd->is_single_paritition()) {
     cmd->Do(&request_, &response_);
+    QosCharge(cmd, table);
     return 0;
   }
 
   // Single Partition related Cmds
-  std::shared_ptr<Partition> partition;
-  int partition_id = cmd->ExtractPartition(&request_);
-  if (partition_id >= 0) {
-    partition = zp_data_server->GetTablePartitionById(
-        cmd->ExtractTable(&request_), partition_id);
-  } else {
-    partition = zp_data_server->GetTablePartition(
-        cmd->ExtractTable(&request_), cmd->ExtractKey(&request_));
+  Partition* partition = NULL;
+  if (table != NULL) {
+    int partition_id = cmd->ExtractPartition(&request_);
+    partition = partition_id >= 0 ? table->RoutePartitionById(partition_id)
+      : table->RoutePartition(cmd->ExtractKey(&request_));
   }
 
   if (partition == NULL) {
@@ -93,10 +123,32 @@ int ZPDataClientConn::DealMessageInternal() {
   }
 
   partition->DoCommand(cmd, request_, &response_);
+  QosCharge(cmd, table);
 
   return 0;
 }
 
+// Resolve table name only when it or the tables changed,
+// the handle keeps the table and its partitions alive
+Table* ZPDataClientConn::ResolveTable(const std::string& table_name) {
+  uint64_t version = zp_data_server->tables_version();
+  if (version != tables_version_ || table_name != table_name_) {
+    table_ = zp_data_server->FindTable(table_name);
+    table_name_ = table_name;
+    tables_version_ = version;
+  }
+  return table_.get();
+}
+
+// Read bytes are only known after execution
+void ZPDataClientConn::QosCharge(const Cmd* cmd, Table* table) {
+  if (cmd->is_admin() || cmd->is_write() || table == NULL
+      || !table->qos()->enable()) {
+    return;
+  }
+  table->qos()->Charge(client_ip_, false, response_.ByteSize());
+}
+
 ////// ZPDataClientConnHandle ///// /
 void ZPDataClientConnHandle::CronHandle() const {
   // Note: ServerCurrentQPS is the sum of client qps and sync qps;
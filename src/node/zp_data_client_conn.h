@@ -14,13 +14,17 @@
 #ifndef SRC_NODE_ZP_DATA_CLIENT_CONN_H_
 #define SRC_NODE_ZP_DATA_CLIENT_CONN_H_
 
+#include <memory>
 #include <string>
 #include "pink/include/pb_conn.h"
 #include "pink/include/pink_thread.h"
 #include "pink/include/server_thread.h"
 
+#include "include/zp_command.h"
 #include "src/node/client.pb.h"
 
+class Table;
+
 class ZPDataClientConn : public pink::PbConn  {
  public:
   ZPDataClientConn(int fd, std::string ip_port,
@@ -32,8 +36,16 @@ class ZPDataClientConn : public pink::PbConn  {
  private:
   client::CmdRequest request_;
   client::CmdResponse response_;
+  std::string client_ip_;
+
+  // Table handle of the last request
+  std::string table_name_;
+  std::shared_ptr<Table> table_;
+  uint64_t tables_version_;
+  Table* ResolveTable(const std::string& table_name);
 
   int DealMessageInternal();
+  void QosCharge(const Cmd* cmd, Table* table);
 };
 
 class ZPDataClientConnHandle : public pink::ServerHandle  {
@@ -15,9 +15,12 @@
 
 #include <glog/logging.h>
 #include <memory>
+#include <algorithm>
 #include <vector>
+#include <atomic>
 #include <unordered_map>
 #include "slash/include/slash_string.h"
+#include "slash/include/slash_mutex.h"
 
 #include "include/db_nemo.h"
 #include "src/node/zp_data_server.h"
@@ -277,9 +280,10 @@ void MgetCmd::Do(const google::protobuf::Message *req,
   sub_req.set_type(client::Type::GET);
   client::CmdResponse sub_res;
   sub_res.set_type(client::Type::GET);
+  std::shared_ptr<Table> table =
+    zp_data_server->FindTable(request->mget().table_name());
   for (auto& key : request->mget().keys()) {
-    std::shared_ptr<Partition> partition = zp_data_server->GetTablePartition(
-        request->mget().table_name(), key);
+    Partition* partition = table ? table->RoutePartition(key) : NULL;
     if (partition == NULL) {
       LOG(WARNING) << "command failed: Mget, no partition for key:" << key;
       response->set_code(client::StatusCode::kError);
@@ -513,3 +517,255 @@ void FlushDBCmd::Do(const google::protobuf::Message *req,
       << ptr->table_name() << "_" << ptr->partition_id();
   }
 }
+
+void IngestCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+  Partition* ptr = static_cast<Partition*>(partition);
+
+  response->Clear();
+  response->set_type(client::Type::INGEST);
+  if (request->ingest().files_size() == 0) {
+    response->set_code(client::StatusCode::kError);
+    response->set_msg("no file to ingest");
+    return;
+  }
+
+  std::vector<std::string> files(request->ingest().files().begin(),
+      request->ingest().files().end());
+  Status s = ptr->Ingest(files, *request);
+  if (!s.ok()) {
+    response->set_code(client::StatusCode::kError);
+    response->set_msg(s.ToString());
+    LOG(WARNING) << "IngestCmd failed at "
+      << ptr->table_name() << "_" << ptr->partition_id()
+      << ", caz:" << s.ToString();
+  } else {
+    response->set_code(client::StatusCode::kOk);
+    LOG(INFO) << "IngestCmd Success at "
+      << ptr->table_name() << "_" << ptr->partition_id()
+      << ", file count: " << files.size();
+  }
+}
+
+void BackupCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+
+  response->Clear();
+  response->set_type(client::Type::BACKUP);
+  const std::string& table_name = request->backup().table_name();
+  if (!zp_data_server->BackupTable(table_name, response->mutable_backup())) {
+    response->clear_backup();
+    response->set_code(client::StatusCode::kError);
+    response->set_msg("no master partition to backup");
+    LOG(WARNING) << "BackupCmd failed, table: " << table_name;
+    return;
+  }
+  response->set_code(client::StatusCode::kOk);
+  LOG(INFO) << "BackupCmd Success, table: " << table_name
+    << ", backup: " << response->backup().name();
+}
+
+void SubscribeCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+  Partition* ptr = static_cast<Partition*>(partition);
+
+  response->Clear();
+  response->set_type(client::Type::SUBSCRIBE);
+
+  const client::CmdRequest_Subscribe& subscribe = request->subscribe();
+  int max_count = kSubscribeBatchCount;
+  if (subscribe.has_max_count()) {
+    max_count = std::max(1,
+        std::min(subscribe.max_count(), kSubscribeMaxBatchCount));
+  }
+  int max_bytes = kSubscribeBatchSize;
+  if (subscribe.has_max_bytes()) {
+    max_bytes = std::max(1,
+        std::min(subscribe.max_bytes(), kSubscribeMaxBatchSize));
+  }
+
+  BinlogOffset from(subscribe.offset().filenum(),
+      subscribe.offset().offset());
+  if (subscribe.has_since()) {
+    ptr->FindBinlogOffset(subscribe.since(), &from);
+  }
+  Status s = ptr->ReadBinlog(subscribe.subscriber(), from,
+      max_count, max_bytes, response->mutable_subscribe());
+  if (!s.ok()) {
+    response->clear_subscribe();
+    response->set_code(client::StatusCode::kError);
+    response->set_msg(s.ToString());
+    LOG(WARNING) << "SubscribeCmd failed at "
+      << ptr->table_name() << "_" << ptr->partition_id()
+      << ", subscriber: " << subscribe.subscriber()
+      << ", caz:" << s.ToString();
+    return;
+  }
+  response->set_code(client::StatusCode::kOk);
+}
+
+static void SyncOne(const client::CmdRequest_Sync& sync,
+    client::CmdResponse_SyncResult* result) {
+  Cmd* sync_cmd = zp_data_server->CmdGet(client::Type::SYNC);
+  client::CmdRequest sub_req;
+  sub_req.set_type(client::Type::SYNC);
+  sub_req.mutable_sync()->CopyFrom(sync);
+  client::CmdResponse sub_res;
+
+  std::shared_ptr<Partition> partition = zp_data_server->GetTablePartitionById(
+      sync.table_name(), sync.sync_offset().partition());
+  if (partition == NULL) {
+    sub_res.set_code(client::StatusCode::kError);
+    sub_res.set_msg("no partition");
+  } else {
+    partition->DoCommand(sync_cmd, sub_req, &sub_res);
+  }
+
+  result->set_code(sub_res.code());
+  result->set_msg(sub_res.msg());
+  client::CmdRequest_Sync* res_sync = result->mutable_sync();
+  res_sync->CopyFrom(sync);
+  if (sub_res.has_sync()) {
+    // Fallback offset
+    res_sync->mutable_sync_offset()->set_filenum(
+        sub_res.sync().sync_offset().filenum());
+    res_sync->mutable_sync_offset()->set_offset(
+        sub_res.sync().sync_offset().offset());
+  }
+}
+
+// Shared by the workers of one SYNCBATCH request,
+// each result slot is only written by one worker
+struct SyncBatchContext {
+  const client::CmdRequest* request;
+  client::CmdResponse* response;
+  std::atomic<int> next;
+  slash::Mutex mu;
+  slash::CondVar cv;
+  int running;
+
+  SyncBatchContext(const client::CmdRequest* req, client::CmdResponse* res,
+      int workers)
+    : request(req), response(res), next(0), cv(&mu), running(workers) {}
+};
+
+static void SyncBatchWork(SyncBatchContext* ctx) {
+  int count = ctx->request->sync_batch_size();
+  int i;
+  while ((i = ctx->next.fetch_add(1)) < count) {
+    SyncOne(ctx->request->sync_batch(i), ctx->response->mutable_sync_batch(i));
+  }
+}
+
+static void DoSyncBatchWork(void* arg) {
+  SyncBatchContext* ctx = static_cast<SyncBatchContext*>(arg);
+  SyncBatchWork(ctx);
+  slash::MutexLock l(&ctx->mu);
+  ctx->running--;
+  ctx->cv.Signal();
+}
+
+void SyncBatchCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+
+  response->Clear();
+  response->set_type(client::Type::SYNCBATCH);
+  int count = request->sync_batch_size();
+  for (int i = 0; i < count; i++) {
+    response->add_sync_batch();
+  }
+
+  // Partitions are independent, handle them concurrently
+  // on the sync batch workers together with current thread
+  int worker_num = std::max(std::min(count, kSyncBatchWorkers) - 1, 0);
+  SyncBatchContext ctx(request, response, worker_num);
+  for (int i = 0; i < worker_num; i++) {
+    zp_data_server->BGSyncBatchTaskSchedule(&DoSyncBatchWork,
+        static_cast<void*>(&ctx));
+  }
+  SyncBatchWork(&ctx);
+  {
+    slash::MutexLock l(&ctx.mu);
+    while (ctx.running > 0) {
+      ctx.cv.Wait();
+    }
+  }
+
+  response->set_code(client::StatusCode::kOk);
+  LOG(INFO) << "SyncBatchCmd handle " << count << " partitions";
+}
+
+void SyncPauseCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+  const client::CmdRequest_SyncPause& pause = request->sync_pause();
+
+  response->Clear();
+  response->set_type(client::Type::SYNCPAUSE);
+  int pause_ms = std::min(pause.pause_ms(), kSyncPauseMax);
+  Node node(pause.node().ip(), pause.node().port() + kPortShiftSync);
+  Status s = zp_data_server->PauseBinlogSendTask(pause.table_name(),
+      pause.partition_id(), node, pause_ms);
+  if (!s.ok()) {
+    response->set_code(client::StatusCode::kNotFound);
+    response->set_msg(s.ToString());
+    return;
+  }
+  response->set_code(client::StatusCode::kOk);
+  DLOG(INFO) << "Pause binlog send task " << pause.table_name() << "_"
+    << pause.partition_id() << " to " << node << " for " << pause_ms << "ms";
+}
+
+void ConfigCmd::Do(const google::protobuf::Message *req,
+    google::protobuf::Message *res, void* partition) const {
+  const client::CmdRequest* request =
+    static_cast<const client::CmdRequest*>(req);
+  client::CmdResponse* response = static_cast<client::CmdResponse*>(res);
+  const client::CmdRequest_Config& config = request->config();
+
+  response->Clear();
+  response->set_type(client::Type::CONFIG);
+  if (config.has_value()) {
+    Status s = zp_data_server->ConfigSet(config.name(), config.value());
+    if (!s.ok()) {
+      response->set_code(client::StatusCode::kError);
+      response->set_msg(s.ToString());
+      return;
+    }
+    LOG(INFO) << "Config set " << config.name() << " to " << config.value();
+  }
+
+  std::vector<std::string> names;
+  if (config.name() == "*") {
+    names = ZpConf::DynamicItems();
+  } else {
+    names.push_back(config.name());
+  }
+  for (auto& name : names) {
+    std::string value;
+    if (!g_zp_conf->ConfigGet(name, &value)) {
+      response->clear_config();
+      response->set_code(client::StatusCode::kNotFound);
+      response->set_msg("unknown config item: " + name);
+      return;
+    }
+    client::CmdResponse_ConfigItem* item = response->add_config();
+    item->set_name(name);
+    item->set_value(value);
+  }
+  response->set_code(client::StatusCode::kOk);
+}
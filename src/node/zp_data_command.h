@@ -218,4 +218,94 @@ class FlushDBCmd : public Cmd  {
   }
 };
 
+class IngestCmd : public Cmd  {
+ public:
+  explicit IngestCmd(int flag) : Cmd(flag, kIngestCmd) {}
+  virtual std::string name() const {
+    return "Ingest";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition) const;
+  // Binlog marker is written by Partition::Ingest under suspend lock
+  virtual bool GenerateLog(const google::protobuf::Message *request,
+      std::string* raw) const {
+    return false;
+  }
+  virtual std::string ExtractTable(const google::protobuf::Message *req) const {
+    const client::CmdRequest* request =
+      static_cast<const client::CmdRequest*>(req);
+    return request->ingest().table_name();
+  }
+  virtual int ExtractPartition(const google::protobuf::Message *req) const {
+    const client::CmdRequest* request =
+      static_cast<const client::CmdRequest*>(req);
+    return request->ingest().partition_id();
+  }
+};
+
+class BackupCmd : public Cmd  {
+ public:
+  explicit BackupCmd(int flag) : Cmd(flag, kBackupCmd) {}
+  virtual std::string name() const {
+    return "Backup";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+  virtual std::string ExtractTable(const google::protobuf::Message *req) const {
+    const client::CmdRequest* request =
+      static_cast<const client::CmdRequest*>(req);
+    return request->backup().table_name();
+  }
+};
+
+class SubscribeCmd : public Cmd  {
+ public:
+  explicit SubscribeCmd(int flag) : Cmd(flag, kSubscribeCmd) {}
+  virtual std::string name() const {
+    return "Subscribe";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition) const;
+  virtual std::string ExtractTable(const google::protobuf::Message *req) const {
+    const client::CmdRequest* request =
+      static_cast<const client::CmdRequest*>(req);
+    return request->subscribe().table_name();
+  }
+  virtual int ExtractPartition(const google::protobuf::Message *req) const {
+    const client::CmdRequest* request =
+      static_cast<const client::CmdRequest*>(req);
+    return request->subscribe().partition_id();
+  }
+};
+
+class SyncBatchCmd : public Cmd  {
+ public:
+  explicit SyncBatchCmd(int flag) : Cmd(flag, kSyncBatchCmd) {}
+  virtual std::string name() const {
+    return "SyncBatch";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
+class SyncPauseCmd : public Cmd  {
+ public:
+  explicit SyncPauseCmd(int flag) : Cmd(flag, kSyncPauseCmd) {}
+  virtual std::string name() const {
+    return "SyncPause";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
+class ConfigCmd : public Cmd  {
+ public:
+  explicit ConfigCmd(int flag) : Cmd(flag, kConfigCmd) {}
+  virtual std::string name() const {
+    return "Config";
+  }
+  virtual void Do(const google::protobuf::Message *req,
+      google::protobuf::Message *res, void* partition = NULL) const;
+};
+
 #endif  // SRC_NODE_ZP_DATA_COMMAND_H_
@@ -13,15 +13,18 @@
 // limitations under the License.
 #include "src/node/zp_data_partition.h"
 
+#include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <fstream>
 #include <utility>
 
+#include "slash/include/slash_string.h"
 #include "slash/include/rsync.h"
 #include "src/node/zp_data_server.h"
 
@@ -35,6 +38,11 @@ struct DBSyncArg {
     : p(_p), ip(_ip), port(_port) {}
 };
 
+struct BackupArg {
+  Partition* p;
+  BackupInfo info;
+};
+
 struct PurgeArg {
   Partition* p;
   uint32_t to;
@@ -50,13 +58,20 @@ Partition::Partition(const std::string& table_name, const int partition_id,
   pstate_(ZPMeta::PState::ACTIVE),
   role_(Role::kNodeSingle),
   repl_state_(ReplState::kNoConnect),
+  binlog_time_(0),
+  apply_lag_(0),
   do_recovery_sync_(false),
   recover_sync_flag_(0),
+  sync_timer_on_(false),
   last_sync_time_(slash::NowMicros()),
   sync_lease_(kBinlogDefaultLease),
   stuck_recover_sync_flag_(0),
+  write_stall_(kStallNone),
+  stall_check_time_(0),
+  stall_notify_time_(0),
   purging_(false),
-  purged_index_(0) {
+  purged_index_(0),
+  archiving_(false) {
     // Partition related path
     log_path_ = NewPartitionPath(log_path, partition_id_);
     data_path_ = NewPartitionPath(data_path, partition_id_);
@@ -93,8 +108,9 @@ Status Partition::Open() {
   }
 
   // Create db handle
-  rocksdb::Status rs = rocksdb::DBNemo::Open(*(zp_data_server->db_options()),
-      data_path_, &db_);
+  rocksdb::Options options;
+  zp_data_server->GetDBOptions(&options);
+  rocksdb::Status rs = rocksdb::DBNemo::Open(options, data_path_, &db_);
   if (!rs.ok()) {
     LOG(FATAL) << "DBNemo open failed. table: " << table_name_
       << ", partition_id: " << partition_id_ << ", error: " << rs.ToString();
@@ -111,6 +127,7 @@ Status Partition::Open() {
   }
 
   opened_ = true;
+  LoadIngestOffset();
 
   slash::RWLock l(&fallback_rw_, true);
   fallback_.time = 0;
@@ -222,8 +239,9 @@ Status Partition::ChangeDb(const std::string& new_path) {
       << ", error: " << strerror(errno);
     return Status::Corruption(strerror(errno));
   }
-  rocksdb::Status s = rocksdb::DBNemo::Open(*(zp_data_server->db_options()),
-      data_path_, &db_);
+  rocksdb::Options options;
+  zp_data_server->GetDBOptions(&options);
+  rocksdb::Status s = rocksdb::DBNemo::Open(options, data_path_, &db_);
   if (!s.ok()) {
     LOG(FATAL) << "Failed to open new db: " << data_path_
       << " when change db, table: "
@@ -247,6 +265,93 @@ Status Partition::FlushDb() {
   return ChangeDb(empty_path);
 }
 
+// Fields appended to a serialized message are merged when parsed,
+// so the request need not be copied for the stamp
+static void StampBinlogTime(int64_t time, std::string* raw) {
+  client::CmdRequest stamp;
+  stamp.set_binlog_time(time);
+  stamp.AppendPartialToString(raw);
+}
+
+// Required: hold read mutex of state_rw_
+Status Partition::Ingest(const std::vector<std::string>& files,
+    const client::CmdRequest& marker) {
+  for (const auto& file : files) {
+    if (!slash::FileExists(file)) {
+      return Status::NotFound("ingest file not exist: " + file);
+    }
+  }
+  std::string raw;
+  if (!marker.SerializeToString(&raw)) {
+    return Status::Corruption("serialize ingest marker failed");
+  }
+
+  // Hard link the sst files into db, and
+  // keep the marker right behind them in binlog
+  rocksdb::IngestExternalFileOptions options;
+  options.move_files = true;
+  slash::RWLock l(&suspend_rw_, true);
+  rocksdb::Status rs = db_->IngestExternalFile(files, options);
+  if (!rs.ok()) {
+    return Status::Corruption(rs.ToString());
+  }
+  int64_t binlog_time = NextBinlogTime();
+  StampBinlogTime(binlog_time, &raw);
+  Status s = logger_->Put(raw, binlog_time);
+  if (!s.ok()) {
+    LOG(WARNING) << "Binlog Put ingest marker failed : " << s.ToString()
+      << ", Partition: " << table_name_ << "_" << partition_id_;
+    return s;
+  }
+
+  BinlogOffset boffset;
+  GetBinlogOffset(&boffset);
+  SaveIngestOffset(boffset);
+  LOG(INFO) << "Ingest " << files.size() << " files, marker end at "
+    << boffset.filenum << "_" << boffset.offset
+    << ", Partition: " << table_name_ << "_" << partition_id_;
+  return Status::OK();
+}
+
+void Partition::LoadIngestOffset() {
+  slash::MutexLock l(&ingest_protector_);
+  ingest_boffset_ = BinlogOffset();
+  std::ifstream is(log_path_ + kIngestInfoFile);
+  if (!is) {
+    return;
+  }
+  uint32_t filenum = 0;
+  uint64_t offset = 0;
+  if (is >> filenum >> offset) {
+    ingest_boffset_ = BinlogOffset(filenum, offset);
+  }
+  is.close();
+}
+
+// Zero offset means no ingest marker need to care about
+void Partition::SaveIngestOffset(const BinlogOffset& boffset) {
+  slash::MutexLock l(&ingest_protector_);
+  ingest_boffset_ = boffset;
+  std::string info_path = log_path_ + kIngestInfoFile;
+  if (boffset == BinlogOffset()) {
+    slash::DeleteFile(info_path);
+    return;
+  }
+  std::ofstream out(info_path, std::ios::out | std::ios::trunc);
+  if (!out.is_open()) {
+    LOG(WARNING) << "Failed to save ingest offset, Partition: "
+      << table_name_ << "_" << partition_id_;
+    return;
+  }
+  out << boffset.filenum << "\n" << boffset.offset << "\n";
+  out.close();
+}
+
+bool Partition::BehindIngest(const BinlogOffset& boffset) {
+  slash::MutexLock l(&ingest_protector_);
+  return boffset < ingest_boffset_;
+}
+
 ////// BGSave //// / /
 
 // Prepare env
@@ -396,6 +501,408 @@ void Partition::DoBgsave(void* arg) {
   p->bgsave_info_.bgsaving = false;
 }
 
+std::string Partition::backup_path() const {
+  return g_zp_conf->backup_path() + table_name_ + "/";
+}
+
+std::string Partition::archive_path() const {
+  return NewPartitionPath(backup_path() + kBackupBinlogDir, partition_id_);
+}
+
+// Copy file no faster than backup_speed_limit,
+// dst will not exist unless the whole file is copied
+static bool BackupCopyFile(const std::string& src, const std::string& dst) {
+  FILE* in = fopen(src.c_str(), "r");
+  if (in == NULL) {
+    LOG(WARNING) << "Open backup source file failed: " << src
+      << ", errno: " << errno;
+    return false;
+  }
+  std::string tmp = dst + ".tmp";
+  FILE* out = fopen(tmp.c_str(), "w");
+  if (out == NULL) {
+    LOG(WARNING) << "Open backup target file failed: " << tmp
+      << ", errno: " << errno;
+    fclose(in);
+    return false;
+  }
+
+  bool ok = true;
+  size_t n = 0;
+  uint64_t copied = 0;
+  uint64_t start = 0;
+  uint64_t limit = 0;
+  char* buf = new char[kBackupCopyChunk];
+  while ((n = fread(buf, 1, kBackupCopyChunk, in)) > 0) {
+    if (fwrite(buf, 1, n, out) != n) {
+      ok = false;
+      break;
+    }
+    // Limit may be changed by CONFIG SET, restart counting then
+    uint64_t cur_limit = static_cast<uint64_t>(
+        g_zp_conf->backup_speed_limit()) * 1024 * 1024;
+    if (cur_limit != limit) {
+      limit = cur_limit;
+      start = slash::NowMicros();
+      copied = 0;
+    }
+    copied += n;
+    uint64_t expect = copied * 1000000 / limit;
+    uint64_t elapse = slash::NowMicros() - start;
+    if (expect > elapse) {
+      usleep(expect - elapse);
+    }
+  }
+  delete[] buf;
+  if (ferror(in)) {
+    ok = false;
+  }
+  fclose(in);
+  if (fclose(out) != 0) {
+    ok = false;
+  }
+
+  if (!ok || slash::RenameFile(tmp, dst) != 0) {
+    LOG(WARNING) << "Copy backup file failed, from: " << src
+      << ", to: " << dst;
+    slash::DeleteFile(tmp);
+    return false;
+  }
+  return true;
+}
+
+// Name of sst file in shared dir. The same name may be another sst after
+// ChangeDb or DBSync, so key it with the size and inode of the checkpoint
+// file, which is a hard link of the living sst
+static bool BackupSharedName(const std::string& file, const std::string& src,
+    std::string* shared) {
+  struct stat file_stat;
+  if (stat(src.c_str(), &file_stat) != 0) {
+    return false;
+  }
+  *shared = file + "." + std::to_string(file_stat.st_size)
+    + "." + std::to_string(file_stat.st_ino);
+  return true;
+}
+
+bool Partition::BackupBegin(const std::string& name, BackupInfo* info) {
+  pthread_rwlock_rdlock(&state_rw_);
+  if (!opened_ || role_ == Role::kNodeSlave) {
+    // Only backup on master, slaves have the same data
+    pthread_rwlock_unlock(&state_rw_);
+    return false;
+  }
+
+  rocksdb::Status s = rocksdb::DBNemoCheckpoint::Create(db_, &info->cp);
+  if (!s.ok()) {
+    LOG(WARNING) << "Create DBNemoCheckpoint for backup failed :"
+      << s.ToString() << ", Partition:" << table_name_ << "_" << partition_id_;
+    pthread_rwlock_unlock(&state_rw_);
+    return false;
+  }
+
+  // Suspend until BackupEnd, so that all partitions of the backup
+  // have their checkpoint files and binlog offset at the same moment
+  pthread_rwlock_wrlock(&suspend_rw_);
+  logger_->GetProducerStatus(&info->filenum, &info->offset);
+  s = info->cp->GetCheckpointFiles(info->content.live_files,
+      info->content.live_wal_files,
+      info->content.manifest_file_size,
+      info->content.sequence_number);
+  if (!s.ok()) {
+    LOG(WARNING) << "Get backup content failed " << s.ToString()
+      << ", Partition:" << table_name_ << "_" << partition_id_;
+    pthread_rwlock_unlock(&suspend_rw_);
+    delete info->cp;
+    info->cp = NULL;
+    pthread_rwlock_unlock(&state_rw_);
+    return false;
+  }
+  info->name = name;
+  info->path = zp_data_server->backup_stage_path() + table_name_ + "/"
+    + name + "/" + std::to_string(partition_id_);
+  return true;
+}
+
+bool Partition::BackupEnd(BackupInfo* info) {
+  pthread_rwlock_unlock(&suspend_rw_);
+
+  // Hard link or copy the pinned files to local stage path
+  rocksdb::Status s;
+  if (!slash::DeleteDirIfExist(info->path)) {
+    s = rocksdb::Status::IOError("remove exist backup stage dir failed");
+  } else {
+    slash::CreatePath(info->path.substr(0, info->path.rfind('/')),
+        0755);  // create parent directory
+    s = info->cp->CreateCheckpointWithFiles(info->path,
+        info->content.live_files,
+        info->content.live_wal_files,
+        info->content.manifest_file_size,
+        info->content.sequence_number);
+  }
+  delete info->cp;
+  info->cp = NULL;
+  pthread_rwlock_unlock(&state_rw_);
+
+  if (!s.ok()) {
+    LOG(WARNING) << "Create backup checkpoint failed, Error:" << s.ToString()
+      << ", Partition:" << table_name_ << "_" << partition_id_;
+    return false;
+  }
+
+  // Copy to backup path in background
+  BackupArg* arg = new BackupArg();
+  arg->p = this;
+  arg->info = *info;
+  zp_data_server->BGBackupTaskSchedule(&DoBackup, static_cast<void*>(arg));
+  return true;
+}
+
+void Partition::DoBackup(void* arg) {
+  BackupArg* pbackup = static_cast<BackupArg*>(arg);
+  Partition* p = pbackup->p;
+
+  if (p->RunBackup(pbackup->info)) {
+    LOG(INFO) << "Backup " << pbackup->info.name << " finished"
+      << ", Partition:" << p->table_name_ << "_" << p->partition_id_;
+  }
+  slash::DeleteDirIfExist(pbackup->info.path);
+  delete pbackup;
+}
+
+// Layout of backup path:
+//   <table>/<name>/<partition>/     db of one backup, with bgsave info file
+//   <table>/shared/<partition>/     sst files shared by backups
+//   <table>/binlog/<partition>/     archived binlogs
+bool Partition::RunBackup(const BackupInfo& info) {
+  std::string snapshot_path = NewPartitionPath(backup_path() + info.name,
+      partition_id_);
+  std::string shared_path = NewPartitionPath(backup_path() + kBackupSharedDir,
+      partition_id_);
+  slash::CreatePath(snapshot_path, 0755);
+  slash::CreatePath(shared_path, 0755);
+  slash::CreatePath(archive_path(), 0755);
+
+  std::vector<std::string> files;
+  if (slash::GetChildren(info.path, files) != 0) {
+    LOG(WARNING) << "Get backup checkpoint files failed, path: " << info.path
+      << ", Partition:" << table_name_ << "_" << partition_id_;
+    return false;
+  }
+
+  for (auto& file : files) {
+    std::string src = info.path + "/" + file;
+    std::string dst = snapshot_path + file;
+    if (file.size() <= 4 || file.substr(file.size() - 4) != ".sst") {
+      if (!BackupCopyFile(src, dst)) {
+        return false;
+      }
+      continue;
+    }
+    // Sst files are immutable, copy only once for all backups
+    std::string shared;
+    if (!BackupSharedName(file, src, &shared)) {
+      LOG(WARNING) << "Stat backup file failed, path: " << src
+        << ", Partition:" << table_name_ << "_" << partition_id_;
+      return false;
+    }
+    shared = shared_path + shared;
+    if (!slash::FileExists(shared) && !BackupCopyFile(src, shared)) {
+      return false;
+    }
+    if (link(shared.c_str(), dst.c_str()) != 0
+        && !BackupCopyFile(shared, dst)) {
+      return false;
+    }
+  }
+
+  ArchiveBinlogs();
+
+  // Info file at last, which means the backup is complete
+  std::ofstream out;
+  out.open(snapshot_path + kBgsaveInfoFile, std::ios::in | std::ios::trunc);
+  if (!out.is_open()) {
+    LOG(WARNING) << "Write backup info file failed, path: " << snapshot_path
+      << ", Partition:" << table_name_ << "_" << partition_id_;
+    return false;
+  }
+  out << "0s\n"
+    << zp_data_server->local_ip() << "\n"
+    << zp_data_server->local_port() << "\n"
+    << info.filenum << "\n"
+    << info.offset << "\n";
+  out.close();
+  return true;
+}
+
+void Partition::DoArchiveBinlogs(void* arg) {
+  Partition* p = static_cast<Partition*>(arg);
+  p->ArchiveBinlogs();
+  p->archiving_ = false;
+}
+
+// Copy the finished binlogs which has not been archived
+void Partition::ArchiveBinlogs() {
+  std::map<uint32_t, std::string> binlogs;
+  uint32_t pro_num = 0;
+  {
+    slash::RWLock l(&state_rw_, false);
+    if (!opened_ || !GetBinlogFiles(&binlogs)) {
+      return;
+    }
+    uint64_t tmp;
+    logger_->GetProducerStatus(&pro_num, &tmp);
+  }
+
+  std::string archive = archive_path();
+  for (auto& binlog : binlogs) {
+    if (binlog.first >= pro_num) {
+      break;
+    }
+    if (BinlogArchived(binlog.second)) {
+      continue;
+    }
+    if (!BackupCopyFile(log_path_ + binlog.second, archive + binlog.second)) {
+      // Maybe purged, retry next time
+      return;
+    }
+    // Time index for restore to time, zp_restore could do without it
+    std::string tindex = BinlogTimeIndexFile(log_path_ + binlog.second);
+    if (slash::FileExists(tindex)) {
+      BackupCopyFile(tindex, BinlogTimeIndexFile(archive + binlog.second));
+    }
+  }
+}
+
+bool Partition::BinlogArchived(const std::string& filename) {
+  std::string archive = archive_path();
+  if (!slash::FileExists(archive)) {
+    // Archive is disabled
+    return true;
+  }
+  // Compare the uncompressed size, either side may be compressed
+  uint64_t archived = 0, size = 0;
+  bool archived_ok = BinlogFileSize(archive + filename, &archived).ok();
+  bool local_ok = BinlogFileSize(log_path_ + filename, &size).ok();
+  return archived_ok == local_ok && archived == size;
+}
+
+// Required: hold read lock of state_rw_, and partition is opened
+Status Partition::ReadBinlog(const std::string& subscriber,
+    const BinlogOffset& from, int max_count, int max_bytes,
+    client::CmdResponse_Subscribe* res) {
+  BinlogOffset end;
+  GetBinlogOffset(&end);
+  if (from > end) {
+    return Status::InvalidArgument("offset beyond the end of binlog");
+  }
+  {
+    slash::MutexLock l(&subscribe_protector_);
+    SubscriberInfo& info = subscribers_[subscriber];
+    info.offset = from;
+    info.active_time = time(NULL);
+  }
+
+  Status s;
+  int bytes = 0;
+  BinlogOffset cur = from;
+  slash::SequentialFile* queue = NULL;
+  BinlogReader* reader = NULL;
+  std::string item;
+  client::CmdRequest request;
+  while (cur != end
+      && res->mutations_size() < max_count
+      && bytes < max_bytes) {
+    if (reader == NULL) {
+      std::string file = NewFileName(logger_->filename(), cur.filenum);
+      s = NewBinlogSequentialFile(file, &queue);
+      if (!s.ok()) {
+        s = Status::NotFound("binlog purged or missing");
+        break;
+      }
+      reader = new BinlogReader(queue);
+      if (cur.offset > 0 && !(s = reader->Seek(cur.offset, file)).ok()) {
+        break;
+      }
+    }
+
+    uint64_t size = 0;
+    s = reader->Consume(&size, &item);
+    if (s.IsEndFile()) {
+      // Roll to next file
+      delete reader;
+      reader = NULL;
+      delete queue;
+      queue = NULL;
+      cur.filenum++;
+      cur.offset = 0;
+      continue;
+    } else if (s.IsIncomplete()) {
+      // Blank item, skip it
+    } else if (!s.ok()) {
+      reader->SkipNextBlock(&size);
+      if (cur.filenum == end.filenum && cur.offset + size > end.offset) {
+        // Never skip beyond the producer, the block may be still writing,
+        // stay here and retry on next poll
+        s = Status::Incomplete("binlog block not finished yet");
+        break;
+      }
+    } else {
+      if (!request.ParseFromString(item)) {
+        s = Status::Corruption("parse binlog item failed");
+        break;
+      }
+      client::CmdResponse_Subscribe_Mutation* mutation = res->add_mutations();
+      mutation->mutable_offset()->set_filenum(cur.filenum);
+      mutation->mutable_offset()->set_offset(cur.offset);
+      mutation->mutable_request()->Swap(&request);
+      bytes += item.size();
+    }
+    if (size == 0) {
+      s = Status::Corruption("no progress when read binlog");
+      break;
+    }
+    cur.offset += size;
+  }
+  delete reader;
+  delete queue;
+
+  if (!s.ok() && !s.IsEndFile() && !s.IsIncomplete()
+      && res->mutations_size() == 0) {
+    return s;
+  }
+  // Return what we got, the error will come back on next poll
+  res->mutable_next_offset()->set_filenum(cur.filenum);
+  res->mutable_next_offset()->set_offset(cur.offset);
+  return Status::OK();
+}
+
+void Partition::FindBinlogOffset(int64_t time, BinlogOffset* boffset) {
+  logger_->FindOffsetByTime(time, &boffset->filenum, &boffset->offset);
+}
+
+// Lagging subscribers beyond subscribe_pin_binlog_count are not waited
+bool Partition::SubscribersAllowPurge(uint32_t index, uint32_t pro_num) {
+  uint32_t pin = g_zp_conf->subscribe_pin_binlog_count();
+  time_t now = time(NULL);
+  slash::MutexLock l(&subscribe_protector_);
+  auto it = subscribers_.begin();
+  while (it != subscribers_.end()) {
+    if (now - it->second.active_time > kSubscriberExpire) {
+      LOG(INFO) << "Subscriber " << it->first << " expired"
+        << ", Partition: " << table_name_ << "_" << partition_id_;
+      it = subscribers_.erase(it);
+      continue;
+    }
+    if (index >= it->second.offset.filenum
+        && pro_num - it->second.offset.filenum <= pin) {
+      return false;
+    }
+    ++it;
+  }
+  return true;
+}
+
 bool Partition::TryUpdateMasterOffset() {
   // Check dbsync finished
   std::string info_path = sync_path_ + kBgsaveInfoFile;
@@ -502,12 +1009,16 @@ Status Partition::SlaveAskSync(const Node &node, BinlogOffset boffset) {
   }
 
   // Binlog already be purged
+  // or behind the last ingest marker
+  bool behind_ingest = BehindIngest(boffset);
   slash::RWLock lp(&purged_index_rw_, false);
   LOG(INFO) << "Partition:" << table_name_ << "_" << partition_id_
-    << ", We " << (purged_index_ > boffset.filenum ? "will" : "won't")
+    << ", We " << (purged_index_ > boffset.filenum || behind_ingest
+        ? "will" : "won't")
     << " TryDBSync, purged_index_=" << purged_index_
-    << ", filenum=" << boffset.filenum;
-  if (purged_index_ > boffset.filenum) {
+    << ", filenum=" << boffset.filenum
+    << ", behind ingest: " << behind_ingest;
+  if (purged_index_ > boffset.filenum || behind_ingest) {
     TryDBSync(node.ip, node.port + kPortShiftRsync, cur_filenum);
     return Status::Incomplete("Bgsaving and DBSync first");
   }
@@ -590,6 +1101,9 @@ void Partition::BecomeSlave() {
   last_sync_time_ = slash::NowMicros();
   sync_lease_ = kBinlogDefaultLease;
   ResetRecoverSync();
+  if (!sync_timer_on_.exchange(true)) {
+    ScheduleTimer(kPartitionCronInterval, &Partition::SyncTimer);
+  }
   stuck_recover_sync_flag_ = 0;
 }
 
@@ -690,6 +1204,7 @@ std::shared_ptr<Partition> NewPartition(const std::string &table_name,
     const Node& master, const std::set<Node> &slaves) {
   std::shared_ptr<Partition> partition(new Partition(table_name,
       partition_id, log_path, data_path, trash_path));
+  partition->StartTimers();
   return partition;
 }
 
@@ -708,6 +1223,8 @@ Status Partition::SetBinlogOffset(const BinlogOffset& target) {
     LOG(WARNING) << "SetBinlogOffset actual_offset small than expected"
       << ", expect:" << target.offset << ", actual_offset:" << actual_offset;
   }
+  // Binlog before target is gone, so does the ingest marker
+  SaveIngestOffset(BinlogOffset());
 
   if (target < old) {
     // Fallback to a smaller sync point, record for later checking
@@ -736,6 +1253,23 @@ bool Partition::GetBinlogOffset(BinlogOffset* boffset) const {
   return true;
 }
 
+int64_t Partition::NextBinlogTime() {
+  int64_t now = time(NULL);
+  int64_t last = binlog_time_.load();
+  while (now > last && !binlog_time_.compare_exchange_weak(last, now)) {
+  }
+  return std::max(now, last);
+}
+
+// Keep master's time, so it goes on from there once we become master
+void Partition::ApplyBinlogTime(int64_t time) {
+  int64_t last = binlog_time_.load();
+  while (time > last && !binlog_time_.compare_exchange_weak(last, time)) {
+  }
+  apply_lag_ = std::max(static_cast<int64_t>(0),
+      static_cast<int64_t>(::time(NULL)) - time);
+}
+
 // Required: hold read mutex of state_rw_
 bool Partition::CheckSyncOption(const PartitionSyncOption& option) {
   // Check from node
@@ -792,6 +1326,17 @@ void Partition::DoBinlogCommand(const PartitionSyncOption& option,
     return;
   }
 
+  if (cmd->type_ == kIngestCmd) {
+    // Ingested files never go through binlog,
+    // Stop here and trysync again, master will DBSync us
+    LOG(WARNING) << "Receive ingest marker from " << option.from_node
+      << " at " << option.filenum << "_" << option.offset
+      << ", will trysync for DBSync, Partition: "
+      << table_name_ << "_" << partition_id_;
+    TryRecoverSync();
+    return;
+  }
+
   uint64_t start_us = slash::NowMicros();
 
   // Add read lock for no suspend command
@@ -799,12 +1344,23 @@ void Partition::DoBinlogCommand(const PartitionSyncOption& option,
     pthread_rwlock_rdlock(&suspend_rw_);
   }
 
+  if (cmd->is_write()) {
+    // Could not refuse binlog, ask master to slow down instead
+    int stall = RefreshWriteStall();
+    if (stall != kStallNone) {
+      NotifyMasterStall(stall);
+    }
+  }
+
   client::CmdResponse res;
   cmd->Do(&req, &res, this);
 
   std::string raw;
   req.SerializeToString(&raw);
-  Status s = logger_->Put(raw);
+  Status s = logger_->Put(raw, req.binlog_time());
+  if (req.has_binlog_time()) {
+    ApplyBinlogTime(req.binlog_time());
+  }
   if (!s.ok()) {
     LOG(WARNING) << "Binlog Put failed : " << s.ToString()
       << ", table: " << table_name_
@@ -853,6 +1409,77 @@ void Partition::DoBinlogLeaseRenew(const PartitionSyncOption& option,
   sync_lease_ = lease;
 }
 
+// Recheck at most once per kWriteStallCheckInterval,
+// others use the last result
+int Partition::RefreshWriteStall() {
+  uint64_t now = slash::NowMicros();
+  uint64_t last = stall_check_time_;
+  if (now - last > kWriteStallCheckInterval * 1000
+      && stall_check_time_.compare_exchange_strong(last, now)) {
+    write_stall_ = CheckWriteStall();
+  }
+  return write_stall_;
+}
+
+// Required: hold read lock of state_rw_, and partition is opened
+int Partition::CheckWriteStall() {
+  ZPDataServer::WriteStallTriggers triggers;
+  zp_data_server->GetWriteStallTriggers(&triggers);
+  int stall = kStallNone;
+
+  std::string value;
+  int64_t l0_files = 0;
+  if (db_->GetProperty("rocksdb.num-files-at-level0", &value)
+      && slash::string2l(value.data(), value.size(), &l0_files)) {
+    if (l0_files >= triggers.level0_stop_writes_trigger - kWriteStallL0Margin) {
+      return kStallStop;
+    } else if (l0_files
+        >= triggers.level0_slowdown_writes_trigger - kWriteStallL0Margin) {
+      stall = kStallSlowdown;
+    }
+  }
+
+  uint64_t pending = 0;
+  if (db_->GetIntProperty("rocksdb.estimate-pending-compaction-bytes",
+        &pending)) {
+    if (triggers.hard_pending_compaction_bytes_limit > 0
+        && pending >= triggers.hard_pending_compaction_bytes_limit
+          / 100 * kWriteStallPendingPercent) {
+      return kStallStop;
+    } else if (triggers.soft_pending_compaction_bytes_limit > 0
+        && pending >= triggers.soft_pending_compaction_bytes_limit
+          / 100 * kWriteStallPendingPercent) {
+      stall = kStallSlowdown;
+    }
+  }
+
+  // Shared by all partitions, memtable flush is falling behind
+  rocksdb::WriteBufferManager* wbm = triggers.write_buffer_manager.get();
+  if (wbm != NULL && wbm->enabled()
+      && wbm->memory_usage() >= wbm->buffer_size()
+        / 100 * kWriteStallMemPercent) {
+    stall = kStallSlowdown;
+  }
+  return stall;
+}
+
+// Required: hold read lock of state_rw_
+void Partition::NotifyMasterStall(int stall) {
+  int pause_ms = (stall == kStallStop) ? kSyncPauseStop : kSyncPauseSlowdown;
+  uint64_t now = slash::NowMicros();
+  uint64_t last = stall_notify_time_;
+  // Renew the pause before it expires on master
+  if (now - last < static_cast<uint64_t>(pause_ms) * 1000 / 2
+      || !stall_notify_time_.compare_exchange_strong(last, now)) {
+    return;
+  }
+  LOG(INFO) << "Partition write stall, ask master " << master_node_
+    << " to pause " << pause_ms << "ms, Table: " << table_name_
+    << ", Partition: " << partition_id_ << ", Stall: " << stall;
+  zp_data_server->AddSyncPauseTask(table_name_, partition_id_,
+      master_node_, pause_ms);
+}
+
 void Partition::DoCommand(const Cmd* cmd, const client::CmdRequest &req,
     client::CmdResponse *res) {
   std::string key = cmd->ExtractKey(&req);
@@ -894,6 +1521,24 @@ void Partition::DoCommand(const Cmd* cmd, const client::CmdRequest &req,
     return;
   }
 
+  if (cmd->is_write()) {
+    int stall = RefreshWriteStall();
+    if (stall == kStallStop
+        || (stall == kStallSlowdown
+          && slash::NowMicros() % 100 > static_cast<uint64_t>(
+            g_zp_conf->slowdown_delay_radio()))) {
+      res->set_type(req.type());
+      res->set_code(client::StatusCode::kWait);
+      res->set_msg("partition write stall");
+      res->set_retry_after(kWriteStallRetryAfter);
+
+      DLOG(WARNING) << "Partition write stall, failed to DoCommand"
+        << ", Table: " << table_name_ << ", Partition: " << partition_id_
+        << ", Stall: " << stall;
+      return;
+    }
+  }
+
   uint64_t start_us = slash::NowMicros();
 
   // Add read lock for no suspend command
@@ -912,7 +1557,9 @@ void Partition::DoCommand(const Cmd* cmd, const client::CmdRequest &req,
       // Restore Message
       std::string raw;
       if (cmd->GenerateLog(&req, &raw)) {
-        logger_->Put(raw);
+        int64_t binlog_time = NextBinlogTime();
+        StampBinlogTime(binlog_time, &raw);
+        logger_->Put(raw, binlog_time);
       }
     }
     mutex_record_.Unlock(key);
@@ -944,7 +1591,7 @@ inline void Partition::ResetRecoverSync() {
   recover_sync_flag_ = 0;
 }
 
-// Required: hold write mutex of state_rw_
+// Required: hold read mutex of state_rw_, only called by SyncTimer
 bool Partition::NeedRecoverSync() {
   if (role_ != Role::kNodeSlave) {
     return false;
@@ -989,33 +1636,85 @@ bool Partition::NeedRecoverSync() {
   return false;
 }
 
-void Partition::DoTimingTask() {
-  // Purge log
-  if (!PurgeLogs(0, false)) {
-    return;
+void Partition::StartTimers() {
+  // Spread partitions over ticks to avoid bursts
+  ScheduleTimer((partition_id_ % kNodeCronWaitCount) * kNodeCronInterval,
+      &Partition::BinlogTimer);
+  ScheduleTimer((partition_id_ * kNodeCronInterval) % kPartitionPurgeInterval,
+      &Partition::PurgeTimer);
+}
+
+// Timer stops once partition destroyed
+void Partition::ScheduleTimer(int64_t delay_ms,
+    int64_t (Partition::*timer)()) {
+  std::weak_ptr<Partition> weak = shared_from_this();
+  zp_data_server->ScheduleTimer(delay_ms, [weak, timer]() -> int64_t {
+    std::shared_ptr<Partition> p = weak.lock();
+    return p ? ((*p).*timer)() : -1;
+  });
+}
+
+int64_t Partition::BinlogTimer() {
+  // Archive binlog for backup
+  bool expect = false;
+  if (slash::FileExists(archive_path())
+      && archiving_.compare_exchange_strong(expect, true)) {
+    zp_data_server->BGBackupTaskSchedule(&DoArchiveBinlogs,
+        static_cast<void*>(this));
+  }
+
+  // Create next binlog file ahead of roll
+  slash::RWLock l(&state_rw_, false);
+  if (opened_) {
+    logger_->PrepareNextFile();
+  }
+  return kPartitionCronInterval;
+}
+
+int64_t Partition::PurgeTimer() {
+  PurgeLogs(0, false);
+  return kPartitionPurgeInterval;
+}
+
+// Only scheduled for slave,
+// the write lock is taken only when trysync should be redone
+int64_t Partition::SyncTimer() {
+  {
+    slash::RWLock l(&state_rw_, false);
+    if (role_ != Role::kNodeSlave) {
+      sync_timer_on_ = false;
+      return -1;
+    }
+    if (!NeedRecoverSync()) {
+      return kPartitionCronInterval;
+    }
   }
 
-  // Maybe trysync
   slash::RWLock l(&state_rw_, true);
-  if (NeedRecoverSync()) {
+  if (role_ == Role::kNodeSlave) {
     BecomeSlave();
   }
+  return kPartitionCronInterval;
 }
 
 // Required: hold read mutex of state_rw_
 void Partition::TryDBSync(const std::string& ip, int port, int32_t top) {
   std::string bg_path;
   uint32_t bg_filenum = 0;
+  uint64_t bg_offset = 0;
   {
     slash::MutexLock l(&bgsave_protector_);
     bg_path = bgsave_info_.path;
     bg_filenum = bgsave_info_.filenum;
+    bg_offset = bgsave_info_.offset;
   }
 
   if (0 != slash::IsDir(bg_path) ||  // Bgsaving dir exist
       !slash::FileExists(NewFileName(logger_->filename(), bg_filenum)) ||
                                      // filenum can be found in binglog
-      top - bg_filenum > kDBSyncMaxGap) {  // The file is not too old
+      top - bg_filenum > kDBSyncMaxGap ||  // The file is not too old
+      BehindIngest(BinlogOffset(bg_filenum, bg_offset))) {
+                                     // Contain the ingested files
     // Need Bgsave first
     Bgsave();
   }
@@ -1166,6 +1865,7 @@ void Partition::DoPurgeLogs(void* arg) {
   Partition* ps = ppurge->p;
 
   ps->PurgeFiles(ppurge->to, ppurge->manual);
+  ps->CompressFiles();
 
   ps->purging_ = false;
   delete ppurge;
@@ -1201,6 +1901,15 @@ bool Partition::PurgeFiles(uint32_t to, bool manual) {
         (stat(((log_path_ + it->second)).c_str(), &file_stat) == 0 &&
          file_stat.st_mtime <
          time(NULL) - g_zp_conf->binlog_remain_days()*24*3600)) {  // Expire time trigger
+      // Keep it until archived, but not too many to fill the disk
+      if (!BinlogArchived(it->second)) {
+        if (remain_expire_num <= kBinlogArchiveMaxWait) {
+          return false;
+        }
+        LOG(ERROR) << "Purge binlog not archived, " << remain_expire_num
+          << " binlogs beyond binlog_remain_max_count: " << it->second
+          << ", Partition: " << table_name_ << "_" << partition_id_;
+      }
       // We check this every time to avoid lock when we do file deletion
       if (!CouldPurge(it->first)) {
         return false;
@@ -1208,6 +1917,7 @@ bool Partition::PurgeFiles(uint32_t to, bool manual) {
 
       // Do delete
       slash::Status s = slash::DeleteFile(log_path_ + it->second);
+      DeleteBinlogIndex(log_path_ + it->second);
       if (s.ok()) {
         ++delete_num;
         --remain_expire_num;
@@ -1230,6 +1940,55 @@ bool Partition::PurgeFiles(uint32_t to, bool manual) {
   return true;
 }
 
+// Compress the finished binlogs not modified for binlog_compress_hours
+void Partition::CompressFiles() {
+  int hours = g_zp_conf->binlog_compress_hours();
+  if (hours <= 0) {
+    return;
+  }
+  std::map<uint32_t, std::string> binlogs;
+  uint32_t pro_num = 0;
+  {
+    slash::RWLock l(&state_rw_, false);
+    if (!opened_ || !GetBinlogFiles(&binlogs)) {
+      return;
+    }
+    uint64_t tmp;
+    logger_->GetProducerStatus(&pro_num, &tmp);
+  }
+
+  time_t expire = time(NULL) - hours * 3600;
+  int compress_num = 0;
+  for (auto& binlog : binlogs) {
+    std::string file = log_path_ + binlog.second;
+    struct stat file_stat;
+    if (binlog.first >= pro_num
+        || stat(file.c_str(), &file_stat) != 0
+        || file_stat.st_mtime >= expire) {
+      break;
+    }
+    if (BinlogFileCompressed(file)) {
+      continue;
+    }
+    slash::RWLock l(&state_rw_, false);
+    if (!opened_) {
+      break;
+    }
+    Status s = logger_->CompressFile(binlog.first);
+    if (!s.ok()) {
+      LOG(WARNING) << "Compress binlog " << binlog.second << " failed: "
+        << s.ToString() << ", Partition: "
+        << table_name_ << "_" << partition_id_;
+      break;
+    }
+    compress_num++;
+  }
+  if (compress_num > 0) {
+    LOG(INFO) << "Compress " << compress_num << " binlogs for "
+      << table_name_ << "_" << partition_id_;
+  }
+}
+
 // Required hold read lock of state_rw_ and  partition opened
 bool Partition::CheckBinlogFiles() {
   if (!slash::FileExists(log_path_)) {
@@ -1319,6 +2078,10 @@ bool Partition::CouldPurge(uint32_t index) {
     return false;
   }
 
+  if (!SubscribersAllowPurge(index, pro_num)) {
+    return false;
+  }
+
   std::set<Node>::iterator it;
   slash::RWLock lp(&purged_index_rw_, true);
   for (it = slave_nodes_.begin(); it != slave_nodes_.end(); ++it) {
@@ -1357,6 +2120,23 @@ void Partition::Dump() {
   }
 }
 
+Status Partition::SetDBOptions(
+    const std::unordered_map<std::string, std::string>& options,
+    bool db_wide) {
+  slash::RWLock l(&state_rw_, false);
+  if (!opened_) {
+    return Status::OK();
+  }
+  rocksdb::Status s = db_wide ? db_->SetDBOptions(options)
+    : db_->SetOptions(options);
+  if (!s.ok()) {
+    LOG(WARNING) << "Set db options failed, Partition: " << table_name_
+      << "_" << partition_id_ << ", error: " << s.ToString();
+    return Status::Corruption(s.ToString());
+  }
+  return Status::OK();
+}
+
 bool Partition::GetState(client::PartitionState* state) {
   state->set_partition_id(partition_id_);
   slash::RWLock l(&state_rw_, false);
@@ -1382,6 +2162,7 @@ bool Partition::GetState(client::PartitionState* state) {
 
   // Fallback
   if (role_ == Role::kNodeSlave) {
+    state->set_apply_lag(apply_lag_);
     slash::RWLock l(&fallback_rw_, false);
     if (fallback_.time == 0) {
       // No fallback
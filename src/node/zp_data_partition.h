@@ -63,6 +63,11 @@ const std::string ReplStateMsg[] = {
   "kConnected",
   "kWaitDBSync"
 };
+enum WriteStall {
+  kStallNone = 0,
+  kStallSlowdown = 1,
+  kStallStop = 2,
+};
 
 // Slave item
 struct SlaveItem {
@@ -160,13 +165,29 @@ struct BGSaveInfo {
   }
 };
 
+struct BackupInfo {
+  std::string name;  // backup start time, shared by all partitions of it
+  std::string path;  // local checkpoint before copy to backup path
+  uint32_t filenum;
+  uint64_t offset;
+  rocksdb::DBNemoCheckpoint* cp;
+  CheckpointContent content;
+  BackupInfo() : filenum(0), offset(0), cp(NULL) {}
+};
+
+struct SubscriberInfo {
+  BinlogOffset offset;  // offset of the last poll
+  time_t active_time;
+  SubscriberInfo() : active_time(0) {}
+};
+
 struct FallbackInfo {
   uint64_t time;  // 0 means no fallback
   BinlogOffset before;
   BinlogOffset after;
 };
 
-class Partition  {
+class Partition : public std::enable_shared_from_this<Partition> {
  public:
   Partition(const std::string& table_name, const int partition_id,
       const std::string& log_path, const std::string& data_path,
@@ -219,6 +240,21 @@ class Partition  {
       const std::set<Node> &slaves);
   void Leave();
   Status FlushDb();
+  Status Ingest(const std::vector<std::string>& files,
+      const client::CmdRequest& marker);
+
+  // Backup related
+  // BackupBegin suspend partition and pin the checkpoint files,
+  // BackupEnd must be called after a successful BackupBegin
+  bool BackupBegin(const std::string& name, BackupInfo* info);
+  bool BackupEnd(BackupInfo* info);
+
+  // Subscribe related
+  // Required: hold read lock of state_rw_, and partition is opened
+  Status ReadBinlog(const std::string& subscriber, const BinlogOffset& from,
+      int max_count, int max_bytes, client::CmdResponse_Subscribe* res);
+  // Offset of the first mutation not earlier than time in seconds
+  void FindBinlogOffset(int64_t time, BinlogOffset* boffset);
 
   // Binlog related
   Status SlaveAskSync(const Node &node, BinlogOffset boffset);
@@ -230,7 +266,13 @@ class Partition  {
   bool GetWinBinlogOffset(BinlogOffset* win);
   bool GetState(client::PartitionState* state);
 
-  void DoTimingTask();
+  // Change mutable options of opened db, db_wide for DBOptions
+  Status SetDBOptions(
+      const std::unordered_map<std::string, std::string>& options,
+      bool db_wide);
+
+  // Schedule timing tasks, called once the partition is created
+  void StartTimers();
 
  private:
   std::string table_name_;
@@ -268,6 +310,11 @@ class Partition  {
   bool CheckBinlogFiles();  // Check binlog availible and update purge_index_
   Status SetBinlogOffset(const BinlogOffset& target);
   bool GetBinlogOffset(BinlogOffset* boffset) const;
+  // Coarse time in seconds stamped on binlog, never goes back
+  std::atomic<int64_t> binlog_time_;
+  std::atomic<int64_t> apply_lag_;  // (s) of the last applied binlog
+  int64_t NextBinlogTime();
+  void ApplyBinlogTime(int64_t time);
 
   // DoCommand related
   slash::RecordMutex mutex_record_;
@@ -281,12 +328,22 @@ class Partition  {
   void TryRecoverSync();
   void ResetRecoverSync();
   bool NeedRecoverSync();
+  std::atomic<bool> sync_timer_on_;  // SyncTimer scheduled
   std::atomic<uint64_t> last_sync_time_;
   std::atomic<uint64_t> sync_lease_;  // (s) use dynamic lease
                                       //set by masters' binlog sender
   std::atomic<int> stuck_recover_sync_flag_;  // how mand cron times
                                               // stuck out of kConnect
 
+  // Write stall related
+  // Shed writes before rocksdb stall them inside the dispatch thread
+  std::atomic<int> write_stall_;
+  std::atomic<uint64_t> stall_check_time_;
+  std::atomic<uint64_t> stall_notify_time_;  // last pause sent to master
+  int RefreshWriteStall();
+  int CheckWriteStall();
+  void NotifyMasterStall(int stall);
+
   // BGSave related
   slash::Mutex bgsave_protector_;
   BGSaveInfo bgsave_info_;
@@ -325,11 +382,46 @@ class Partition  {
   bool CouldPurge(uint32_t index);
   bool PurgeLogs(uint32_t to, bool manual);
   bool PurgeFiles(uint32_t to, bool manual);
+  void CompressFiles();
 
   // Fallback related
   pthread_rwlock_t fallback_rw_;  // protect partition status below
   FallbackInfo fallback_;
 
+  // Ingest related
+  // Ingested files never go through binlog,
+  // so slaves behind the last ingest marker should do DBSync
+  slash::Mutex ingest_protector_;
+  BinlogOffset ingest_boffset_;  // binlog offset right after the last marker
+  void LoadIngestOffset();
+  void SaveIngestOffset(const BinlogOffset& boffset);
+  bool BehindIngest(const BinlogOffset& boffset);
+
+  // Backup related
+  // Binlogs are archived once backup binlog dir of this partition exists,
+  // and will not be purged before archived
+  std::atomic<bool> archiving_;
+  std::string backup_path() const;
+  std::string archive_path() const;
+  static void DoBackup(void* arg);
+  bool RunBackup(const BackupInfo& info);
+  static void DoArchiveBinlogs(void* arg);
+  void ArchiveBinlogs();
+  bool BinlogArchived(const std::string& filename);
+
+  // Timing tasks, return delay of next run, negative to stop
+  void ScheduleTimer(int64_t delay_ms, int64_t (Partition::*timer)());
+  int64_t BinlogTimer();
+  int64_t PurgeTimer();
+  int64_t SyncTimer();
+
+  // Subscribe related
+  // Active subscribers keep binlogs from purged,
+  // unless fall behind more than subscribe_pin_binlog_count files
+  slash::Mutex subscribe_protector_;
+  std::unordered_map<std::string, SubscriberInfo> subscribers_;
+  bool SubscribersAllowPurge(uint32_t index, uint32_t pro_num);
+
   // Lock order:
   // state_rw_      >       suspend_rw_         >       bgsave_protector_
   // state_rw_      >       suspend_rw_         >       mutex_record_
@@ -337,6 +429,11 @@ class Partition  {
   // state_rw_      >       db_sync_protector_
   // state_rw_      >       purged_index_rw_
   // state_rw_      >       fallback_rw_
+  // state_rw_      >       suspend_rw_         >       ingest_protector_
+  // state_rw_      >       ingest_protector_
+  // state_rw_      >       subscribe_protector_
+  // Table::Backup holds state_rw_ and suspend_rw_ of many partitions,
+  // which are always locked in partition id order
 
   Partition(const Partition&);
   void operator=(const Partition&);
@@ -15,12 +15,15 @@
 
 #include <glog/logging.h>
 #include <sys/resource.h>
+#include <unistd.h>
 #include <google/protobuf/text_format.h>
 #include <map>
 #include <random>
+#include <thread>
 #include <utility>
 #include <fstream>
 
+#include "rocksdb/env.h"
 #include "rocksdb/table.h"
 #include "slash/include/rsync.h"
 
@@ -29,10 +32,14 @@
 
 ZPDataServer::ZPDataServer()
   : table_count_(0),
+  tables_version_(0),
+  binlog_sender_count_(0),
   should_exit_(false),
   meta_port_(0),
   meta_epoch_(-1),
-  should_pull_meta_(false) {
+  should_pull_meta_(false),
+  bgsyncbatch_next_(0),
+  timer_wheel_(kNodeCronInterval) {
     pthread_rwlock_init(&meta_state_rw_, NULL);
     pthread_rwlockattr_t attr;
     pthread_rwlockattr_init(&attr);
@@ -60,12 +67,12 @@ ZPDataServer::ZPDataServer()
     // Binlog receive
     for (int j = 0; j < g_zp_conf->sync_recv_thread_num(); j++) {
       zp_binlog_receive_bgworkers_.push_back(
-          new ZPBinlogReceiveBgWorker(kBinlogReceiveBgWorkerFull));
+          new ZPBinlogReceiveBgWorker(kBinlogReceiveBgWorkerFull, j));
     }
     sync_factory_ = new ZPSyncConnFactory();
     sync_handle_ = new ZPSyncConnHandle();
     zp_binlog_receiver_thread_ = pink::NewHolyThread(
-        g_zp_conf->local_port() + kPortShiftSync,
+        g_zp_conf->sync_listen_port(),
         sync_factory_,
         kBinlogReceiverCronInterval,
         sync_handle_);
@@ -79,21 +86,15 @@ ZPDataServer::ZPDataServer()
       ZPBinlogSendThread *thread = new ZPBinlogSendThread(&binlog_send_pool_);
       binlog_send_workers_.push_back(thread);
     }
+    binlog_sender_count_ = binlog_send_workers_.size();
 
     // Client command
     client_factory_ = new ZPDataClientConnFactory();
     client_handle_ = new ZPDataClientConnHandle();
-    zp_dispatch_thread_ = pink::NewDispatchThread(
-        g_zp_conf->local_port(),
-        g_zp_conf->data_thread_num(),
-        client_factory_,
-        kDispatchCronInterval,
-        kDispatchQueueSize,
-        client_handle_);
-
-    // KeepAlive in seconds
-    zp_dispatch_thread_->set_keepalive_timeout(kKeepAlive);
-    zp_dispatch_thread_->set_thread_name("ZPDataDispatch");
+    zp_dispatch_thread_ = NULL;
+    if (g_zp_conf->client_loop_num() == 0) {
+      NewDispatchThread();
+    }
 
     // Ping
     zp_ping_thread_ = new ZPPingThread();
@@ -111,8 +112,13 @@ ZPDataServer::~ZPDataServer() {
   delete zp_ping_thread_;
 
   // We call StopThread first
-  zp_dispatch_thread_->StopThread();
-  delete zp_dispatch_thread_;
+  if (zp_dispatch_thread_ != NULL) {
+    zp_dispatch_thread_->StopThread();
+    delete zp_dispatch_thread_;
+  }
+  for (auto loop : client_loops_) {
+    delete loop;
+  }
   delete client_factory_;
   delete client_handle_;
   LOG(INFO) << "Dispatch thread exit!";
@@ -148,6 +154,10 @@ ZPDataServer::~ZPDataServer() {
   LOG(INFO) << " All Tables exit!!!";
   bgsave_thread_.StopThread();
   bgpurge_thread_.StopThread();
+  bgbackup_thread_.StopThread();
+  for (int i = 0; i < kSyncBatchWorkers; i++) {
+    bgsyncbatch_threads_[i].StopThread();
+  }
 
   DestoryCmdTable(cmds_);
   pthread_rwlock_destroy(&meta_state_rw_);
@@ -191,10 +201,224 @@ void ZPDataServer::InitDBOptions() {
     = g_zp_conf->max_background_compactions();
 
   db_options_.create_if_missing = true;
+
+  // Create them before any db opened
+  if (!g_zp_conf->db_cpus().empty()) {
+    SetDBThreads(db_options_.max_background_compactions,
+        db_options_.max_background_flushes);
+  }
+}
+
+// Rocksdb background threads inherit affinity of their creator,
+// so create them in a pinned thread
+void ZPDataServer::SetDBThreads(int compactions, int flushes) {
+  std::vector<int> db_cpus = g_zp_conf->db_cpus();
+  if (db_cpus.empty()) {
+    // Not inherit the affinity of caller
+    for (long i = 0; i < sysconf(_SC_NPROCESSORS_ONLN); i++) {
+      db_cpus.push_back(i);
+    }
+  }
+  rocksdb::Env* env = db_options_.env;
+  std::thread creator([env, &db_cpus, compactions, flushes]() {
+    PinThread(pthread_self(), db_cpus);
+    env->SetBackgroundThreads(compactions, rocksdb::Env::Priority::LOW);
+    env->SetBackgroundThreads(flushes, rocksdb::Env::Priority::HIGH);
+  });
+  creator.join();
+}
+
+void ZPDataServer::GetDBOptions(rocksdb::Options* options) {
+  slash::MutexLock l(&db_options_mu_);
+  *options = db_options_;
+}
+
+void ZPDataServer::GetWriteStallTriggers(WriteStallTriggers* triggers) {
+  slash::MutexLock l(&db_options_mu_);
+  triggers->level0_slowdown_writes_trigger =
+    db_options_.level0_slowdown_writes_trigger;
+  triggers->level0_stop_writes_trigger =
+    db_options_.level0_stop_writes_trigger;
+  triggers->soft_pending_compaction_bytes_limit =
+    db_options_.soft_pending_compaction_bytes_limit;
+  triggers->hard_pending_compaction_bytes_limit =
+    db_options_.hard_pending_compaction_bytes_limit;
+  triggers->write_buffer_manager = db_options_.write_buffer_manager;
+}
+
+// Change options of all opened dbs, db_wide for DBOptions
+Status ZPDataServer::SetDBOptions(
+    const std::unordered_map<std::string, std::string>& options,
+    bool db_wide) {
+  Status result;
+  slash::RWLock l(&table_rw_, false);
+  for (auto& item : tables_) {
+    Status s = item.second->SetDBOptions(options, db_wide);
+    if (!s.ok()) {
+      result = s;
+    }
+  }
+  return result;
+}
+
+Status ZPDataServer::StartBinlogSender(ZPBinlogSendThread* thread,
+    int index) {
+  LOG(INFO) << "Start one binlog send worker thread";
+  if (pink::RetCode::kSuccess != thread->StartThread()) {
+    LOG(FATAL) << "Binlog send worker start failed";
+    return Status::Corruption("Binlog send worker start failed!");
+  }
+  PinThread(thread->thread_id(), g_zp_conf->sync_send_cpus(), index);
+  return Status::OK();
+}
+
+// Task of a stopped sender is put back to the pool,
+// and will be picked up by the remaining ones
+void ZPDataServer::ResizeBinlogSenders(int num) {
+  slash::MutexLock l(&binlog_send_workers_mu_);
+  while (static_cast<int>(binlog_send_workers_.size()) < num) {
+    ZPBinlogSendThread *thread = new ZPBinlogSendThread(&binlog_send_pool_);
+    if (!StartBinlogSender(thread, binlog_send_workers_.size()).ok()) {
+      delete thread;
+      break;
+    }
+    binlog_send_workers_.push_back(thread);
+  }
+  while (static_cast<int>(binlog_send_workers_.size()) > num) {
+    delete binlog_send_workers_.back();
+    binlog_send_workers_.pop_back();
+  }
+  binlog_sender_count_ = binlog_send_workers_.size();
+  LOG(INFO) << "Binlog sender count changed to " << binlog_sender_count_;
+}
+
+Status ZPDataServer::ConfigSet(const std::string& name,
+    const std::string& value) {
+  slash::MutexLock l(&config_mu_);
+  std::string old_value;
+  if (!g_zp_conf->ConfigGet(name, &old_value)
+      || !g_zp_conf->ConfigSet(name, value)) {
+    return Status::InvalidArgument("invalid config item or value");
+  }
+
+  Status s = ApplyConfig(name);
+  if (!s.ok()) {
+    LOG(WARNING) << "Config set " << name << " failed on some partition: "
+      << s.ToString() << ", roll back to " << old_value;
+    // Partitions already changed need the old value too
+    g_zp_conf->ConfigSet(name, old_value);
+    Status rs = ApplyConfig(name);
+    if (!rs.ok()) {
+      LOG(ERROR) << "Config roll back " << name << " failed: "
+        << rs.ToString();
+    }
+    return s;
+  }
+
+  if (!g_zp_conf->Rewrite()) {
+    LOG(WARNING) << "Rewrite conf failed after config set " << name;
+    return Status::IOError("rewrite conf failed");
+  }
+  return Status::OK();
+}
+
+// Apply current value of the item in g_zp_conf
+Status ZPDataServer::ApplyConfig(const std::string& name) {
+  Status s;
+  if (name == "sync_send_thread_num") {
+    ResizeBinlogSenders(g_zp_conf->sync_send_thread_num());
+  } else if (name == "max_background_compactions"
+      || name == "max_background_flushes") {
+    int compactions = g_zp_conf->max_background_compactions();
+    int flushes = g_zp_conf->max_background_flushes();
+    {
+      slash::MutexLock l(&db_options_mu_);
+      db_options_.max_background_compactions = compactions;
+      db_options_.max_background_flushes = flushes;
+    }
+    // Thread pools are shared by all dbs
+    SetDBThreads(compactions, flushes);
+    s = SetDBOptions({{"max_background_compactions",
+          std::to_string(compactions)}}, true);
+  } else if (name == "db_write_buffer_size") {
+    uint64_t size = static_cast<uint64_t>(
+        g_zp_conf->db_write_buffer_size()) * 1024;
+    {
+      slash::MutexLock l(&db_options_mu_);
+      db_options_.write_buffer_size = size;
+      db_options_.max_bytes_for_level_base = 2 * size;
+    }
+    s = SetDBOptions({{"write_buffer_size", std::to_string(size)},
+        {"max_bytes_for_level_base", std::to_string(2 * size)}}, false);
+  } else if (name == "db_target_file_size_base") {
+    uint64_t size = static_cast<uint64_t>(
+        g_zp_conf->db_target_file_size_base()) * 1024;
+    {
+      slash::MutexLock l(&db_options_mu_);
+      db_options_.target_file_size_base = size;
+    }
+    s = SetDBOptions({{"target_file_size_base", std::to_string(size)}},
+        false);
+  }
+  // Others are read from g_zp_conf when used
+  return s;
+}
+
+void ZPDataServer::NewDispatchThread() {
+  zp_dispatch_thread_ = pink::NewDispatchThread(
+      g_zp_conf->local_port(),
+      g_zp_conf->data_thread_num(),
+      client_factory_,
+      kDispatchCronInterval,
+      kDispatchQueueSize,
+      client_handle_);
+
+  // KeepAlive in seconds
+  zp_dispatch_thread_->set_keepalive_timeout(kKeepAlive);
+  zp_dispatch_thread_->set_thread_name("ZPDataDispatch");
+}
+
+Status ZPDataServer::StartClientLoops() {
+  Status s;
+  for (int i = 0; i < g_zp_conf->client_loop_num(); i++) {
+    // Only the first loop do the cron
+    ZPClientLoopThread* loop = new ZPClientLoopThread(g_zp_conf->local_port(),
+        client_factory_, i == 0 ? client_handle_ : NULL);
+    client_loops_.push_back(loop);
+    s = loop->Listen();
+    if (!s.ok()) {
+      break;
+    }
+  }
+  for (size_t i = 0; s.ok() && i < client_loops_.size(); i++) {
+    if (pink::RetCode::kSuccess != client_loops_[i]->StartThread()) {
+      s = Status::Corruption("Client loop start failed");
+    }
+  }
+  if (!s.ok()) {
+    for (auto loop : client_loops_) {
+      delete loop;
+    }
+    client_loops_.clear();
+  }
+  return s;
 }
 
 Status ZPDataServer::Start() {
-  if (pink::RetCode::kSuccess != zp_dispatch_thread_->StartThread()) {
+  if (g_zp_conf->client_loop_num() > 0) {
+    Status s = StartClientLoops();
+    if (s.ok()) {
+      LOG(INFO) << client_loops_.size() << " client loops started";
+    } else {
+      // Maybe SO_REUSEPORT is not supported
+      LOG(WARNING) << "Client loops start failed, " << s.ToString()
+        << ", fall back to dispatch thread";
+      NewDispatchThread();
+    }
+  }
+
+  if (zp_dispatch_thread_ != NULL
+      && pink::RetCode::kSuccess != zp_dispatch_thread_->StartThread()) {
     LOG(FATAL) << "Dispatch thread start failed";
     return Status::Corruption("Dispatch thread start failed!");
   }
@@ -212,29 +436,51 @@ Status ZPDataServer::Start() {
   }
   LOG(INFO) << "Ping thread started";
 
-  std::vector<ZPBinlogSendThread*>::iterator bsit
-    = binlog_send_workers_.begin();
-  for (; bsit != binlog_send_workers_.end(); ++bsit) {
-    LOG(INFO) << "Start one binlog send worker thread";
-    if (pink::RetCode::kSuccess != (*bsit)->StartThread()) {
-      LOG(FATAL) << "Binlog send worker start failed";
-      return Status::Corruption("Binlog send worker start failed!");
+  {
+    slash::MutexLock l(&binlog_send_workers_mu_);
+    for (size_t i = 0; i < binlog_send_workers_.size(); i++) {
+      Status s = StartBinlogSender(binlog_send_workers_[i], i);
+      if (!s.ok()) {
+        return s;
+      }
     }
   }
   LOG(INFO) << "Binlog sender thread started";
 
-  auto iter = g_zp_conf->meta_addr().begin();
-  while (iter != g_zp_conf->meta_addr().end()) {
-    LOG(INFO) << "Meta seed is: " << *iter;
-    iter++;
+  // Start background threads early to pin them
+  std::vector<int> bg_cpus = g_zp_conf->bg_cpus();
+  if (!bg_cpus.empty()) {
+    {
+      slash::MutexLock l(&bgsave_thread_protector_);
+      bgsave_thread_.StartThread();
+      PinThread(bgsave_thread_.thread_id(), bg_cpus);
+    }
+    {
+      slash::MutexLock l(&bgpurge_thread_protector_);
+      bgpurge_thread_.StartThread();
+      PinThread(bgpurge_thread_.thread_id(), bg_cpus);
+    }
+    {
+      slash::MutexLock l(&bgbackup_thread_protector_);
+      bgbackup_thread_.StartThread();
+      PinThread(bgbackup_thread_.thread_id(), bg_cpus);
+    }
+    {
+      slash::MutexLock l(&bgsyncbatch_threads_protector_);
+      for (int i = 0; i < kSyncBatchWorkers; i++) {
+        bgsyncbatch_threads_[i].StartThread();
+        PinThread(bgsyncbatch_threads_[i].thread_id(), bg_cpus);
+      }
+    }
+  }
+
+  for (auto& addr : g_zp_conf->meta_addr()) {
+    LOG(INFO) << "Meta seed is: " << addr;
   }
 
   while (!should_exit_) {
-    DoTimingTask();
-    int sleep_count = kNodeCronWaitCount;
-    while (!should_exit_ && sleep_count-- > 0) {
-      usleep(kNodeCronInterval * 1000);
-    }
+    timer_wheel_.Tick();
+    usleep(kNodeCronInterval * 1000);
   }
   return Status::OK();
 }
@@ -260,8 +506,9 @@ void ZPDataServer::FinishPullMeta(int64_t epoch) {
 
 void ZPDataServer::NextMeta(std::string* ip, long* port) {
   // New meta_index_ may not exactly increased by one since thread contention
-  meta_index_ = (meta_index_ + 1) % g_zp_conf->meta_addr().size();
-  auto addr = g_zp_conf->meta_addr()[meta_index_];
+  const std::vector<std::string>& addrs = g_zp_conf->meta_addr();
+  meta_index_ = (meta_index_ + 1) % addrs.size();
+  auto addr = addrs[meta_index_];
   auto pos = addr.find(":");
   if (pos != std::string::npos) {
     *ip = addr.substr(0, pos);
@@ -300,6 +547,7 @@ std::shared_ptr<Table> ZPDataServer::GetOrAddTable(const std::string &tname) {
   std::shared_ptr<Table> table = NewTable(tname,
       g_zp_conf->log_path(), g_zp_conf->data_path(), g_zp_conf->trash_path());
   tables_[tname] = table;
+  tables_version_++;
   return table;
 }
 
@@ -308,8 +556,9 @@ void ZPDataServer::DeleteTable(const std::string &table_name) {
   auto it = tables_.find(table_name);
   if (it != tables_.end()) {
     it->second->LeaveAllPartition();
+    tables_.erase(it);
+    tables_version_++;
   }
-  tables_.erase(table_name);
 }
 
 // Required: hold table_rw_
@@ -343,6 +592,11 @@ void ZPDataServer::DumpTableBinlogOffsets(const std::string &table_name,
   }
 }
 
+std::shared_ptr<Table> ZPDataServer::FindTable(const std::string &table_name) {
+  slash::RWLock l(&table_rw_, false);
+  return GetTable(table_name);
+}
+
 std::shared_ptr<Partition> ZPDataServer::GetTablePartition(
     const std::string &table_name, const std::string &key) {
   slash::RWLock l(&table_rw_, false);
@@ -376,6 +630,21 @@ void ZPDataServer::BGPurgeTaskSchedule(void (*function)(void*), void* arg) {
   bgpurge_thread_.Schedule(function, arg);
 }
 
+void ZPDataServer::BGBackupTaskSchedule(void (*function)(void*), void* arg) {
+  slash::MutexLock l(&bgbackup_thread_protector_);
+  bgbackup_thread_.StartThread();
+  bgbackup_thread_.Schedule(function, arg);
+}
+
+void ZPDataServer::BGSyncBatchTaskSchedule(void (*function)(void*),
+    void* arg) {
+  slash::MutexLock l(&bgsyncbatch_threads_protector_);
+  pink::BGThread& thread = bgsyncbatch_threads_[bgsyncbatch_next_];
+  bgsyncbatch_next_ = (bgsyncbatch_next_ + 1) % kSyncBatchWorkers;
+  thread.StartThread();
+  thread.Schedule(function, arg);
+}
+
 // Add Task, remove first if already exist
 // Return Status::InvalidArgument means the filenum and offset is Invalid
 Status ZPDataServer::AddBinlogSendTask(const std::string &table,
@@ -400,6 +669,13 @@ int32_t ZPDataServer::GetBinlogSendFilenum(const std::string &table,
   return binlog_send_pool_.TaskFilenum(task_name);
 }
 
+Status ZPDataServer::PauseBinlogSendTask(const std::string &table,
+    int partition_id, const Node& node, int pause_ms) {
+  std::string task_name = ZPBinlogSendTaskName(table, partition_id, node);
+  return binlog_send_pool_.PauseTask(task_name,
+      slash::NowMicros() + static_cast<uint64_t>(pause_ms) * 1000);
+}
+
 void ZPDataServer::DumpBinlogSendTask() {
   LOG(INFO) << "BinlogSendTask==========================";
   binlog_send_pool_.Dump();
@@ -411,6 +687,12 @@ void ZPDataServer::AddSyncTask(const std::string& table,
   zp_trysync_thread_->TrySyncTaskSchedule(table, partition_id, delay);
 }
 
+void ZPDataServer::AddSyncPauseTask(const std::string& table,
+    int partition_id, const Node& master, int pause_ms) {
+  zp_trysync_thread_->SyncPauseTaskSchedule(table, partition_id,
+      master, pause_ms);
+}
+
 void ZPDataServer::AddMetacmdTask() {
   zp_metacmd_bgworker_->AddTask();
 }
@@ -603,6 +885,16 @@ bool ZPDataServer::GetTableReplInfo(const std::string& table_name,
   return true;
 }
 
+bool ZPDataServer::BackupTable(const std::string& table_name,
+    client::CmdResponse_Backup* backup) {
+  slash::RWLock l(&table_rw_, false);
+  auto it = tables_.find(table_name);
+  if (it == tables_.end()) {
+    return false;
+  }
+  return it->second->Backup(backup);
+}
+
 bool ZPDataServer::GetServerInfo(client::CmdResponse_InfoServer* info_server) {
   info_server->set_epoch(meta_epoch());
   std::set<std::string> table_names;
@@ -618,6 +910,9 @@ bool ZPDataServer::GetServerInfo(client::CmdResponse_InfoServer* info_server) {
   }
 
   info_server->set_meta_renewing(ShouldPullMeta());
+  for (auto loop : client_loops_) {
+    info_server->add_client_loop_conns(loop->conn_num());
+  }
   return true;
 }
 
@@ -678,12 +973,34 @@ void ZPDataServer::InitClientCmdTable() {
       kCmdFlagsAdmin | kCmdFlagsWrite | kCmdFlagsSuspend);
   cmds_.insert(std::pair<int, Cmd*>(
         static_cast<int>(client::Type::FLUSHDB), flushdbptr));
-}
-
-void ZPDataServer::DoTimingTask() {
-  slash::RWLock l(&table_rw_, false);
-  for (auto& pair : tables_) {
-    pair.second->DoTimingTask();
-  }
+  // IngestCmd
+  Cmd* ingestptr = new IngestCmd(
+      kCmdFlagsAdmin | kCmdFlagsWrite | kCmdFlagsSuspend);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::INGEST), ingestptr));
+  // BackupCmd
+  Cmd* backupptr = new BackupCmd(
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::BACKUP), backupptr));
+  // SubscribeCmd
+  Cmd* subscribeptr = new SubscribeCmd(kCmdFlagsAdmin | kCmdFlagsRead);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::SUBSCRIBE), subscribeptr));
+  // SyncBatchCmd
+  Cmd* syncbatchptr = new SyncBatchCmd(
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::SYNCBATCH), syncbatchptr));
+  // SyncPauseCmd
+  Cmd* syncpauseptr = new SyncPauseCmd(
+      kCmdFlagsAdmin | kCmdFlagsRead | kCmdFlagsMultiPartition);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::SYNCPAUSE), syncpauseptr));
+  // Write since it may change config
+  Cmd* configptr = new ConfigCmd(
+      kCmdFlagsAdmin | kCmdFlagsWrite | kCmdFlagsMultiPartition);
+  cmds_.insert(std::pair<int, Cmd*>(
+        static_cast<int>(client::Type::CONFIG), configptr));
 }
 
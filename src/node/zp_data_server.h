@@ -40,6 +40,8 @@
 #include "src/node/zp_trysync_thread.h"
 #include "src/node/zp_binlog_sender.h"
 #include "src/node/zp_binlog_receive_bgworker.h"
+#include "src/node/zp_client_loop_thread.h"
+#include "src/node/zp_timer_wheel.h"
 #include "src/node/zp_data_table.h"
 #include "src/node/zp_data_partition.h"
 
@@ -72,7 +74,7 @@ class ZPDataServer  {
     slash::RWLock l(&meta_state_rw_, false);
     return meta_port_;
   }
-  std::string local_ip() {
+  const std::string& local_ip() {
     return g_zp_conf->local_ip();
   }
   int local_port() {
@@ -93,12 +95,24 @@ class ZPDataServer  {
     return g_zp_conf->data_path() + "/dump/";
   }
 
-  const rocksdb::Options* db_options() const {
-    return &db_options_;
+  std::string backup_stage_path() {
+    return g_zp_conf->data_path() + "/backup_stage/";
   }
 
+  // Options to open db with, which may be changed by ConfigSet
+  void GetDBOptions(rocksdb::Options* options);
+  // Part of db options checked by Partition::CheckWriteStall
+  struct WriteStallTriggers {
+    int level0_slowdown_writes_trigger;
+    int level0_stop_writes_trigger;
+    uint64_t soft_pending_compaction_bytes_limit;
+    uint64_t hard_pending_compaction_bytes_limit;
+    std::shared_ptr<rocksdb::WriteBufferManager> write_buffer_manager;
+  };
+  void GetWriteStallTriggers(WriteStallTriggers* triggers);
+
   size_t binlog_sender_count() {
-    return binlog_send_workers_.size();
+    return binlog_sender_count_;
   }
 
   void Exit() {
@@ -130,6 +144,11 @@ class ZPDataServer  {
   std::shared_ptr<Table> GetOrAddTable(const std::string &table_name);
   void DeleteTable(const std::string &table_name);
 
+  // Table handle for lock free routing, valid until tables_version changed
+  std::shared_ptr<Table> FindTable(const std::string &table_name);
+  uint64_t tables_version() const {
+    return tables_version_.load(std::memory_order_acquire);
+  }
   std::shared_ptr<Partition> GetTablePartition(
       const std::string &table_name, const std::string &key);
   std::shared_ptr<Partition> GetTablePartitionById(
@@ -143,6 +162,12 @@ class ZPDataServer  {
   // Backgroud thread
   void BGSaveTaskSchedule(void (*function)(void*), void* arg);
   void BGPurgeTaskSchedule(void (*function)(void*), void* arg);
+  void BGBackupTaskSchedule(void (*function)(void*), void* arg);
+  void BGSyncBatchTaskSchedule(void (*function)(void*), void* arg);
+  // Timing task run by server thread
+  void ScheduleTimer(int64_t delay_ms, const ZPTimerWheel::Task& task) {
+    timer_wheel_.Schedule(delay_ms, task);
+  }
   void AddSyncTask(const std::string& table, int partition_id,
       uint64_t delay = 0);
   void AddMetacmdTask();
@@ -153,6 +178,10 @@ class ZPDataServer  {
       const Node& node);
   int32_t GetBinlogSendFilenum(const std::string &table, int partition_id,
       const Node& node);
+  Status PauseBinlogSendTask(const std::string &table, int partition_id,
+      const Node& node, int pause_ms);
+  void AddSyncPauseTask(const std::string& table, int partition_id,
+      const Node& master, int pause_ms);
   void DispatchBinlogBGWorker(ZPBinlogReceiveTask *task);
 
   // Command related
@@ -178,6 +207,12 @@ class ZPDataServer  {
   bool GetTableReplInfo(const std::string& table_name,
       std::unordered_map<std::string, client::CmdResponse_InfoRepl>* repls);
   bool GetServerInfo(client::CmdResponse_InfoServer* info_server);
+  bool BackupTable(const std::string& table_name,
+      client::CmdResponse_Backup* backup);
+
+  // Apply config to running threads and dbs, then persist it,
+  // the old value is restored if failed to apply
+  Status ConfigSet(const std::string& name, const std::string& value);
 
  private:
   slash::Mutex server_mutex_;
@@ -188,12 +223,17 @@ class ZPDataServer  {
   // rather than certain partiton which should keep thread safety itself
   pthread_rwlock_t table_rw_;
   std::atomic<int> table_count_;
+  std::atomic<uint64_t> tables_version_;  // Inc when table added or deleted
   std::unordered_map<std::string, std::shared_ptr<Table>> tables_;
   std::shared_ptr<Table> GetTable(const std::string &table_name);
 
   // Binlog Send related
   ZPBinlogSendTaskPool binlog_send_pool_;
+  slash::Mutex binlog_send_workers_mu_;
   std::vector<ZPBinlogSendThread*> binlog_send_workers_;
+  std::atomic<int> binlog_sender_count_;
+  Status StartBinlogSender(ZPBinlogSendThread* thread, int index);
+  void ResizeBinlogSenders(int num);
 
   // Server related
   ZPMetacmdBGWorker* zp_metacmd_bgworker_;
@@ -206,7 +246,10 @@ class ZPDataServer  {
 
   pink::ConnFactory* client_factory_;
   pink::ServerHandle* client_handle_;
-  pink::ServerThread* zp_dispatch_thread_;
+  pink::ServerThread* zp_dispatch_thread_;  // NULL if client loops in use
+  std::vector<ZPClientLoopThread*> client_loops_;
+  void NewDispatchThread();
+  Status StartClientLoops();
   ZPPingThread* zp_ping_thread_;
 
   std::atomic<bool> should_exit_;
@@ -229,7 +272,15 @@ class ZPDataServer  {
   pink::BGThread bgsave_thread_;
   slash::Mutex bgpurge_thread_protector_;
   pink::BGThread bgpurge_thread_;
-  void DoTimingTask();
+  slash::Mutex bgbackup_thread_protector_;
+  pink::BGThread bgbackup_thread_;
+  // Workers handle the entries of SYNCBATCH requests
+  slash::Mutex bgsyncbatch_threads_protector_;
+  pink::BGThread bgsyncbatch_threads_[kSyncBatchWorkers];
+  int bgsyncbatch_next_;
+
+  // Partitions schedule their own timing tasks
+  ZPTimerWheel timer_wheel_;
 
   // Statistic related
   struct ThreadStatistic {
@@ -247,8 +298,17 @@ class ZPDataServer  {
   bool GetStat(const StatType type, const std::string &table,
       Statistic* stat);
 
+  slash::Mutex db_options_mu_;
   rocksdb::Options db_options_;
   void InitDBOptions();
+  void SetDBThreads(int compactions, int flushes);
+  Status SetDBOptions(
+      const std::unordered_map<std::string, std::string>& options,
+      bool db_wide);
+
+  // Serialize ConfigSet
+  slash::Mutex config_mu_;
+  Status ApplyConfig(const std::string& name);
 };
 
 #endif  // SRC_NODE_ZP_DATA_SERVER_H_
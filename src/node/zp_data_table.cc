@@ -13,8 +13,10 @@
 // limitations under the License.
 #include "src/node/zp_data_table.h"
 
+#include <string.h>
 #include <sys/statvfs.h>
 #include <glog/logging.h>
+#include <vector>
 #include <utility>
 
 #include "src/node/zp_data_server.h"
@@ -39,7 +41,8 @@ Table::Table(const std::string& table_name, const std::string &log_path,
   log_path_(log_path),
   data_path_(data_path),
   trash_path_(trash_path),
-  partition_cnt_(0) {
+  partition_cnt_(0),
+  route_(NULL) {
   if (log_path_.back() != '/') {
     log_path_.push_back('/');
   }
@@ -70,30 +73,67 @@ Table::~Table() {
 }
 
 bool Table::SetPartitionCount(const int count) {
-  partition_cnt_ = count;
+  slash::RWLock l(&partition_rw_, true);
+  if (partition_cnt_ != count || route_.load() == NULL) {
+    partition_cnt_ = count;
+    PublishRoute();
+  }
   DLOG(INFO) << " Set Table: " << table_name_
     << " with " << partition_cnt_ << " partitions.";
   return true;
 }
 
+void Table::PublishRoute() {
+  int count = partition_cnt_ > 0 ? partition_cnt_.load() : 0;
+  std::unique_ptr<PartitionRoute> route(new PartitionRoute(count));
+  for (int i = 0; i < count; i++) {
+    auto iter = partitions_.find(i);
+    (*route)[i].store(iter != partitions_.end() ? iter->second.get() : NULL,
+        std::memory_order_relaxed);
+  }
+  route_.store(route.get(), std::memory_order_release);
+  routes_.push_back(std::move(route));
+}
+
+// key := hash_tag or kLBrace + hash_tag + kRBrace + ...
+// Only the key begin is compared for kLBrace, and kRBrace is
+// searched by memmem, no copy of key unless hash tag found
+static int HashPartition(const std::string& key, int count) {
+  if (key.compare(0, kLBrace.size(), kLBrace) == 0) {
+    const char* tag = key.data() + kLBrace.size();
+    const char* r_brace = static_cast<const char*>(memmem(tag,
+          key.size() - kLBrace.size(), kRBrace.data(), kRBrace.size()));
+    if (r_brace != NULL) {
+      return std::hash<std::string>()(std::string(tag, r_brace)) % count;
+    }
+  }
+  return std::hash<std::string>()(key) % count;
+}
+
 int Table::KeyToPartitionId(const std::string& key) {
-  if (partition_cnt_ <= 0) {
+  int count = partition_cnt_;
+  if (count <= 0) {
     return -1;
   }
-  // key := hash_tag
-  std::string hash_tag(key);
+  return HashPartition(key, count);
+}
 
-  size_t l_brace = key.find(kLBrace);
-  if (l_brace == 0) {
-    // key := kLBrace + hash_tag + kRBrace + ...
-    size_t r_brace = key.find(kRBrace, l_brace + kLBrace.size());
-    if (r_brace != std::string::npos) {
-      hash_tag.assign(key.begin() + kLBrace.size(), key.begin() + r_brace);
-    }
+Partition* Table::RoutePartition(const std::string& key) const {
+  const PartitionRoute* route = route_.load(std::memory_order_acquire);
+  if (route == NULL || route->empty()) {
+    return NULL;
   }
+  return (*route)[HashPartition(key, route->size())].load(
+      std::memory_order_acquire);
+}
 
-  int partition_id = std::hash<std::string>()(hash_tag) % partition_cnt_;
-  return partition_id;
+Partition* Table::RoutePartitionById(int partition_id) const {
+  const PartitionRoute* route = route_.load(std::memory_order_acquire);
+  if (route == NULL || partition_id < 0
+      || static_cast<size_t>(partition_id) >= route->size()) {
+    return NULL;
+  }
+  return (*route)[partition_id].load(std::memory_order_acquire);
 }
 
 std::shared_ptr<Partition> Table::GetPartition(const std::string &key) {
@@ -134,6 +174,11 @@ bool Table::UpdateOrAddPartition(const int partition_id,
 
   partition->Update(ZPMeta::PState::ACTIVE, master, slaves);
   partitions_[partition_id] = partition;
+  PartitionRoute* route = route_.load(std::memory_order_relaxed);
+  if (route != NULL && partition_id >= 0
+      && static_cast<size_t>(partition_id) < route->size()) {
+    (*route)[partition_id].store(partition.get(), std::memory_order_release);
+  }
 
   return true;
 }
@@ -163,11 +208,19 @@ void Table::Dump() {
   LOG(INFO) << "--------------------------";
 }
 
-void Table::DoTimingTask() {
+// Return the last failure
+Status Table::SetDBOptions(
+    const std::unordered_map<std::string, std::string>& options,
+    bool db_wide) {
+  Status result;
   slash::RWLock l(&partition_rw_, false);
-  for (auto pair : partitions_) {
-    pair.second->DoTimingTask();
+  for (auto& pair : partitions_) {
+    Status s = pair.second->SetDBOptions(options, db_wide);
+    if (!s.ok()) {
+      result = s;
+    }
   }
+  return result;
 }
 
 void Table::DumpPartitionBinlogOffsets(std::map<int, BinlogOffset> *offset) {
@@ -213,3 +266,44 @@ void Table::GetReplInfo(client::CmdResponse_InfoRepl* repl_info) {
   }
 }
 
+// Backup all local master partitions at the same binlog moment
+bool Table::Backup(client::CmdResponse_Backup* backup) {
+  char s_time[32];
+  time_t now = time(NULL);
+  int len = strftime(s_time, sizeof(s_time), "%Y%m%d%H%M%S", localtime(&now));
+  std::string name(s_time, len);
+
+  std::vector<std::shared_ptr<Partition>> targets;
+  {
+    slash::RWLock l(&partition_rw_, false);
+    for (auto& pair : partitions_) {
+      targets.push_back(pair.second);
+    }
+  }
+
+  // Suspend in partition id order, and resume only after all suspended
+  std::vector<std::pair<std::shared_ptr<Partition>, BackupInfo>> begun;
+  for (auto& p : targets) {
+    BackupInfo info;
+    if (p->BackupBegin(name, &info)) {
+      begun.push_back(std::make_pair(p, info));
+    }
+  }
+  if (begun.empty()) {
+    return false;
+  }
+
+  backup->set_name(name);
+  for (auto& item : begun) {
+    if (!item.first->BackupEnd(&item.second)) {
+      continue;
+    }
+    client::SyncOffset* offset = backup->add_offsets();
+    offset->set_partition(item.first->partition_id());
+    offset->set_filenum(item.second.filenum);
+    offset->set_offset(item.second.offset);
+  }
+  LOG(INFO) << "Backup " << name << " of table " << table_name_ << " begin"
+    << ", partition count: " << backup->offsets_size();
+  return true;
+}
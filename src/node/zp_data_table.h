@@ -19,12 +19,15 @@
 #include <atomic>
 #include <memory>
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 #include "include/zp_util.h"
 #include "include/zp_const.h"
 #include "src/meta/zp_meta.pb.h"
 #include "src/node/client.pb.h"
 #include "src/node/zp_data_entity.h"
+#include "src/node/zp_qos.h"
 
 class Table;
 class Partition;
@@ -53,11 +56,23 @@ class Table  {
 
   int KeyToPartitionId(const std::string &key);
 
+  // Lock free routing for client requests, NULL if not found.
+  // Partitions are never removed from the table, so the pointer
+  // keeps valid as long as the table is referenced
+  Partition* RoutePartition(const std::string& key) const;
+  Partition* RoutePartitionById(int partition_id) const;
+
   void Dump();
-  void DoTimingTask();
   void DumpPartitionBinlogOffsets(std::map<int, BinlogOffset> *offset);
   void GetCapacity(Statistic *stat);
   void GetReplInfo(client::CmdResponse_InfoRepl* repl_info);
+  bool Backup(client::CmdResponse_Backup* backup);
+  slash::Status SetDBOptions(
+      const std::unordered_map<std::string, std::string>& options,
+      bool db_wide);
+  QosLimiter* qos() {
+    return &qos_;
+  }
 
  private:
   std::string table_name_;
@@ -69,6 +84,16 @@ class Table  {
   pthread_rwlock_t partition_rw_;
   std::map<int, std::shared_ptr<Partition>> partitions_;
 
+  // Partition of every id in [0, partition_cnt_), slots are filled
+  // as partitions added, and a new route is published only when
+  // partition count changed. Old ones are kept for readers
+  typedef std::vector<std::atomic<Partition*>> PartitionRoute;
+  std::atomic<PartitionRoute*> route_;
+  std::vector<std::unique_ptr<PartitionRoute>> routes_;
+  void PublishRoute();  // Required: hold partition_rw_ write
+
+  QosLimiter qos_;
+
   Table(const Table&);
   void operator=(const Table&);
 };
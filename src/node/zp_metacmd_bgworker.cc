@@ -133,6 +133,7 @@ Status ZPMetacmdBGWorker::ParsePullResponse(
     std::shared_ptr<Table> table
       = zp_data_server->GetOrAddTable(table_info.name());
     assert(table != NULL);
+    table->qos()->SetQos(table_info.qos());
 
     int j = 0;
     for (; j < table_info.partitions_size(); j++) {
@@ -190,13 +191,15 @@ Status ZPMetacmdBGWorker::ParsePullResponse(
       metas.insert(maddr);
       mstr += maddr + " ";
     }
-    LOG(INFO) << mstr;
-    g_zp_conf->SetMetaAddr(metas);
-    if (!g_zp_conf->Rewrite()) {
-      LOG(WARNING) << "Rewrite conf after meta membership changed failed"; 
-      return Status::Corruption("Rewrite conf failed");
+    // Meta members come with every pull, rewrite only on change
+    if (g_zp_conf->SetMetaAddr(metas)) {
+      LOG(INFO) << mstr;
+      if (!g_zp_conf->Rewrite()) {
+        LOG(WARNING) << "Rewrite conf after meta membership changed failed"; 
+        return Status::Corruption("Rewrite conf failed");
+      }
+      LOG(INFO) << "Rewrite conf after meta membership changed succ";
     }
-    LOG(INFO) << "Rewrite conf after meta membership changed succ";
   }
   return Status::OK();
 }
@@ -0,0 +1,172 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_qos.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "slash/include/env.h"
+
+#include "include/zp_const.h"
+
+void TokenBucket::SetRate(int64_t rate) {
+  if (rate_ == 0 && rate > 0) {
+    // Start full
+    tokens_ = rate;
+    last_us_ = slash::NowMicros();
+  }
+  rate_ = rate;
+  tokens_ = std::min(tokens_, static_cast<double>(rate_));
+}
+
+uint64_t TokenBucket::Wait(uint64_t now) {
+  if (rate_ <= 0) {
+    return 0;
+  }
+  if (now > last_us_) {
+    tokens_ = std::min(static_cast<double>(rate_),
+        tokens_ + (now - last_us_) * rate_ / 1000000.0);
+    last_us_ = now;
+  }
+  if (tokens_ > 0) {
+    return 0;
+  }
+  // Time to refill at least one token
+  return static_cast<uint64_t>((1 - tokens_) * 1000000 / rate_);
+}
+
+void QosBuckets::SetRate(int64_t rops, int64_t wops,
+    int64_t rbytes, int64_t wbytes) {
+  read_ops.SetRate(rops);
+  write_ops.SetRate(wops);
+  read_bytes.SetRate(rbytes);
+  write_bytes.SetRate(wbytes);
+}
+
+uint64_t QosBuckets::Wait(bool is_write, uint64_t now) {
+  last_active = now;
+  if (is_write) {
+    return std::max(write_ops.Wait(now), write_bytes.Wait(now));
+  }
+  return std::max(read_ops.Wait(now), read_bytes.Wait(now));
+}
+
+void QosBuckets::Charge(bool is_write, int64_t bytes) {
+  if (is_write) {
+    write_bytes.Charge(bytes);
+  } else {
+    read_bytes.Charge(bytes);
+  }
+}
+
+void QosLimiter::SetQos(const ZPMeta::Qos& qos) {
+  slash::MutexLock l(&mu_);
+  if (qos_.SerializeAsString() == qos.SerializeAsString()) {
+    return;
+  }
+  qos_.CopyFrom(qos);
+  enable_ = qos.read_qps() > 0 || qos.write_qps() > 0
+    || qos.read_bytes() > 0 || qos.write_bytes() > 0
+    || qos.client_read_qps() > 0 || qos.client_write_qps() > 0
+    || qos.client_read_bytes() > 0 || qos.client_write_bytes() > 0;
+  table_.SetRate(qos.read_qps(), qos.write_qps(),
+      qos.read_bytes(), qos.write_bytes());
+  for (auto& kv : clients_) {
+    kv.second.SetRate(qos.client_read_qps(), qos.client_write_qps(),
+        qos.client_read_bytes(), qos.client_write_bytes());
+  }
+}
+
+// Required: hold mu_
+QosBuckets* QosLimiter::ClientBuckets(const std::string& ip, uint64_t now) {
+  auto iter = clients_.find(ip);
+  if (iter != clients_.end()) {
+    return &(iter->second);
+  }
+
+  if (clients_.size() >= static_cast<size_t>(kQosMaxClients)) {
+    // Clean idle clients
+    for (auto it = clients_.begin(); it != clients_.end();) {
+      if (now - it->second.last_active > kQosClientExpire * 1000000LL) {
+        it = clients_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  if (clients_.size() >= static_cast<size_t>(kQosMaxClients)) {
+    // Still full of active clients, evict the oldest in batch,
+    // so as not to scan on every new client
+    std::vector<std::pair<uint64_t, std::string>> actives;
+    actives.reserve(clients_.size());
+    for (auto& kv : clients_) {
+      actives.push_back(std::make_pair(kv.second.last_active, kv.first));
+    }
+    size_t evict = clients_.size() - kQosMaxClients * kQosKeepPercent / 100;
+    std::nth_element(actives.begin(), actives.begin() + evict - 1,
+        actives.end());
+    for (size_t i = 0; i < evict; i++) {
+      clients_.erase(actives[i].second);
+    }
+  }
+  QosBuckets* buckets = &clients_[ip];
+  buckets->SetRate(qos_.client_read_qps(), qos_.client_write_qps(),
+      qos_.client_read_bytes(), qos_.client_write_bytes());
+  return buckets;
+}
+
+uint64_t QosLimiter::Admit(const std::string& ip, bool is_write,
+    int64_t bytes) {
+  if (!enable()) {
+    return 0;
+  }
+  slash::MutexLock l(&mu_);
+  if (!enable_) {
+    return 0;
+  }
+  uint64_t now = slash::NowMicros();
+  QosBuckets* client = ClientBuckets(ip, now);
+  uint64_t wait = std::max(table_.Wait(is_write, now),
+      client->Wait(is_write, now));
+  if (wait > 0) {
+    return wait;
+  }
+
+  if (is_write) {
+    table_.write_ops.Charge(1);
+    client->write_ops.Charge(1);
+  } else {
+    table_.read_ops.Charge(1);
+    client->read_ops.Charge(1);
+  }
+  table_.Charge(is_write, bytes);
+  client->Charge(is_write, bytes);
+  return 0;
+}
+
+void QosLimiter::Charge(const std::string& ip, bool is_write,
+    int64_t bytes) {
+  if (!enable()) {
+    return;
+  }
+  slash::MutexLock l(&mu_);
+  if (!enable_) {
+    return;
+  }
+  table_.Charge(is_write, bytes);
+  auto iter = clients_.find(ip);
+  if (iter != clients_.end()) {
+    iter->second.Charge(is_write, bytes);
+  }
+}
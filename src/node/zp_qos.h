@@ -0,0 +1,85 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_QOS_H_
+#define SRC_NODE_ZP_QOS_H_
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+#include "slash/include/slash_mutex.h"
+#include "src/meta/zp_meta.pb.h"
+
+// Refill rate tokens per second, burst up to one second of rate.
+// Tokens may go negative, since some cost is only known after execution
+class TokenBucket {
+ public:
+  TokenBucket()
+    : rate_(0), tokens_(0), last_us_(0) {}
+  void SetRate(int64_t rate);  // 0 for unlimited
+  // Micro seconds to wait before admitted, 0 for now
+  uint64_t Wait(uint64_t now);
+  void Charge(int64_t n) {
+    if (rate_ > 0) {
+      tokens_ -= n;
+    }
+  }
+
+ private:
+  int64_t rate_;
+  double tokens_;
+  uint64_t last_us_;
+};
+
+struct QosBuckets {
+  TokenBucket read_ops;
+  TokenBucket write_ops;
+  TokenBucket read_bytes;
+  TokenBucket write_bytes;
+  uint64_t last_active;
+
+  QosBuckets()
+    : last_active(0) {}
+  void SetRate(int64_t rops, int64_t wops, int64_t rbytes, int64_t wbytes);
+  uint64_t Wait(bool is_write, uint64_t now);
+  void Charge(bool is_write, int64_t bytes);
+};
+
+// Admission control of one table, by table and by client ip
+class QosLimiter {
+ public:
+  QosLimiter()
+    : enable_(false) {}
+  void SetQos(const ZPMeta::Qos& qos);
+  // Lock free, so that tables without qos cost nothing
+  bool enable() const {
+    return enable_.load(std::memory_order_relaxed);
+  }
+
+  // Return micro seconds to retry after if rejected, 0 if admitted,
+  // bytes is the request size
+  uint64_t Admit(const std::string& ip, bool is_write, int64_t bytes);
+  // Charge bytes known after execution, such as read result
+  void Charge(const std::string& ip, bool is_write, int64_t bytes);
+
+ private:
+  slash::Mutex mu_;
+  std::atomic<bool> enable_;
+  ZPMeta::Qos qos_;
+  QosBuckets table_;
+  std::unordered_map<std::string, QosBuckets> clients_;
+
+  QosBuckets* ClientBuckets(const std::string& ip, uint64_t now);
+};
+
+#endif  // SRC_NODE_ZP_QOS_H_
@@ -21,6 +21,12 @@ extern ZPDataServer* zp_data_server;
 ZPSyncConn::ZPSyncConn(int fd, std::string ip_port,
     pink::ServerThread* server_thread) :
   PbConn(fd, ip_port, server_thread) {
+  // Sync receiver thread share cpus with receive bgworkers
+  static thread_local bool pinned = false;
+  if (!pinned) {
+    pinned = true;
+    PinThread(pthread_self(), g_zp_conf->sync_recv_cpus());
+  }
 }
 
 ZPSyncConn::~ZPSyncConn() {
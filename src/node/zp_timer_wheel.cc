@@ -0,0 +1,114 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/node/zp_timer_wheel.h"
+
+#include <time.h>
+#include <utility>
+
+static uint64_t MonotonicMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+ZPTimerWheel::ZPTimerWheel(int64_t tick_ms, const Clock& clock)
+  : tick_ms_(tick_ms > 0 ? tick_ms : 1),
+  clock_(clock ? clock : Clock(MonotonicMs)),
+  begin_ms_(clock_()),
+  current_(0),
+  size_(0) {
+  }
+
+uint64_t ZPTimerWheel::NowTick() const {
+  uint64_t now_ms = clock_();
+  // Never wrap around even if the clock goes back
+  if (now_ms < begin_ms_) {
+    return 0;
+  }
+  return (now_ms - begin_ms_) / tick_ms_;
+}
+
+void ZPTimerWheel::Schedule(int64_t delay_ms, const Task& task) {
+  Timer timer;
+  timer.task = task;
+  slash::MutexLock l(&mu_);
+  // Round up, and never before next tick
+  uint64_t delay = delay_ms > 0 ? (delay_ms + tick_ms_ - 1) / tick_ms_ : 1;
+  timer.expire = current_ + delay;
+  Insert(&timer);
+  size_++;
+}
+
+void ZPTimerWheel::Insert(Timer* timer) {
+  uint64_t max_delay = (1ULL << (kLevels * kSlotBits)) - 1;
+  if (timer->expire <= current_) {
+    timer->expire = current_ + 1;
+  } else if (timer->expire - current_ > max_delay) {
+    timer->expire = current_ + max_delay;
+  }
+
+  uint64_t delay = timer->expire - current_;
+  int level = 0;
+  while (level < kLevels - 1
+      && delay >= (1ULL << ((level + 1) * kSlotBits))) {
+    level++;
+  }
+  uint64_t slot = (timer->expire >> (level * kSlotBits)) & kSlotMask;
+  slots_[level][slot].push_back(std::move(*timer));
+}
+
+// Move the current slot of level down to lower levels
+void ZPTimerWheel::Cascade(int level) {
+  uint64_t slot = (current_ >> (level * kSlotBits)) & kSlotMask;
+  std::vector<Timer> timers;
+  timers.swap(slots_[level][slot]);
+  for (auto& timer : timers) {
+    Insert(&timer);
+  }
+}
+
+void ZPTimerWheel::Tick() {
+  uint64_t now = NowTick();
+  std::vector<Timer> due;
+  while (true) {
+    {
+      slash::MutexLock l(&mu_);
+      if (current_ >= now) {
+        break;
+      }
+      current_++;
+      // Higher level first, so its timers could fall into lower ones
+      for (int level = kLevels - 1; level > 0; level--) {
+        if ((current_ & ((1ULL << (level * kSlotBits)) - 1)) == 0) {
+          Cascade(level);
+        }
+      }
+      due.swap(slots_[0][current_ & kSlotMask]);
+      size_ -= due.size();
+    }
+
+    for (auto& timer : due) {
+      int64_t next = timer.task();
+      if (next >= 0) {
+        Schedule(next, timer.task);
+      }
+    }
+    due.clear();
+  }
+}
+
+size_t ZPTimerWheel::size() {
+  slash::MutexLock l(&mu_);
+  return size_;
+}
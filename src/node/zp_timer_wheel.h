@@ -0,0 +1,74 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SRC_NODE_ZP_TIMER_WHEEL_H_
+#define SRC_NODE_ZP_TIMER_WHEEL_H_
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include "slash/include/slash_mutex.h"
+
+/**
+ * ZPTimerWheel
+ * Hierarchical timer wheel, schedule is O(1),
+ * every tick only touches the tasks due in it.
+ * Tasks are run by the thread calling Tick, outside of the lock,
+ * so that they could schedule new tasks
+ */
+class ZPTimerWheel {
+ public:
+  // Return delay of next run in milli seconds, negative to stop
+  typedef std::function<int64_t()> Task;
+  // Return current milli seconds, never go back
+  typedef std::function<uint64_t()> Clock;
+
+  // Default clock is CLOCK_MONOTONIC, not affected by wall clock change
+  explicit ZPTimerWheel(int64_t tick_ms, const Clock& clock = Clock());
+
+  void Schedule(int64_t delay_ms, const Task& task);
+
+  // Run all tasks due till now
+  void Tick();
+
+  size_t size();
+
+ private:
+  static const int kLevels = 3;
+  static const int kSlotBits = 6;
+  static const uint64_t kSlots = 1 << kSlotBits;
+  static const uint64_t kSlotMask = kSlots - 1;
+
+  struct Timer {
+    uint64_t expire;  // in ticks
+    Task task;
+  };
+
+  slash::Mutex mu_;
+  int64_t tick_ms_;
+  Clock clock_;
+  uint64_t begin_ms_;
+  uint64_t current_;  // ticks since begin_ms_
+  size_t size_;
+  std::vector<Timer> slots_[kLevels][kSlots];
+
+  uint64_t NowTick() const;
+  void Insert(Timer* timer);  // Required: hold mu_
+  void Cascade(int level);  // Required: hold mu_
+
+  // No copying allowed
+  ZPTimerWheel(const ZPTimerWheel&);
+  void operator=(const ZPTimerWheel&);
+};
+
+#endif  // SRC_NODE_ZP_TIMER_WHEEL_H_
@@ -14,6 +14,8 @@
 #include "src/node/zp_trysync_thread.h"
 
 #include <glog/logging.h>
+#include <algorithm>
+#include <random>
 #include "slash/include/rsync.h"
 #include "src/node/zp_data_server.h"
 #include "src/node/zp_data_partition.h"
@@ -26,9 +28,13 @@ static std::string TablePartitionString(const std::string& table, int id) {
   return std::string(buf);
 }
 
-ZPTrySyncThread::ZPTrySyncThread() {
+ZPTrySyncThread::ZPTrySyncThread()
+  : next_seq_(0),
+  batch_scheduled_(false) {
     bg_thread_ = new pink::BGThread(1024 * 1024 * 256);
     bg_thread_->set_thread_name("ZPDataTrySync");
+    std::random_device rd;
+    rand_.seed(rd());
 }
 
 ZPTrySyncThread::~ZPTrySyncThread() {
@@ -42,11 +48,29 @@ ZPTrySyncThread::~ZPTrySyncThread() {
   LOG(INFO) << " TrySync thread " << pthread_self() << " exit!!!";
 }
 
+// Schedule without delay wake the partition up, retry from the
+// shortest backoff, e.g. when master changed
 void ZPTrySyncThread::TrySyncTaskSchedule(const std::string& table,
     int partition_id, uint64_t delay) {
+  if (delay == 0) {
+    slash::MutexLock l(&retry_mu_);
+    retry_states_[TablePartitionString(table, partition_id)].attempts = 0;
+  }
+  Schedule(table, partition_id, delay);
+}
+
+void ZPTrySyncThread::Schedule(const std::string& table,
+    int partition_id, uint64_t delay) {
+  TrySyncTaskArg *targ = new TrySyncTaskArg(this, table, partition_id);
+  {
+    // Only the latest scheduled task of a partition is valid
+    slash::MutexLock l(&retry_mu_);
+    targ->seq = ++next_seq_;
+    retry_states_[TablePartitionString(table, partition_id)].seq = targ->seq;
+  }
+
   slash::MutexLock l(&bg_thread_protector_);
   bg_thread_->StartThread();
-  TrySyncTaskArg *targ = new TrySyncTaskArg(this, table, partition_id);
   if (delay == 0) {  // no delay
     bg_thread_->Schedule(&DoTrySyncTask, static_cast<void*>(targ));
   } else {
@@ -56,30 +80,164 @@ void ZPTrySyncThread::TrySyncTaskSchedule(const std::string& table,
 
 void ZPTrySyncThread::DoTrySyncTask(void* arg) {
   TrySyncTaskArg* targ = static_cast<TrySyncTaskArg*>(arg);
-  (targ->thread)->TrySyncTask(targ->table_name, targ->partition_id);
+  if ((targ->thread)->IsLatestTask(targ->table_name, targ->partition_id,
+        targ->seq)) {
+    (targ->thread)->TrySyncTask(targ->table_name, targ->partition_id);
+  }
   delete targ;
 }
 
+void ZPTrySyncThread::SyncPauseTaskSchedule(const std::string& table,
+    int partition_id, const Node& master, int pause_ms) {
+  SyncPauseTaskArg *parg = new SyncPauseTaskArg(this, table, partition_id,
+      master, pause_ms);
+  slash::MutexLock l(&bg_thread_protector_);
+  bg_thread_->StartThread();
+  bg_thread_->Schedule(&DoSyncPauseTask, static_cast<void*>(parg));
+}
+
+void ZPTrySyncThread::DoSyncPauseTask(void* arg) {
+  SyncPauseTaskArg* parg = static_cast<SyncPauseTaskArg*>(arg);
+  (parg->thread)->SendSyncPause(*parg);
+  delete parg;
+}
+
+// Best effort, master keeps sending if failed
+void ZPTrySyncThread::SendSyncPause(const SyncPauseTaskArg& arg) {
+  pink::PinkCli* cli = GetConnection(arg.master);
+  if (cli == NULL) {
+    return;
+  }
+  // The connection is shared with trysync, which may have changed them
+  cli->set_send_timeout(1000);
+  cli->set_recv_timeout(1000);
+
+  client::CmdRequest request;
+  request.set_type(client::Type::SYNCPAUSE);
+  client::CmdRequest_SyncPause* pause = request.mutable_sync_pause();
+  pause->mutable_node()->set_ip(zp_data_server->local_ip());
+  pause->mutable_node()->set_port(zp_data_server->local_port());
+  pause->set_table_name(arg.table_name);
+  pause->set_partition_id(arg.partition_id);
+  pause->set_pause_ms(arg.pause_ms);
+
+  client::CmdResponse response;
+  Status s = cli->Send(&request);
+  if (s.ok()) {
+    s = cli->Recv(&response);
+  }
+  if (!s.ok()) {
+    LOG(WARNING) << "SyncPause failed, Partition: " << arg.table_name
+      << "_" << arg.partition_id << ", master: " << arg.master
+      << ", caz " << s.ToString();
+    DropConnection(arg.master);
+  } else if (response.code() != client::StatusCode::kOk) {
+    LOG(WARNING) << "SyncPause refused, Partition: " << arg.table_name
+      << "_" << arg.partition_id << ", master: " << arg.master
+      << ", msg: " << response.msg();
+  }
+}
+
+bool ZPTrySyncThread::IsLatestTask(const std::string& table_name,
+    int partition_id, uint64_t seq) {
+  slash::MutexLock l(&retry_mu_);
+  auto iter = retry_states_.find(
+      TablePartitionString(table_name, partition_id));
+  return iter != retry_states_.end() && iter->second.seq == seq;
+}
+
 void ZPTrySyncThread::TrySyncTask(const std::string& table_name,
     int partition_id) {
+  if (!zp_data_server->Availible()) {  // server is not availible now
+    TrySyncLater(table_name, partition_id);
+    return;
+  }
+
+  // Collect tasks queued before the batch runs, so that
+  // partitions with same master share one request
+  pending_.insert(std::make_pair(table_name, partition_id));
+  if (!batch_scheduled_) {
+    batch_scheduled_ = true;
+    slash::MutexLock l(&bg_thread_protector_);
+    bg_thread_->Schedule(&DoTrySyncBatch, static_cast<void*>(this));
+  }
+}
+
+void ZPTrySyncThread::DoTrySyncBatch(void* arg) {
+  static_cast<ZPTrySyncThread*>(arg)->TrySyncBatch();
+}
+
+void ZPTrySyncThread::TrySyncBatch() {
+  batch_scheduled_ = false;
+  std::map<Node, std::vector<std::shared_ptr<Partition> > > masters;
+  for (auto& item : pending_) {
+    std::shared_ptr<Partition> partition;
+    if (!PrepareTrySync(item.first, item.second, &partition)) {
+      TrySyncLater(item.first, item.second, true);
+    } else if (partition) {
+      masters[partition->master_node()].push_back(partition);
+    }
+  }
+  pending_.clear();
+
+  for (auto& kv : masters) {
+    std::vector<std::shared_ptr<Partition> >& all = kv.second;
+    for (size_t i = 0; i < all.size(); i += kTrySyncBatchSize) {
+      size_t end = std::min(all.size(), i + kTrySyncBatchSize);
+      SendTrySyncBatch(kv.first,
+          std::vector<std::shared_ptr<Partition> >(
+            all.begin() + i, all.begin() + end));
+    }
+  }
+}
 
-  if (!zp_data_server->Availible()  // server is not availible now
-      || !SendTrySync(table_name, partition_id)) {
-    // Need one more trysync, since error happenning or waiting for db sync
-    LOG(WARNING) << "SendTrySync delay " << kTrySyncInterval
+void ZPTrySyncThread::TrySyncLater(const std::string& table_name,
+    int partition_id, bool wait_dbsync) {
+  // Need one more trysync, since error happenning or waiting for db sync
+  uint64_t delay = kDBSyncPollInterval;
+  int polls = 0;
+  {
+    slash::MutexLock l(&retry_mu_);
+    RetryState& state = retry_states_[
+      TablePartitionString(table_name, partition_id)];
+    if (wait_dbsync) {
+      polls = state.polls++;
+    } else {
+      delay = RetryDelay(state.attempts++);
+    }
+  }
+  if (!wait_dbsync) {
+    LOG(WARNING) << "SendTrySync delay " << delay
       << "(ms) to ReSchedule for table:" << table_name
       << ", partition:" << partition_id
       << ",  meta_epoch:" << zp_data_server->meta_epoch();
-    zp_data_server->AddSyncTask(table_name, partition_id, kTrySyncInterval);
+  } else if (polls % kDBSyncPollLogCount == 0) {
+    LOG(INFO) << "Partition: " << table_name << "_" << partition_id
+      << " still wait for dbsync after " << polls << " polls"
+      << ",  meta_epoch:" << zp_data_server->meta_epoch();
   }
+  Schedule(table_name, partition_id, delay);
 }
 
-bool ZPTrySyncThread::Send(std::shared_ptr<Partition> partition,
-    pink::PinkCli* cli) {
-  // Generate Request
-  client::CmdRequest request;
-  client::CmdRequest_Sync* sync = request.mutable_sync();
-  request.set_type(client::Type::SYNC);
+// Required: hold retry_mu_
+// Exponential backoff from kTrySyncMinInterval to kTrySyncInterval,
+// jitter spread the retries of partitions failed together
+uint64_t ZPTrySyncThread::RetryDelay(int attempts) {
+  uint64_t base = kTrySyncMinInterval;
+  for (int i = 0; i < attempts && base < kTrySyncInterval; i++) {
+    base *= 2;
+  }
+  base = std::min(base, static_cast<uint64_t>(kTrySyncInterval));
+  return base / 2 + rand_() % (base / 2 + 1);
+}
+
+void ZPTrySyncThread::RetryDone(const std::string& index) {
+  slash::MutexLock l(&retry_mu_);
+  retry_states_.erase(index);
+}
+
+void ZPTrySyncThread::FillSync(std::shared_ptr<Partition> partition,
+    client::CmdRequest_Sync* sync) {
   client::Node* node = sync->mutable_node();
   node->set_ip(zp_data_server->local_ip());
   node->set_port(zp_data_server->local_port());
@@ -94,13 +252,22 @@ bool ZPTrySyncThread::Send(std::shared_ptr<Partition> partition,
   int64_t epoch = zp_data_server->meta_epoch();  // just use current epoch
   sync->set_epoch(epoch);
 
-  // Send through client
-  slash::Status s = cli->Send(&request);
   LOG(INFO) << "TrySync: Partition " << partition->table_name() << "_"
     << partition->partition_id() << " with SyncPoint ("
     << sync->node().ip() << ":" << sync->node().port()
     << ", " << boffset.filenum << ", " << boffset.offset << ")"
     << ", epoch: " << epoch;
+}
+
+bool ZPTrySyncThread::Send(std::shared_ptr<Partition> partition,
+    pink::PinkCli* cli) {
+  // Generate Request
+  client::CmdRequest request;
+  request.set_type(client::Type::SYNC);
+  FillSync(partition, request.mutable_sync());
+
+  // Send through client
+  slash::Status s = cli->Send(&request);
   if (!s.ok()) {
     LOG(WARNING) << "TrySync send failed, Partition "
       << partition->table_name()
@@ -171,10 +338,11 @@ void ZPTrySyncThread::DropConnection(const Node& node) {
 }
 
 /*
- * Return false if one more trysync is needed
+ * Return false if one more trysync is needed,
+ * set ptr if the partition should send trysync to its master
  */
-bool ZPTrySyncThread::SendTrySync(const std::string& table_name,
-    int partition_id) {
+bool ZPTrySyncThread::PrepareTrySync(const std::string& table_name,
+    int partition_id, std::shared_ptr<Partition>* ptr) {
   std::string index = TablePartitionString(table_name, partition_id);
   std::shared_ptr<Partition> partition =
     zp_data_server->GetTablePartitionById(table_name, partition_id);
@@ -184,18 +352,21 @@ bool ZPTrySyncThread::SendTrySync(const std::string& table_name,
     LOG(INFO) << "SendTrySync closed or deleted Partition "
       << table_name << "_" << partition_id;
     RsyncUnref(index);
+    RetryDone(index);
     return true;
   }
 
   if (partition->ShouldWaitDBSync()) {
-    LOG(INFO) << " Partition: " << partition->table_name()
-      << "_" << partition->partition_id() << " ShouldWaitDBSync.";
-    
+    // Polled every kDBSyncPollInterval, TrySyncLater logs the waiting
     if (!partition->TryUpdateMasterOffset()) {
       return false;
     }
     partition->WaitDBSyncDone();
     RsyncUnref(index);
+    {
+      slash::MutexLock l(&retry_mu_);
+      retry_states_[index].polls = 0;
+    }
     LOG(INFO) << "Success Update Master Offset for Partition "
       << partition->table_name() << "_" << partition->partition_id();
   }
@@ -203,77 +374,181 @@ bool ZPTrySyncThread::SendTrySync(const std::string& table_name,
   if (!partition->ShouldTrySync()) {
     // Return true so that the trysync will not be reschedule
     RsyncUnref(index);
+    RetryDone(index);
     return true;
   }
 
-  Node master_node = partition->master_node();
+  *ptr = partition;
+  return true;
+}
+
+void ZPTrySyncThread::SendTrySyncBatch(const Node& master_node,
+    const std::vector<std::shared_ptr<Partition> >& partitions) {
   pink::PinkCli* cli = GetConnection(master_node);
-  LOG(INFO) << "TrySync connect(" << partition->table_name() << "_"
-    << partition->partition_id() << "_" << master_node.ip << ":"
-    << master_node.port << ") " << (cli != NULL ? "ok" : "failed");
-  if (cli) {
-    cli->set_send_timeout(1000);
-    cli->set_recv_timeout(1000);
+  LOG(INFO) << "TrySync connect(" << master_node.ip << ":"
+    << master_node.port << ") for " << partitions.size() << " partitions "
+    << (cli != NULL ? "ok" : "failed");
+  if (!cli) {
+    for (auto& partition : partitions) {
+      TrySyncLater(partition->table_name(), partition->partition_id());
+    }
+    return;
+  }
 
+  client::CmdRequest request;
+  request.set_type(client::Type::SYNCBATCH);
+  for (auto& partition : partitions) {
     slash::CreatePath(partition->sync_path());
-    RsyncRef(index);
-    // Send && Recv
-    if (Send(partition, cli)) {
-      Status s;
-      RecvResult res;
-      if (Recv(partition, cli, &res)) {
-        switch (res.code) {
-          case client::StatusCode::kOk:
-            LOG(INFO) << "TrySync ok, Partition: "
-              << partition->table_name() << "_" << partition->partition_id();
-            partition->TrySyncDone();
-            RsyncUnref(index);
-            return true;
-          case client::StatusCode::kFallback:
-            LOG(WARNING) << "Receive sync offset fallback to : "
-              << res.filenum << "_" << res.offset << ", Partition: "
-              << partition->table_name() << "_" << partition->partition_id()
-              << ", back from: " << master_node.ip << ":" << master_node.port;
-            s = partition->SetBinlogOffsetWithLock(BinlogOffset(res.filenum,
-                  res.offset));
-            if (!s.ok()) {
-              LOG(WARNING) << "Set sync offset fallback to : "
-                << res.filenum << "_" << res.offset << ", Partition: "
-                << partition->table_name() << "_" << partition->partition_id()
-                << ", Faliled: " << s.ToString();
-            }
-            break;
-          case client::StatusCode::kWait:
-            LOG(INFO) << "Receive wait dbsync wait, Partition: "
-              << partition->table_name() << "_" << partition->partition_id()
-              << ", back from: " << master_node.ip << ":" << master_node.port;
-            partition->SetWaitDBSync();
-            return false;  // Keep the rsync deamon for sync file receive
-            break;
-          default:
-            LOG(WARNING) << "TrySyncThread failed, "
-              << partition->table_name() << "_" << partition->partition_id()
-              << "_" << master_node.ip << ":" << master_node.port << "), Msg: "
-              << res.message;
-        }
-      } else {
-        LOG(WARNING) << "TrySyncThread Recv failed, "
-          << partition->table_name() << "_" << partition->partition_id()
-          << "_" << master_node.ip << ":" << master_node.port << ")";
-        DropConnection(master_node);
+    RsyncRef(TablePartitionString(partition->table_name(),
+          partition->partition_id()));
+    FillSync(partition, request.add_sync_batch());
+  }
+
+  // Send && Recv
+  cli->set_send_timeout(1000);
+  cli->set_recv_timeout(kTrySyncBatchTimeout);
+  client::CmdResponse response;
+  Status s = cli->Send(&request);
+  if (s.ok()) {
+    s = cli->Recv(&response);
+  }
+  // An old master could not parse SYNCBATCH, since type is a required
+  // enum, it replies kError with the type it parsed instead
+  bool unsupported = s.ok()
+    && response.code() == client::StatusCode::kError;
+  if (s.ok() && !unsupported
+      && response.type() != client::Type::SYNCBATCH) {
+    s = Status::Corruption("error type response");
+  }
+  if (!s.ok()) {
+    LOG(WARNING) << "TrySyncThread batch failed, " << master_node.ip << ":"
+      << master_node.port << ", caz " << s.ToString();
+    DropConnection(master_node);
+  } else if (unsupported) {
+    // Master not support SYNCBATCH, trysync one by one
+    LOG(WARNING) << "TrySyncThread batch not supported by "
+      << master_node.ip << ":" << master_node.port << ", Msg: "
+      << response.msg();
+    // The master may close connection after reply an error
+    DropConnection(master_node);
+    for (auto& partition : partitions) {
+      if (!SendTrySync(partition, master_node)) {
+        TrySyncLater(partition->table_name(), partition->partition_id(),
+            partition->ShouldWaitDBSync());
       }
-    } else {
-      LOG(WARNING) << "TrySyncThread Send failed, "
-        << partition->table_name() << "_" << partition->partition_id()
-        << "_" << master_node.ip << ":" << master_node.port << ")";
-      DropConnection(master_node);
     }
-    RsyncUnref(index);
-  } else {
+    return;
+  }
+
+  std::map<std::pair<std::string, int>, RecvResult> results;
+  if (s.ok() && response.code() == client::StatusCode::kOk) {
+    for (auto& item : response.sync_batch()) {
+      RecvResult& res = results[std::make_pair(item.sync().table_name(),
+          item.sync().sync_offset().partition())];
+      res.code = item.code();
+      res.message = item.msg();
+      res.filenum = item.sync().sync_offset().filenum();
+      res.offset = item.sync().sync_offset().offset();
+    }
+  }
+  for (auto& partition : partitions) {
+    auto iter = results.find(std::make_pair(partition->table_name(),
+          partition->partition_id()));
+    if (iter == results.end()) {
+      RsyncUnref(TablePartitionString(partition->table_name(),
+            partition->partition_id()));
+      TrySyncLater(partition->table_name(), partition->partition_id());
+    } else if (!HandleSyncResult(partition, master_node, iter->second)) {
+      TrySyncLater(partition->table_name(), partition->partition_id(),
+          partition->ShouldWaitDBSync());
+    }
+  }
+}
+
+/*
+ * Return false if one more trysync is needed
+ */
+bool ZPTrySyncThread::SendTrySync(std::shared_ptr<Partition> partition,
+    const Node& master_node) {
+  std::string index = TablePartitionString(partition->table_name(),
+      partition->partition_id());
+  pink::PinkCli* cli = GetConnection(master_node);
+  if (!cli) {
     LOG(WARNING) << "TrySyncThread Connect failed ("
       << partition->table_name() << "_" << partition->partition_id()
       << "_" << master_node.ip << ":" << master_node.port << ")";
+    RsyncUnref(index);
+    return false;
+  }
+  cli->set_send_timeout(1000);
+  cli->set_recv_timeout(1000);
+
+  slash::CreatePath(partition->sync_path());
+  RsyncRef(index);
+  // Send && Recv
+  RecvResult res;
+  if (!Send(partition, cli)) {
+    LOG(WARNING) << "TrySyncThread Send failed, "
+      << partition->table_name() << "_" << partition->partition_id()
+      << "_" << master_node.ip << ":" << master_node.port << ")";
+    DropConnection(master_node);
+    RsyncUnref(index);
+    return false;
+  }
+  if (!Recv(partition, cli, &res)) {
+    LOG(WARNING) << "TrySyncThread Recv failed, "
+      << partition->table_name() << "_" << partition->partition_id()
+      << "_" << master_node.ip << ":" << master_node.port << ")";
+    DropConnection(master_node);
+    RsyncUnref(index);
+    return false;
+  }
+  return HandleSyncResult(partition, master_node, res);
+}
+
+/*
+ * Return false if one more trysync is needed
+ */
+bool ZPTrySyncThread::HandleSyncResult(std::shared_ptr<Partition> partition,
+    const Node& master_node, const RecvResult& res) {
+  std::string index = TablePartitionString(partition->table_name(),
+      partition->partition_id());
+  Status s;
+  switch (res.code) {
+    case client::StatusCode::kOk:
+      LOG(INFO) << "TrySync ok, Partition: "
+        << partition->table_name() << "_" << partition->partition_id();
+      partition->TrySyncDone();
+      RsyncUnref(index);
+      RetryDone(index);
+      return true;
+    case client::StatusCode::kFallback:
+      LOG(WARNING) << "Receive sync offset fallback to : "
+        << res.filenum << "_" << res.offset << ", Partition: "
+        << partition->table_name() << "_" << partition->partition_id()
+        << ", back from: " << master_node.ip << ":" << master_node.port;
+      s = partition->SetBinlogOffsetWithLock(BinlogOffset(res.filenum,
+            res.offset));
+      if (!s.ok()) {
+        LOG(WARNING) << "Set sync offset fallback to : "
+          << res.filenum << "_" << res.offset << ", Partition: "
+          << partition->table_name() << "_" << partition->partition_id()
+          << ", Faliled: " << s.ToString();
+      }
+      break;
+    case client::StatusCode::kWait:
+      LOG(INFO) << "Receive wait dbsync wait, Partition: "
+        << partition->table_name() << "_" << partition->partition_id()
+        << ", back from: " << master_node.ip << ":" << master_node.port;
+      partition->SetWaitDBSync();
+      return false;  // Keep the rsync deamon for sync file receive
+    default:
+      LOG(WARNING) << "TrySyncThread failed, "
+        << partition->table_name() << "_" << partition->partition_id()
+        << "_" << master_node.ip << ":" << master_node.port << "), Msg: "
+        << res.message;
   }
+  RsyncUnref(index);
   return false;
 }
 
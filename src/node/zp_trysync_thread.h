@@ -14,8 +14,12 @@
 #ifndef SRC_NODE_ZP_TRYSYNC_THREAD_H_
 #define SRC_NODE_ZP_TRYSYNC_THREAD_H_
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <memory>
+#include <random>
+#include <unordered_map>
 #include <unordered_set>
 #include "slash/include/slash_status.h"
 #include "slash/include/slash_mutex.h"
@@ -32,6 +36,8 @@ class ZPTrySyncThread  {
   void TrySyncTaskSchedule(const std::string& table,
       int partition_id, uint64_t delay = 0);
   void TrySyncTask(const std::string& table_name, int partition_id);
+  void SyncPauseTaskSchedule(const std::string& table, int partition_id,
+      const Node& master, int pause_ms);
 
  private:
   // BGThread related
@@ -39,13 +45,62 @@ class ZPTrySyncThread  {
     ZPTrySyncThread* thread;
     std::string table_name;
     int partition_id;
+    uint64_t seq;
     TrySyncTaskArg(ZPTrySyncThread* t, const std::string& table, int id)
-        : thread(t), table_name(table), partition_id(id){}
+        : thread(t), table_name(table), partition_id(id), seq(0){}
   };
   slash::Mutex bg_thread_protector_;
   pink::BGThread* bg_thread_;
   static void DoTrySyncTask(void* arg);
-  bool SendTrySync(const std::string& table_name, int partition_id);
+
+  // Ask master to pause binlog sending when db is about to stall
+  struct SyncPauseTaskArg {
+    ZPTrySyncThread* thread;
+    std::string table_name;
+    int partition_id;
+    Node master;
+    int pause_ms;
+    SyncPauseTaskArg(ZPTrySyncThread* t, const std::string& table, int id,
+        const Node& m, int ms)
+        : thread(t), table_name(table), partition_id(id), master(m),
+        pause_ms(ms) {}
+  };
+  static void DoSyncPauseTask(void* arg);
+  void SendSyncPause(const SyncPauseTaskArg& arg);
+  void Schedule(const std::string& table, int partition_id, uint64_t delay);
+
+  // Retry related, backoff state of partitions waiting for trysync
+  struct RetryState {
+    uint64_t seq;  // seq of the latest scheduled task
+    int attempts;
+    int polls;  // of dbsync done, only log some of them
+    RetryState() : seq(0), attempts(0), polls(0) {}
+  };
+  slash::Mutex retry_mu_;
+  std::unordered_map<std::string, RetryState> retry_states_;
+  uint64_t next_seq_;
+  std::mt19937 rand_;
+  bool IsLatestTask(const std::string& table_name, int partition_id,
+      uint64_t seq);
+  uint64_t RetryDelay(int attempts);
+  void RetryDone(const std::string& index);
+  static void DoTrySyncBatch(void* arg);
+
+  // Partitions waiting for trysync, sent in batch per master,
+  // only accessed in bg thread
+  std::set<std::pair<std::string, int> > pending_;
+  bool batch_scheduled_;
+  void TrySyncBatch();
+  void TrySyncLater(const std::string& table_name, int partition_id,
+      bool wait_dbsync = false);
+  bool PrepareTrySync(const std::string& table_name, int partition_id,
+      std::shared_ptr<Partition>* ptr);
+  void SendTrySyncBatch(const Node& master_node,
+      const std::vector<std::shared_ptr<Partition> >& partitions);
+  bool SendTrySync(std::shared_ptr<Partition> partition,
+      const Node& master_node);
+  void FillSync(std::shared_ptr<Partition> partition,
+      client::CmdRequest_Sync* sync);
   bool Send(std::shared_ptr<Partition> partition, pink::PinkCli* cli);
 
   struct RecvResult {
@@ -53,9 +108,12 @@ class ZPTrySyncThread  {
     std::string message;
     uint32_t filenum;
     uint64_t offset;
+    RecvResult() : code(client::StatusCode::kError), filenum(0), offset(0) {}
   };
   bool Recv(std::shared_ptr<Partition> partition, pink::PinkCli* cli,
       RecvResult* res);
+  bool HandleSyncResult(std::shared_ptr<Partition> partition,
+      const Node& master_node, const RecvResult& res);
 
   // Rsync related
   std::unordered_set<std::string> rsync_ref_;
@@ -0,0 +1,206 @@
+// Copyright 2017 Qihoo
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http:// www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "src/node/zp_timer_wheel.h"
+
+// Unit test of ZPTimerWheel, driven by a fake clock, run by `make test`
+
+static int failures = 0;
+
+#define CHECK_EQ(expect, actual) do { \
+  uint64_t e = static_cast<uint64_t>(expect); \
+  uint64_t a = static_cast<uint64_t>(actual); \
+  if (e != a) { \
+    fprintf(stderr, "%s:%d: expect %lu, actual %lu\n", \
+        __FILE__, __LINE__, e, a); \
+    failures++; \
+  } \
+} while (0)
+
+const int64_t kTickMs = 10;
+// Delays beyond one level, two levels, and the whole wheel in ticks
+const uint64_t kLevel1 = 64;
+const uint64_t kLevel2 = 64 * 64;
+const uint64_t kWheel = 64 * 64 * 64;
+
+struct FakeClock {
+  uint64_t now_ms;
+  FakeClock() : now_ms(1000000000) {}
+  ZPTimerWheel::Clock clock() {
+    return [this]() { return now_ms; };
+  }
+};
+
+// Advance clock tick by tick, so that every run is seen at its tick
+static void RunTicks(FakeClock* clock, ZPTimerWheel* wheel, uint64_t ticks) {
+  for (uint64_t i = 0; i < ticks; i++) {
+    clock->now_ms += kTickMs;
+    wheel->Tick();
+  }
+}
+
+// Record ticks when task runs, by a once task
+static ZPTimerWheel::Task Once(const FakeClock* clock, uint64_t begin_ms,
+    std::vector<uint64_t>* runs) {
+  return [clock, begin_ms, runs]() {
+    runs->push_back((clock->now_ms - begin_ms) / kTickMs);
+    return -1;
+  };
+}
+
+static void TestRunOnTime() {
+  FakeClock clock;
+  uint64_t begin = clock.now_ms;
+  ZPTimerWheel wheel(kTickMs, clock.clock());
+  std::vector<uint64_t> runs;
+  wheel.Schedule(0, Once(&clock, begin, &runs));  // next tick
+  wheel.Schedule(1, Once(&clock, begin, &runs));  // round up
+  wheel.Schedule(kTickMs * 5, Once(&clock, begin, &runs));
+  wheel.Schedule(kTickMs * 5 + 1, Once(&clock, begin, &runs));
+  CHECK_EQ(4, wheel.size());
+
+  RunTicks(&clock, &wheel, 10);
+  CHECK_EQ(4, runs.size());
+  if (runs.size() == 4) {
+    CHECK_EQ(1, runs[0]);
+    CHECK_EQ(1, runs[1]);
+    CHECK_EQ(5, runs[2]);
+    CHECK_EQ(6, runs[3]);
+  }
+  CHECK_EQ(0, wheel.size());
+}
+
+// Timers on higher levels move down level by level, and still run
+// at the exact tick, also when current tick is not aligned
+static void TestCascade() {
+  FakeClock clock;
+  uint64_t begin = clock.now_ms;
+  ZPTimerWheel wheel(kTickMs, clock.clock());
+  RunTicks(&clock, &wheel, 37);
+
+  std::vector<uint64_t> delays = {kLevel1 - 1, kLevel1, kLevel1 + 1,
+    kLevel1 * 3 + 5, kLevel2 - 1, kLevel2, kLevel2 + 1, kLevel2 * 7 + 13};
+  std::vector<uint64_t> runs;
+  for (uint64_t delay : delays) {
+    wheel.Schedule(delay * kTickMs, Once(&clock, begin, &runs));
+  }
+  RunTicks(&clock, &wheel, kLevel2 * 8);
+  CHECK_EQ(delays.size(), runs.size());
+  for (size_t i = 0; i < delays.size() && i < runs.size(); i++) {
+    CHECK_EQ(37 + delays[i], runs[i]);
+  }
+  CHECK_EQ(0, wheel.size());
+}
+
+// Slot index wraps around the wheel many times,
+// delay longer than the wheel is cut to the longest one
+static void TestWrapAround() {
+  FakeClock clock;
+  uint64_t begin = clock.now_ms;
+  ZPTimerWheel wheel(kTickMs, clock.clock());
+  RunTicks(&clock, &wheel, kWheel - 3);
+
+  std::vector<uint64_t> runs;
+  wheel.Schedule(5 * kTickMs, Once(&clock, begin, &runs));
+  wheel.Schedule((kLevel2 + 2) * kTickMs, Once(&clock, begin, &runs));
+  wheel.Schedule(kWheel * 2 * kTickMs, Once(&clock, begin, &runs));
+  RunTicks(&clock, &wheel, kWheel + 1);
+  CHECK_EQ(3, runs.size());
+  if (runs.size() == 3) {
+    CHECK_EQ(kWheel + 2, runs[0]);
+    CHECK_EQ(kWheel - 3 + kLevel2 + 2, runs[1]);
+    CHECK_EQ(kWheel - 3 + kWheel - 1, runs[2]);
+  }
+}
+
+// Task is rescheduled by its return, and could schedule others
+static void TestReschedule() {
+  FakeClock clock;
+  uint64_t begin = clock.now_ms;
+  ZPTimerWheel wheel(kTickMs, clock.clock());
+  std::vector<uint64_t> runs;
+  std::vector<uint64_t> others;
+  int count = 0;
+  wheel.Schedule(kTickMs, [&]() -> int64_t {
+    runs.push_back((clock.now_ms - begin) / kTickMs);
+    if (++count == 3) {
+      wheel.Schedule(kTickMs * 2, Once(&clock, begin, &others));
+      return -1;
+    }
+    return kTickMs * kLevel1;  // through level 1 each time
+  });
+
+  RunTicks(&clock, &wheel, kLevel1 * 3);
+  CHECK_EQ(3, runs.size());
+  if (runs.size() == 3) {
+    CHECK_EQ(1, runs[0]);
+    CHECK_EQ(1 + kLevel1, runs[1]);
+    CHECK_EQ(1 + kLevel1 * 2, runs[2]);
+  }
+  CHECK_EQ(1, others.size());
+  if (others.size() == 1) {
+    CHECK_EQ(3 + kLevel1 * 2, others[0]);
+  }
+  CHECK_EQ(0, wheel.size());
+}
+
+// Runs all due tasks at once after a long stall
+static void TestCatchUp() {
+  FakeClock clock;
+  uint64_t begin = clock.now_ms;
+  ZPTimerWheel wheel(kTickMs, clock.clock());
+  std::vector<uint64_t> runs;
+  wheel.Schedule(kTickMs * 3, Once(&clock, begin, &runs));
+  wheel.Schedule(kTickMs * kLevel2, Once(&clock, begin, &runs));
+  clock.now_ms += kTickMs * kLevel2 * 2;
+  wheel.Tick();
+  CHECK_EQ(2, runs.size());
+  CHECK_EQ(0, wheel.size());
+}
+
+// Clock before begin must not be seen as a huge tick
+static void TestClockBeforeBegin() {
+  FakeClock clock;
+  ZPTimerWheel wheel(kTickMs, clock.clock());
+  int count = 0;
+  wheel.Schedule(kTickMs, [&count]() -> int64_t {
+    count++;
+    return kTickMs;
+  });
+  clock.now_ms -= 3600 * 1000;
+  wheel.Tick();
+  CHECK_EQ(0, count);
+  clock.now_ms += 3600 * 1000 + kTickMs * 4;
+  wheel.Tick();
+  CHECK_EQ(4, count);
+  CHECK_EQ(1, wheel.size());
+}
+
+int main() {
+  TestRunOnTime();
+  TestCascade();
+  TestWrapAround();
+  TestReschedule();
+  TestCatchUp();
+  TestClockBeforeBegin();
+  if (failures > 0) {
+    printf("zp_timer_wheel_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("zp_timer_wheel_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "slash/include/env.h"
+#include "slash/include/slash_string.h"
+#include "include/zp_const.h"
+#include "include/zp_binlog.h"
+
+// Compare binlog write and read path with and without
+// next file preparing and readahead
+
+struct Options {
+  std::string path;
+  int64_t count;
+  int64_t item_size;
+  int64_t file_size;
+  Options() : count(1000000), item_size(512), file_size(64 * 1024 * 1024) {}
+};
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./binlog_bench [-n count] [-s item_size]"
+    << " [-f binlog_file_size] path" << std::endl;
+  exit(-1);
+}
+
+void PrintLatency(const std::string& title, std::vector<uint64_t>* lats,
+    uint64_t total_us) {
+  std::sort(lats->begin(), lats->end());
+  size_t n = lats->size();
+  std::cout << title << ": "
+    << n * 1000000 / std::max(total_us, static_cast<uint64_t>(1))
+    << " ops/s, p50 " << (*lats)[n / 2]
+    << "us, p99 " << (*lats)[n * 99 / 100]
+    << "us, p9999 " << (*lats)[n * 9999 / 10000]
+    << "us, max " << (*lats)[n - 1] << "us" << std::endl;
+}
+
+bool BenchWrite(const Options& opt, const std::string& path, bool prepare) {
+  slash::DeleteDirIfExist(path);
+  slash::CreatePath(path);
+  Binlog* binlog = NULL;
+  Status s = Binlog::Create(path, opt.file_size, &binlog);
+  if (!s.ok()) {
+    std::cout << "Create binlog failed: " << s.ToString() << std::endl;
+    return false;
+  }
+
+  // As the partition cron does
+  std::atomic<bool> stop(false);
+  std::thread cron([&]() {
+    while (prepare && !stop) {
+      binlog->PrepareNextFile();
+      usleep(100 * 1000);
+    }
+  });
+
+  std::string item(opt.item_size, 'x');
+  std::vector<uint64_t> lats;
+  lats.reserve(opt.count);
+  uint64_t begin = slash::NowMicros();
+  for (int64_t i = 0; i < opt.count; i++) {
+    uint64_t start = slash::NowMicros();
+    binlog->Put(item);
+    lats.push_back(slash::NowMicros() - start);
+  }
+  uint64_t total = slash::NowMicros() - begin;
+  stop = true;
+  cron.join();
+  delete binlog;
+
+  PrintLatency(prepare ? "Write with next file prepared" : "Write",
+      &lats, total);
+  return true;
+}
+
+// Drop page cache of binlog files, so the reader hit disk
+void DropCache(const std::string& prefix, uint32_t files) {
+  for (uint32_t i = 0; i < files; i++) {
+    int fd = open(NewFileName(prefix, i).c_str(), O_RDONLY);
+    if (fd >= 0) {
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+  }
+}
+
+bool BenchRead(const std::string& path, bool readahead) {
+  std::string prefix = path + "/" + kBinlogPrefix;
+  uint32_t files = 0;
+  while (slash::FileExists(NewFileName(prefix, files))) {
+    files++;
+  }
+  DropCache(prefix, files);
+
+  uint64_t items = 0;
+  uint64_t bytes = 0;
+  uint64_t begin = slash::NowMicros();
+  for (uint32_t i = 0; i < files; i++) {
+    std::string file = NewFileName(prefix, i);
+    slash::SequentialFile* queue = NULL;
+    if (!slash::NewSequentialFile(file, &queue).ok()) {
+      std::cout << "Open binlog failed: " << file << std::endl;
+      return false;
+    }
+    BinlogReader* reader = new BinlogReader(queue);
+    BinlogReadahead* ahead = readahead ? new BinlogReadahead(file) : NULL;
+    uint64_t offset = 0;
+    std::string item;
+    while (true) {
+      if (ahead != NULL) {
+        ahead->Advance(offset);
+      }
+      uint64_t size = 0;
+      Status s = reader->Consume(&size, &item);
+      if (s.IsEndFile()) {
+        break;
+      } else if (!s.ok() && !s.IsIncomplete()) {
+        reader->SkipNextBlock(&size);
+      } else if (s.ok()) {
+        items++;
+      }
+      offset += size;
+    }
+    bytes += offset;
+    delete ahead;
+    delete reader;
+    delete queue;
+  }
+  uint64_t total = std::max(slash::NowMicros() - begin,
+      static_cast<uint64_t>(1));
+  std::cout << (readahead ? "Read with readahead" : "Read") << ": "
+    << items * 1000000 / total << " items/s, "
+    << bytes / total << " MB/s" << std::endl;
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "n:s:f:")) != -1) {
+    int64_t* target = NULL;
+    switch (c) {
+      case 'n': target = &opt.count; break;
+      case 's': target = &opt.item_size; break;
+      case 'f': target = &opt.file_size; break;
+      default: print_usage_exit();
+    }
+    if (!slash::string2l(optarg, strlen(optarg), target) || *target <= 0) {
+      print_usage_exit();
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage_exit();
+  }
+  opt.path = argv[optind];
+
+  std::string plain = opt.path + "/plain";
+  std::string prepared = opt.path + "/prepared";
+  if (!BenchWrite(opt, plain, false)
+      || !BenchWrite(opt, prepared, true)
+      || !BenchRead(plain, false)
+      || !BenchRead(prepared, true)) {
+    return -1;
+  }
+  slash::DeleteDirIfExist(plain);
+  slash::DeleteDirIfExist(prepared);
+  return 0;
+}
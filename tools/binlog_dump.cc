@@ -0,0 +1,480 @@
+#include <map>
+#include <set>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "slash/include/env.h"
+#include "slash/include/slash_string.h"
+#include "include/zp_const.h"
+#include "include/zp_binlog.h"
+#include "src/node/client.pb.h"
+
+// Decode binlog files in parallel.
+// Every kBlockSize block begins with a record header, so blocks could be
+// decoded independently: one task owns the items beginning in its blocks,
+// and reads over its last block to finish the one spanning out.
+
+const int kBlocksPerTask = 64;  // 4MB
+
+struct Position {
+  uint32_t filenum;
+  uint64_t offset;
+  Position(uint32_t n = 0, uint64_t o = 0) : filenum(n), offset(o) {}
+  bool operator< (const Position& rhs) const {
+    return (filenum < rhs.filenum ||
+        (filenum == rhs.filenum && offset < rhs.offset));
+  }
+};
+
+struct Filter {
+  std::string table;
+  std::string key_prefix;
+  std::set<int> types;
+  Position start;
+  Position end;
+  bool replay;
+  Filter() : start(0, 0), end(UINT32_MAX, UINT64_MAX), replay(false) {}
+};
+
+struct TaskResult {
+  std::string output;
+  uint64_t items;
+  uint64_t matched;
+  uint64_t corrupt;
+  TaskResult() : items(0), matched(0), corrupt(0) {}
+};
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./binlog_dump [-t table] [-k key_prefix] [-c SET,DEL,...]"
+    << " [-s filenum:offset] [-e filenum:offset] [-r] [-j threads]"
+    << " binlog_path|binlog_file" << std::endl;
+  std::cout << "    -r output replay stream, every item as"
+    << " 4 bytes little endian length and serialized CmdRequest" << std::endl;
+  std::cout << "    otherwise output one json per line" << std::endl;
+  exit(-1);
+}
+
+bool ParsePosition(const std::string& arg, Position* pos) {
+  int64_t tmp = 0;
+  size_t colon = arg.find(':');
+  if (colon == std::string::npos
+      || !slash::string2l(arg.data(), colon, &tmp) || tmp < 0) {
+    return false;
+  }
+  pos->filenum = tmp;
+  if (!slash::string2l(arg.data() + colon + 1, arg.size() - colon - 1, &tmp)
+      || tmp < 0) {
+    return false;
+  }
+  pos->offset = tmp;
+  return true;
+}
+
+void AppendJsonString(const std::string& str, std::string* out) {
+  char buf[8];
+  out->push_back('"');
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20 || c >= 0x7f) {
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+bool HasPrefix(const std::string& str, const std::string& prefix) {
+  return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Table name and keys the item touches
+void ExtractItem(const client::CmdRequest& req, std::string* table,
+    std::vector<std::string>* keys) {
+  switch (req.type()) {
+    case client::Type::SET:
+      *table = req.set().table_name();
+      keys->push_back(req.set().key());
+      break;
+    case client::Type::DEL:
+      *table = req.del().table_name();
+      keys->push_back(req.del().key());
+      break;
+    case client::Type::WRITEBATCH:
+      *table = req.write_batch().table_name();
+      keys->push_back(req.write_batch().hash_tag());
+      keys->insert(keys->end(), req.write_batch().keys_to_add().begin(),
+          req.write_batch().keys_to_add().end());
+      keys->insert(keys->end(), req.write_batch().keys_to_delete().begin(),
+          req.write_batch().keys_to_delete().end());
+      break;
+    case client::Type::DELETEBYTAG:
+      *table = req.deleteby_tag().table_name();
+      keys->push_back(req.deleteby_tag().hash_tag());
+      break;
+    case client::Type::FLUSHDB:
+      *table = req.flushdb().table_name();
+      break;
+    case client::Type::INGEST:
+      *table = req.ingest().table_name();
+      break;
+    default:
+      break;
+  }
+}
+
+bool Match(const Filter& filter, const client::CmdRequest& req,
+    const std::string& table, const std::vector<std::string>& keys) {
+  if (!filter.types.empty() && filter.types.count(req.type()) == 0) {
+    return false;
+  }
+  if (!filter.table.empty() && table != filter.table) {
+    return false;
+  }
+  if (filter.key_prefix.empty()) {
+    return true;
+  }
+  for (auto& key : keys) {
+    if (HasPrefix(key, filter.key_prefix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Output(const Filter& filter, const Position& pos,
+    const std::string& raw, const client::CmdRequest& req,
+    const std::string& table, const std::vector<std::string>& keys,
+    std::string* out) {
+  if (filter.replay) {
+    uint32_t len = raw.size();
+    char buf[4];
+    buf[0] = static_cast<char>(len & 0xff);
+    buf[1] = static_cast<char>((len >> 8) & 0xff);
+    buf[2] = static_cast<char>((len >> 16) & 0xff);
+    buf[3] = static_cast<char>(len >> 24);
+    out->append(buf, 4);
+    out->append(raw);
+    return;
+  }
+
+  char buf[128];
+  snprintf(buf, sizeof(buf), "{\"filenum\":%u,\"offset\":%" PRIu64 ",\"type\":",
+      pos.filenum, pos.offset);
+  out->append(buf);
+  AppendJsonString(client::Type_Name(req.type()), out);
+  out->append(",\"table\":");
+  AppendJsonString(table, out);
+  out->append(",\"keys\":[");
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i > 0) {
+      out->push_back(',');
+    }
+    AppendJsonString(keys[i], out);
+  }
+  out->push_back(']');
+  if (req.type() == client::Type::SET) {
+    snprintf(buf, sizeof(buf), ",\"value_size\":%zu",
+        req.set().value().size());
+    out->append(buf);
+    if (req.set().has_expire()) {
+      snprintf(buf, sizeof(buf), ",\"ttl\":%d,\"base\":%d",
+          req.set().expire().ttl(), req.set().expire().base());
+      out->append(buf);
+    }
+  }
+  out->append("}\n");
+}
+
+// Decode items beginning in blocks [begin, end) of one mmaped file
+void DecodeBlocks(const Filter& filter, uint32_t filenum, const char* data,
+    uint64_t size, uint64_t begin, uint64_t end, TaskResult* result) {
+  uint64_t offset = begin * kBlockSize;
+  uint64_t bound = std::min(end * kBlockSize, size);
+  uint64_t item_offset = 0;
+  bool inside = false;
+  std::string item;
+  client::CmdRequest req;
+  while (offset < size) {
+    uint64_t block_left = kBlockSize - offset % kBlockSize;
+    if (block_left <= kHeaderSize) {
+      offset += block_left;  // Trailer of block
+      continue;
+    }
+    if (!inside && offset >= bound) {
+      break;  // Items from here belong to next task
+    }
+    if (offset + kHeaderSize > size) {
+      break;
+    }
+    const unsigned char* header =
+      reinterpret_cast<const unsigned char*>(data + offset);
+    uint32_t length = header[0] | (header[1] << 8) | (header[2] << 16);
+    uint32_t type = header[3];
+    if (type == kZeroType && length == 0) {
+      // Padding or not written yet
+      inside = false;
+      offset += block_left;
+      continue;
+    }
+    if (kHeaderSize + length > block_left
+        || offset + kHeaderSize + length > size
+        || type > kEmptyType) {
+      result->corrupt++;
+      inside = false;
+      offset += block_left;
+      continue;
+    }
+    const char* payload = data + offset + kHeaderSize;
+    uint64_t record_offset = offset;
+    offset += kHeaderSize + length;
+
+    switch (type) {
+      case kFullType:
+        inside = false;
+        item_offset = record_offset;
+        item.assign(payload, length);
+        break;
+      case kFirstType:
+        inside = true;
+        item_offset = record_offset;
+        item.assign(payload, length);
+        continue;
+      case kMiddleType:
+        if (inside) {
+          item.append(payload, length);
+        }
+        continue;
+      case kLastType:
+        if (!inside) {
+          continue;  // Tail of the item from previous task
+        }
+        inside = false;
+        item.append(payload, length);
+        break;
+      default:
+        continue;  // Blank
+    }
+
+    result->items++;
+    Position pos(filenum, item_offset);
+    if (pos < filter.start || !(pos < filter.end)) {
+      continue;
+    }
+    if (!req.ParseFromString(item)) {
+      result->corrupt++;
+      continue;
+    }
+    std::string table;
+    std::vector<std::string> keys;
+    ExtractItem(req, &table, &keys);
+    if (Match(filter, req, table, keys)) {
+      result->matched++;
+      Output(filter, pos, item, req, table, keys, &result->output);
+    }
+  }
+}
+
+// Compressed binlog is uncompressed into memory as a whole
+bool LoadCompressedFile(const std::string& path, std::string* content) {
+  BinlogCompressedFile* cfile = NULL;
+  if (!BinlogCompressedFile::Open(path, &cfile).ok()) {
+    std::cerr << "Open compressed binlog failed: " << path << std::endl;
+    return false;
+  }
+  content->resize(cfile->size());
+  bool ok = content->empty()
+    || cfile->Pread(&(*content)[0], content->size(), 0)
+    == static_cast<ssize_t>(content->size());
+  delete cfile;
+  if (!ok) {
+    std::cerr << "Read compressed binlog failed: " << path << std::endl;
+  }
+  return ok;
+}
+
+bool DumpFile(const Filter& filter, const std::string& path,
+    uint32_t filenum, int threads, TaskResult* total) {
+  std::string content;
+  bool compressed = BinlogFileCompressed(path);
+  if (compressed && !LoadCompressedFile(path, &content)) {
+    return false;
+  }
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Open binlog failed: " << path << std::endl;
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+  uint64_t size = compressed ? content.size() : file_stat.st_size;
+  if (size == 0) {
+    close(fd);
+    return true;
+  }
+  void* addr = NULL;
+  const char* data = content.data();
+  if (!compressed) {
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      std::cerr << "Mmap binlog failed: " << path << std::endl;
+      return false;
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(addr);
+  }
+  close(fd);
+
+  uint64_t blocks = (size + kBlockSize - 1) / kBlockSize;
+  uint64_t task_num = (blocks + kBlocksPerTask - 1) / kBlocksPerTask;
+  std::vector<TaskResult> results(task_num);
+  std::atomic<uint64_t> next(0);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.push_back(std::thread([&]() {
+      uint64_t task;
+      while ((task = next++) < task_num) {
+        DecodeBlocks(filter, filenum, data, size, task * kBlocksPerTask,
+            (task + 1) * kBlocksPerTask, &results[task]);
+      }
+    }));
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  if (addr != NULL) {
+    munmap(addr, size);
+  }
+
+  // Output in binlog order
+  for (auto& result : results) {
+    fwrite(result.output.data(), 1, result.output.size(), stdout);
+    total->items += result.items;
+    total->matched += result.matched;
+    total->corrupt += result.corrupt;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  Filter filter;
+  int threads = std::thread::hardware_concurrency();
+  int opt;
+  while ((opt = getopt(argc, argv, "t:k:c:s:e:rj:")) != -1) {
+    switch (opt) {
+      case 't':
+        filter.table = optarg;
+        break;
+      case 'k':
+        filter.key_prefix = optarg;
+        break;
+      case 'c': {
+        std::vector<std::string> names;
+        slash::StringSplit(optarg, ',', names);
+        for (auto& name : names) {
+          client::Type type;
+          if (!client::Type_Parse(name, &type)) {
+            std::cerr << "Unknown command type: " << name << std::endl;
+            print_usage_exit();
+          }
+          filter.types.insert(type);
+        }
+        break;
+      }
+      case 's':
+        if (!ParsePosition(optarg, &filter.start)) {
+          print_usage_exit();
+        }
+        break;
+      case 'e':
+        if (!ParsePosition(optarg, &filter.end)) {
+          print_usage_exit();
+        }
+        break;
+      case 'r':
+        filter.replay = true;
+        break;
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      default:
+        print_usage_exit();
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage_exit();
+  }
+  if (threads <= 0) {
+    threads = 1;
+  }
+
+  // Binlog files in order
+  std::string path(argv[optind]);
+  std::map<uint32_t, std::string> binlogs;
+  std::vector<std::string> children;
+  int64_t index = 0;
+  if (slash::IsDir(path) == 0) {
+    if (slash::GetChildren(path, children) != 0) {
+      std::cerr << "Get binlog files failed: " << path << std::endl;
+      return -1;
+    }
+    for (auto& child : children) {
+      if (child.compare(0, kBinlogPrefixLen, kBinlogPrefix) != 0) {
+        continue;
+      }
+      std::string sindex = child.substr(kBinlogPrefixLen);
+      if (slash::string2l(sindex.c_str(), sindex.size(), &index) == 1) {
+        binlogs[index] = path + "/" + child;
+      }
+    }
+  } else {
+    std::string name = path.substr(path.rfind('/') + 1);
+    std::string sindex = name.substr(std::min(name.size(), kBinlogPrefixLen));
+    if (name.compare(0, kBinlogPrefixLen, kBinlogPrefix) != 0
+        || slash::string2l(sindex.c_str(), sindex.size(), &index) != 1) {
+      std::cerr << "Not a binlog file: " << path << std::endl;
+      return -1;
+    }
+    binlogs[index] = path;
+  }
+
+  TaskResult total;
+  int scanned = 0, skipped = 0;
+  for (auto& binlog : binlogs) {
+    if (binlog.first < filter.start.filenum
+        || binlog.first > filter.end.filenum) {
+      skipped++;
+      continue;
+    }
+    if (!DumpFile(filter, binlog.second, binlog.first, threads, &total)) {
+      return -1;
+    }
+    scanned++;
+  }
+  fflush(stdout);
+  std::cerr << "Files scanned: " << scanned << ", skipped: " << skipped
+    << ", items: " << total.items
+    << ", matched: " << total.matched << ", corrupt: " << total.corrupt
+    << std::endl;
+  return total.corrupt == 0 ? 0 : 1;
+}
@@ -0,0 +1,480 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "slash/include/env.h"
+#include "slash/include/slash_mutex.h"
+#include "slash/include/slash_string.h"
+#include "include/zp_conf.h"
+#include "include/zp_const.h"
+#include "include/zp_binlog.h"
+#include "src/node/client.pb.h"
+#include "src/node/zp_data_command.h"
+#include "src/node/zp_data_server.h"
+#include "src/node/zp_data_table.h"
+
+// Micro benchmarks of the node hot paths, built with the node objects
+// by `make bench`. Result is printed in the json format of
+// google benchmark, so it could be compared by its tools.
+// For multi thread benchmark, iterations is the sum of all threads,
+// real_time is the wall time each thread spent on one iteration
+
+// Defined in zp_node.cc, which is not linked
+ZpConf* g_zp_conf = NULL;
+ZPDataServer* zp_data_server = NULL;
+
+struct Options {
+  std::string path;
+  std::string output;
+  std::string filter;
+  int64_t min_time_ms;
+  Options() : path("./micro_bench_data"), min_time_ms(500) {}
+};
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./micro_bench [-t min_time_ms] [-f filter]"
+    << " [-d data_path] [-o output_json]" << std::endl;
+  exit(-1);
+}
+
+// Body runs iters iterations as thread tid
+typedef std::function<void(int64_t iters, int tid)> BenchBody;
+
+struct Benchmark {
+  std::string name;
+  int threads;
+  int64_t bytes_per_op;  // 0 for no bytes_per_second
+  int64_t max_iters;  // per thread, bound the binlog disk usage
+  std::function<void()> setup;
+  std::function<void()> teardown;
+  BenchBody body;
+};
+
+struct BenchResult {
+  std::string name;
+  int threads;
+  int64_t iterations;
+  double real_time;  // ns
+  double cpu_time;  // ns
+  double items_per_second;
+  double bytes_per_second;
+};
+
+uint64_t NowNanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Return wall time in ns, cpu time of the process in *cpu_ns
+uint64_t RunOnce(const Benchmark& bm, int64_t iters, uint64_t* cpu_ns) {
+  std::atomic<int> ready(0);
+  std::atomic<bool> start(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < bm.threads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      ready++;
+      while (!start) {
+      }
+      bm.body(iters, t);
+    }));
+  }
+  while (ready < bm.threads) {
+  }
+  uint64_t cpu_begin = NowNanos(CLOCK_PROCESS_CPUTIME_ID);
+  uint64_t begin = NowNanos(CLOCK_MONOTONIC);
+  start = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  uint64_t wall = NowNanos(CLOCK_MONOTONIC) - begin;
+  // Spinning threads before start are counted, but negligible
+  *cpu_ns = NowNanos(CLOCK_PROCESS_CPUTIME_ID) - cpu_begin;
+  return std::max(wall, static_cast<uint64_t>(1));
+}
+
+// Grow iterations until the run lasts min_time, as google benchmark does
+BenchResult Run(const Benchmark& bm, int64_t min_time_ms) {
+  if (bm.setup) {
+    bm.setup();
+  }
+  uint64_t min_ns = static_cast<uint64_t>(min_time_ms) * 1000000;
+  int64_t iters = 1;
+  uint64_t wall = 0, cpu = 0;
+  while (true) {
+    wall = RunOnce(bm, iters, &cpu);
+    if (wall >= min_ns || iters >= bm.max_iters) {
+      break;
+    }
+    double multiplier = wall * 10 <= min_ns ? 10
+      : static_cast<double>(min_ns) * 1.4 / wall;
+    iters = std::min(bm.max_iters,
+        std::max(iters + 1, static_cast<int64_t>(iters * multiplier)));
+  }
+  if (bm.teardown) {
+    bm.teardown();
+  }
+
+  BenchResult r;
+  r.name = bm.name + "/threads:" + std::to_string(bm.threads);
+  r.threads = bm.threads;
+  r.iterations = iters * bm.threads;
+  r.real_time = static_cast<double>(wall) / iters;
+  r.cpu_time = static_cast<double>(cpu) / r.iterations;
+  r.items_per_second = r.iterations * 1e9 / wall;
+  r.bytes_per_second = r.items_per_second * bm.bytes_per_op;
+  return r;
+}
+
+std::string JsonEscape(const std::string& str) {
+  std::string res;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      res.push_back('\\');
+    }
+    res.push_back(c);
+  }
+  return res;
+}
+
+void PrintJson(std::ostream& out, const std::vector<BenchResult>& results) {
+  char date[64];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%FT%T%z", localtime(&now));
+  char host[256] = {0};
+  gethostname(host, sizeof(host) - 1);
+
+  out << "{" << std::endl;
+  out << "  \"context\": {" << std::endl;
+  out << "    \"date\": \"" << date << "\"," << std::endl;
+  out << "    \"host_name\": \"" << JsonEscape(host) << "\"," << std::endl;
+  out << "    \"num_cpus\": " << std::thread::hardware_concurrency()
+    << "," << std::endl;
+  out << "    \"zp_version\": \"" << JsonEscape(kZPVersion) << "\","
+    << std::endl;
+#ifdef NDEBUG
+  out << "    \"library_build_type\": \"release\"" << std::endl;
+#else
+  out << "    \"library_build_type\": \"debug\"" << std::endl;
+#endif
+  out << "  }," << std::endl;
+  out << "  \"benchmarks\": [" << std::endl;
+  char buf[1024];
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& r = results[i];
+    snprintf(buf, sizeof(buf), "    {\n"
+        "      \"name\": \"%s\",\n"
+        "      \"run_name\": \"%s\",\n"
+        "      \"run_type\": \"iteration\",\n"
+        "      \"threads\": %d,\n"
+        "      \"iterations\": %ld,\n"
+        "      \"real_time\": %.2f,\n"
+        "      \"cpu_time\": %.2f,\n"
+        "      \"time_unit\": \"ns\",\n"
+        "      \"items_per_second\": %.2f,\n"
+        "      \"bytes_per_second\": %.2f\n"
+        "    }%s\n",
+        JsonEscape(r.name).c_str(), JsonEscape(r.name).c_str(), r.threads,
+        r.iterations, r.real_time, r.cpu_time, r.items_per_second,
+        r.bytes_per_second, i + 1 == results.size() ? "" : ",");
+    out << buf;
+  }
+  out << "  ]" << std::endl;
+  out << "}" << std::endl;
+}
+
+const int kValueSizes[] = {64, 512, 4096};
+const int kThreads[] = {1, 4};
+const int64_t kMaxIters = 100000000;
+// Bytes written by one binlog benchmark
+const int64_t kMaxBinlogBytes = 512LL * 1024 * 1024;
+const int kKeyCount = 1024;
+
+std::vector<std::string> Keys(const std::string& prefix) {
+  std::vector<std::string> keys;
+  for (int i = 0; i < kKeyCount; i++) {
+    keys.push_back(prefix + std::to_string(i));
+  }
+  return keys;
+}
+
+std::string SetRequest(int value_size, bool expire) {
+  client::CmdRequest req;
+  req.set_type(client::Type::SET);
+  client::CmdRequest_Set* set = req.mutable_set();
+  set->set_table_name("bench_table");
+  set->set_key("bench_key_0000");
+  set->set_value(std::string(value_size, 'v'));
+  set->set_uuid("bench_uuid");
+  if (expire) {
+    set->mutable_expire()->set_ttl(3600);
+  }
+  return req.SerializeAsString();
+}
+
+void AddBinlogBenchmarks(const Options& opt, std::vector<Benchmark>* bms) {
+  std::string path = opt.path + "/binlog/";
+  for (int size : kValueSizes) {
+    int64_t max_iters = kMaxBinlogBytes / size;
+
+    // Binlog::Put, which serialize producers and call BinlogWriter::Produce
+    for (int threads : kThreads) {
+      std::shared_ptr<Binlog*> binlog(new Binlog*(NULL));
+      std::string item(size, 'x');
+      Benchmark bm;
+      bm.name = "BM_BinlogProduce/" + std::to_string(size);
+      bm.threads = threads;
+      bm.bytes_per_op = size;
+      bm.max_iters = max_iters / threads;
+      bm.setup = [path, binlog]() {
+        slash::DeleteDirIfExist(path);
+        slash::CreatePath(path);
+        Status s = Binlog::Create(path, kBinlogSize, binlog.get());
+        if (!s.ok()) {
+          std::cerr << "Create binlog failed: " << s.ToString() << std::endl;
+          exit(-1);
+        }
+      };
+      bm.teardown = [path, binlog]() {
+        delete *binlog;
+        *binlog = NULL;
+        slash::DeleteDirIfExist(path);
+      };
+      bm.body = [binlog, item](int64_t iters, int tid) {
+        for (int64_t i = 0; i < iters; i++) {
+          (*binlog)->Put(item);
+        }
+      };
+      bms->push_back(bm);
+    }
+
+    // BinlogReader::Consume on a file in page cache, every thread
+    // reads the file from begin again once reaching the end
+    for (int threads : kThreads) {
+      std::string file = NewFileName(path + kBinlogPrefix, 0);
+      Benchmark bm;
+      bm.name = "BM_BinlogConsume/" + std::to_string(size);
+      bm.threads = threads;
+      bm.bytes_per_op = size;
+      bm.max_iters = kMaxIters;
+      bm.setup = [path, size]() {
+        slash::DeleteDirIfExist(path);
+        slash::CreatePath(path);
+        Binlog* binlog = NULL;
+        Status s = Binlog::Create(path, kBinlogSize, &binlog);
+        if (!s.ok()) {
+          std::cerr << "Create binlog failed: " << s.ToString() << std::endl;
+          exit(-1);
+        }
+        std::string item(size, 'x');
+        for (int64_t i = 0; i < 64 * 1024 * 1024 / size; i++) {
+          binlog->Put(item);
+        }
+        delete binlog;
+      };
+      bm.teardown = [path]() {
+        slash::DeleteDirIfExist(path);
+      };
+      bm.body = [file](int64_t iters, int tid) {
+        slash::SequentialFile* queue = NULL;
+        BinlogReader* reader = NULL;
+        std::string item;
+        int64_t i = 0;
+        while (i < iters) {
+          if (reader == NULL) {
+            if (!NewBinlogSequentialFile(file, &queue).ok()) {
+              std::cerr << "Open binlog failed: " << file << std::endl;
+              exit(-1);
+            }
+            reader = new BinlogReader(queue);
+          }
+          uint64_t size = 0;
+          Status s = reader->Consume(&size, &item);
+          if (s.ok()) {
+            i++;
+          } else {
+            delete reader;
+            reader = NULL;
+            delete queue;
+            queue = NULL;
+          }
+        }
+        delete reader;
+        delete queue;
+      };
+      bms->push_back(bm);
+    }
+  }
+}
+
+void AddTableBenchmarks(const Options& opt, std::vector<Benchmark>* bms) {
+  std::shared_ptr<Table> table = NewTable("bench_table",
+      opt.path + "/log", opt.path + "/db", opt.path + "/trash");
+  table->SetPartitionCount(1024);
+  std::vector<std::pair<std::string, std::vector<std::string>>> cases = {
+    {"plain", Keys("bench_key_")},
+    {"hash_tag", Keys("{bench_tag}_key_")}
+  };
+  for (auto& c : cases) {
+    std::vector<std::string> keys = c.second;
+    for (int threads : kThreads) {
+      Benchmark bm;
+      bm.name = "BM_KeyToPartitionId/" + c.first;
+      bm.threads = threads;
+      bm.bytes_per_op = 0;
+      bm.max_iters = kMaxIters;
+      bm.body = [table, keys](int64_t iters, int tid) {
+        int sum = 0;
+        for (int64_t i = 0; i < iters; i++) {
+          sum += table->KeyToPartitionId(keys[i % kKeyCount]);
+        }
+        // Keep the loop
+        if (sum == -1) {
+          std::cerr << sum << std::endl;
+        }
+      };
+      bms->push_back(bm);
+    }
+  }
+}
+
+void AddCommandBenchmarks(std::vector<Benchmark>* bms) {
+  std::shared_ptr<Cmd> cmd(new SetCmd(kCmdFlagsKv | kCmdFlagsWrite));
+  for (int size : kValueSizes) {
+    for (bool expire : {false, true}) {
+      std::shared_ptr<client::CmdRequest> req(new client::CmdRequest);
+      req->ParseFromString(SetRequest(size, expire));
+      for (int threads : kThreads) {
+        Benchmark bm;
+        bm.name = "BM_SetCmdGenerateLog/" + std::to_string(size)
+          + (expire ? "/expire" : "");
+        bm.threads = threads;
+        bm.bytes_per_op = size;
+        bm.max_iters = kMaxIters;
+        bm.body = [cmd, req](int64_t iters, int tid) {
+          std::string raw;
+          for (int64_t i = 0; i < iters; i++) {
+            raw.clear();
+            cmd->GenerateLog(req.get(), &raw);
+          }
+        };
+        bms->push_back(bm);
+      }
+    }
+  }
+
+  // As DealMessageInternal, parse into a reused request
+  for (int size : kValueSizes) {
+    std::string raw = SetRequest(size, false);
+    for (int threads : kThreads) {
+      Benchmark bm;
+      bm.name = "BM_ParseCmdRequest/" + std::to_string(size);
+      bm.threads = threads;
+      bm.bytes_per_op = raw.size();
+      bm.max_iters = kMaxIters;
+      bm.body = [raw](int64_t iters, int tid) {
+        client::CmdRequest req;
+        for (int64_t i = 0; i < iters; i++) {
+          if (!req.ParseFromArray(raw.data(), raw.size())) {
+            std::cerr << "Parse failed" << std::endl;
+            exit(-1);
+          }
+        }
+      };
+      bms->push_back(bm);
+    }
+  }
+}
+
+void AddRecordMutexBenchmarks(std::vector<Benchmark>* bms) {
+  std::shared_ptr<slash::RecordMutex> mutex(new slash::RecordMutex);
+  for (bool hot : {false, true}) {
+    for (int threads : {1, 4, 16}) {
+      std::vector<std::string> keys;
+      for (int t = 0; t < threads; t++) {
+        keys.push_back(hot ? "hot_key" : "key_" + std::to_string(t));
+      }
+      Benchmark bm;
+      bm.name = std::string("BM_RecordMutex/") + (hot ? "same_key" : "own_key");
+      bm.threads = threads;
+      bm.bytes_per_op = 0;
+      bm.max_iters = kMaxIters;
+      bm.body = [mutex, keys](int64_t iters, int tid) {
+        for (int64_t i = 0; i < iters; i++) {
+          mutex->Lock(keys[tid]);
+          mutex->Unlock(keys[tid]);
+        }
+      };
+      bms->push_back(bm);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "t:f:d:o:")) != -1) {
+    switch (c) {
+      case 't':
+        if (!slash::string2l(optarg, strlen(optarg), &opt.min_time_ms)
+            || opt.min_time_ms <= 0) {
+          print_usage_exit();
+        }
+        break;
+      case 'f': opt.filter = optarg; break;
+      case 'd': opt.path = optarg; break;
+      case 'o': opt.output = optarg; break;
+      default: print_usage_exit();
+    }
+  }
+  if (optind != argc) {
+    print_usage_exit();
+  }
+  slash::CreatePath(opt.path);
+
+  std::vector<Benchmark> bms;
+  AddBinlogBenchmarks(opt, &bms);
+  AddTableBenchmarks(opt, &bms);
+  AddCommandBenchmarks(&bms);
+  AddRecordMutexBenchmarks(&bms);
+
+  std::vector<BenchResult> results;
+  for (auto& bm : bms) {
+    if (!opt.filter.empty()
+        && bm.name.find(opt.filter) == std::string::npos) {
+      continue;
+    }
+    BenchResult r = Run(bm, opt.min_time_ms);
+    fprintf(stderr, "%-48s %12.1f ns %12.1f ns %12ld\n",
+        r.name.c_str(), r.real_time, r.cpu_time, r.iterations);
+    results.push_back(r);
+  }
+  bms.clear();
+  slash::DeleteDirIfExist(opt.path);
+
+  if (opt.output.empty()) {
+    PrintJson(std::cout, results);
+  } else {
+    std::ofstream out(opt.output);
+    PrintJson(out, results);
+    if (!out) {
+      std::cerr << "Write " << opt.output << " failed" << std::endl;
+      return -1;
+    }
+  }
+  return 0;
+}
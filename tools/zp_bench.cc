@@ -0,0 +1,539 @@
+#include <map>
+#include <cmath>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pink/include/pink_cli.h"
+#include "slash/include/env.h"
+#include "slash/include/slash_string.h"
+#include "slash/include/slash_status.h"
+#include "src/node/client.pb.h"
+
+// Load generator speaking client.proto to data nodes directly.
+// Follow kMove redirect, so it works with any node of the cluster.
+
+// Same as kLBrace and kRBrace in include/zp_command.h
+const std::string kLBrace = "#ZPLBRACE%#";
+const std::string kRBrace = "#ZPRBRACE%#";
+
+const int kRedirectLimit = 3;
+
+enum OpType {
+  kOpSet = 0,
+  kOpGet,
+  kOpMget,
+  kOpWriteBatch,
+  kOpMax,
+};
+const std::string OpName[] = {"SET", "GET", "MGET", "WRITEBATCH"};
+
+enum Distribution {
+  kUniform = 0,
+  kZipfian,
+  kHashTag,
+};
+
+struct BenchOptions {
+  std::vector<std::pair<std::string, int>> nodes;
+  std::string table;
+  int threads;
+  int pipeline;
+  int duration;  // s
+  int64_t requests;  // 0 for no limit
+  int64_t keyspace;
+  int value_size;
+  int read_percent;
+  int mget_percent;
+  int writebatch_percent;
+  int batch;
+  Distribution distribution;
+  double zipf_theta;
+  int hash_tags;
+  BenchOptions()
+    : table("bench"), threads(16), pipeline(1), duration(60), requests(0),
+    keyspace(1000000), value_size(100), read_percent(50), mget_percent(0),
+    writebatch_percent(0), batch(10), distribution(kUniform),
+    zipf_theta(0.99), hash_tags(1000) {}
+};
+
+// Log linear histogram in microseconds, kSubBuckets buckets for every
+// power of two, so that error is below 1/kSubBuckets
+class Histogram {
+ public:
+  static const int kSubBits = 6;
+  static const int kSubBuckets = 1 << kSubBits;
+  static const int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+  Histogram() : counts_(kBuckets, 0), total_(0), max_(0) {}
+
+  void Add(uint64_t value) {
+    counts_[Index(value)]++;
+    total_++;
+    max_ = std::max(max_, value);
+  }
+
+  void Merge(const Histogram& other) {
+    for (int i = 0; i < kBuckets; i++) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t Percentile(double p) const {
+    uint64_t target = static_cast<uint64_t>(ceil(total_ * p / 100));
+    uint64_t sum = 0;
+    for (int i = 0; i < kBuckets; i++) {
+      sum += counts_[i];
+      if (sum >= target && sum > 0) {
+        return std::min(UpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  uint64_t total() const {
+    return total_;
+  }
+  uint64_t max() const {
+    return max_;
+  }
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t total_;
+  uint64_t max_;
+
+  // Exact below 2 * kSubBuckets, then value >> shift is
+  // in [kSubBuckets, 2 * kSubBuckets)
+  static int Index(uint64_t value) {
+    if (value < static_cast<uint64_t>(2 * kSubBuckets)) {
+      return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - kSubBits;
+    return shift * kSubBuckets + (value >> shift);
+  }
+
+  static uint64_t UpperBound(int index) {
+    if (index < 2 * kSubBuckets) {
+      return index;
+    }
+    int shift = index / kSubBuckets - 1;
+    uint64_t sub = index % kSubBuckets + kSubBuckets;
+    return ((sub + 1) << shift) - 1;
+  }
+};
+
+// Zipfian generator from YCSB, item 0 is the hottest
+class Zipfian {
+ public:
+  Zipfian(int64_t items, double theta)
+    : items_(items), theta_(theta), zetan_(0) {
+    for (int64_t i = 1; i <= items_; i++) {
+      zetan_ += 1 / pow(i, theta_);
+    }
+    double zeta2 = 1 + 1 / pow(2, theta_);
+    alpha_ = 1 / (1 - theta_);
+    eta_ = (1 - pow(2.0 / items_, 1 - theta_)) / (1 - zeta2 / zetan_);
+  }
+
+  int64_t Next(std::mt19937_64* rng) const {
+    double u = std::uniform_real_distribution<double>(0, 1)(*rng);
+    double uz = u * zetan_;
+    if (uz < 1) {
+      return 0;
+    }
+    if (uz < 1 + pow(0.5, theta_)) {
+      return 1;
+    }
+    return static_cast<int64_t>(items_ * pow(eta_ * u - eta_ + 1, alpha_));
+  }
+
+ private:
+  int64_t items_;
+  double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+BenchOptions g_opt;
+Zipfian* g_zipfian = NULL;
+std::atomic<bool> g_stop(false);
+std::atomic<int64_t> g_issued(0);
+std::atomic<int64_t> g_done(0);
+std::atomic<int64_t> g_errors(0);
+
+struct Pending {
+  OpType op;
+  uint64_t start_us;
+  client::CmdRequest request;
+};
+
+class Worker {
+ public:
+  explicit Worker(int id)
+    : rng_(id * 7919 + slash::NowMicros()),
+    histograms_(kOpMax) {
+  }
+  ~Worker() {
+    for (auto& item : clis_) {
+      delete item.second;
+    }
+  }
+
+  void Run();
+
+  const std::vector<Histogram>& histograms() const {
+    return histograms_;
+  }
+
+ private:
+  std::mt19937_64 rng_;
+  std::vector<Histogram> histograms_;
+  std::map<std::string, pink::PinkCli*> clis_;
+
+  pink::PinkCli* GetConnection(const std::string& ip, int port);
+  void DropConnection(const std::string& ip, int port);
+  std::string NextKey();
+  std::string NextTag();
+  void BuildRequest(OpType op, client::CmdRequest* request);
+  OpType NextOp();
+  bool Process(const std::string& ip, int port, std::vector<Pending>* batch,
+      int redirect_limit);
+};
+
+pink::PinkCli* Worker::GetConnection(const std::string& ip, int port) {
+  std::string ip_port = slash::IpPortString(ip, port);
+  auto iter = clis_.find(ip_port);
+  if (iter != clis_.end()) {
+    return iter->second;
+  }
+  pink::PinkCli* cli = pink::NewPbCli();
+  cli->set_connect_timeout(1500);
+  slash::Status s = cli->Connect(ip, port);
+  if (!s.ok()) {
+    std::cerr << "Connect " << ip_port << " failed: " << s.ToString()
+      << std::endl;
+    delete cli;
+    return NULL;
+  }
+  cli->set_send_timeout(3000);
+  cli->set_recv_timeout(3000);
+  clis_[ip_port] = cli;
+  return cli;
+}
+
+void Worker::DropConnection(const std::string& ip, int port) {
+  auto iter = clis_.find(slash::IpPortString(ip, port));
+  if (iter != clis_.end()) {
+    delete iter->second;
+    clis_.erase(iter);
+  }
+}
+
+std::string Worker::NextTag() {
+  int64_t tag = std::uniform_int_distribution<int64_t>(
+      0, g_opt.hash_tags - 1)(rng_);
+  return "tag" + std::to_string(tag);
+}
+
+std::string Worker::NextKey() {
+  int64_t index = 0;
+  switch (g_opt.distribution) {
+    case kZipfian:
+      // Scatter the hot items over the keyspace
+      index = g_zipfian->Next(&rng_);
+      index = (index * 2654435761LL) % g_opt.keyspace;
+      break;
+    case kHashTag:
+      // Keys of one tag locate in the same partition
+      index = std::uniform_int_distribution<int64_t>(
+          0, g_opt.keyspace / g_opt.hash_tags)(rng_);
+      return kLBrace + NextTag() + kRBrace + "key" + std::to_string(index);
+    default:
+      index = std::uniform_int_distribution<int64_t>(
+          0, g_opt.keyspace - 1)(rng_);
+  }
+  return "key" + std::to_string(index);
+}
+
+OpType Worker::NextOp() {
+  int dice = std::uniform_int_distribution<int>(0, 99)(rng_);
+  if (dice < g_opt.mget_percent) {
+    return kOpMget;
+  }
+  dice -= g_opt.mget_percent;
+  if (dice < g_opt.writebatch_percent) {
+    return kOpWriteBatch;
+  }
+  dice -= g_opt.writebatch_percent;
+  if (dice < g_opt.read_percent) {
+    return kOpGet;
+  }
+  return kOpSet;
+}
+
+void Worker::BuildRequest(OpType op, client::CmdRequest* request) {
+  static const std::string value(g_opt.value_size, 'v');
+  request->Clear();
+  switch (op) {
+    case kOpSet: {
+      request->set_type(client::Type::SET);
+      client::CmdRequest_Set* set = request->mutable_set();
+      set->set_table_name(g_opt.table);
+      set->set_key(NextKey());
+      set->set_value(value);
+      break;
+    }
+    case kOpGet: {
+      request->set_type(client::Type::GET);
+      client::CmdRequest_Get* get = request->mutable_get();
+      get->set_table_name(g_opt.table);
+      get->set_key(NextKey());
+      break;
+    }
+    case kOpMget: {
+      request->set_type(client::Type::MGET);
+      client::CmdRequest_Mget* mget = request->mutable_mget();
+      mget->set_table_name(g_opt.table);
+      for (int i = 0; i < g_opt.batch; i++) {
+        mget->add_keys(NextKey());
+      }
+      break;
+    }
+    case kOpWriteBatch: {
+      // All keys of a WriteBatch share one hash tag
+      request->set_type(client::Type::WRITEBATCH);
+      client::CmdRequest_WriteBatch* wb = request->mutable_write_batch();
+      std::string tag = NextTag();
+      wb->set_table_name(g_opt.table);
+      wb->set_hash_tag(tag);
+      for (int i = 0; i < g_opt.batch; i++) {
+        wb->add_keys_to_add(kLBrace + tag + kRBrace + "key"
+            + std::to_string(i));
+        wb->add_values_to_add(value);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// Send the whole batch then receive, redirected ones are retried
+bool Worker::Process(const std::string& ip, int port,
+    std::vector<Pending>* batch, int redirect_limit) {
+  pink::PinkCli* cli = GetConnection(ip, port);
+  if (cli == NULL) {
+    g_errors += batch->size();
+    batch->clear();
+    return false;
+  }
+
+  size_t sent = 0;
+  for (; sent < batch->size(); sent++) {
+    if (!cli->Send(&(*batch)[sent].request).ok()) {
+      break;
+    }
+  }
+
+  std::vector<Pending> redirect;
+  std::string redirect_ip;
+  int redirect_port = 0;
+  client::CmdResponse response;
+  size_t received = 0;
+  for (; received < sent; received++) {
+    if (!cli->Recv(&response).ok()) {
+      break;
+    }
+    Pending& pending = (*batch)[received];
+    if (response.code() == client::StatusCode::kMove
+        && response.has_redirect() && redirect_limit > 0) {
+      redirect_ip = response.redirect().ip();
+      redirect_port = response.redirect().port();
+      redirect.push_back(pending);
+      continue;
+    }
+    uint64_t now = slash::NowMicros();
+    histograms_[pending.op].Add(now - pending.start_us);
+    if (response.code() != client::StatusCode::kOk
+        && response.code() != client::StatusCode::kNotFound) {
+      g_errors++;
+    }
+    g_done++;
+  }
+
+  if (received < batch->size()) {
+    // Connection broken, responses of the rest are lost
+    DropConnection(ip, port);
+    g_errors += batch->size() - received;
+  }
+  batch->clear();
+
+  if (!redirect.empty()) {
+    return Process(redirect_ip, redirect_port, &redirect, redirect_limit - 1);
+  }
+  return received == sent;
+}
+
+void Worker::Run() {
+  std::vector<Pending> batch;
+  size_t node = std::uniform_int_distribution<size_t>(
+      0, g_opt.nodes.size() - 1)(rng_);
+  while (!g_stop) {
+    for (int i = 0; i < g_opt.pipeline; i++) {
+      if (g_opt.requests > 0 && g_issued++ >= g_opt.requests) {
+        g_stop = true;
+        break;
+      }
+      Pending pending;
+      pending.op = NextOp();
+      BuildRequest(pending.op, &pending.request);
+      pending.start_us = slash::NowMicros();
+      batch.push_back(pending);
+    }
+    if (batch.empty()) {
+      break;
+    }
+    if (!Process(g_opt.nodes[node].first, g_opt.nodes[node].second, &batch,
+          kRedirectLimit)) {
+      // Try next node
+      node = (node + 1) % g_opt.nodes.size();
+      usleep(10000);
+    }
+  }
+}
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./zp_bench -h ip:port[,ip:port...] [-t table]"
+    << " [-c threads] [-P pipeline] [-d seconds] [-n requests]"
+    << " [-k keyspace] [-s value_size] [-D uniform|zipfian|hashtag]"
+    << " [-z zipf_theta] [-g hash_tags] [-r read_percent]"
+    << " [-m mget_percent] [-w writebatch_percent] [-b batch]" << std::endl;
+  exit(-1);
+}
+
+void ParseOptions(int argc, char* argv[]) {
+  int opt;
+  std::vector<std::string> elems;
+  while ((opt = getopt(argc, argv, "h:t:c:P:d:n:k:s:D:z:g:r:m:w:b:")) != -1) {
+    switch (opt) {
+      case 'h': {
+        slash::StringSplit(optarg, ',', elems);
+        for (auto& elem : elems) {
+          std::string ip;
+          int port = 0;
+          if (!slash::ParseIpPortString(elem, ip, port)) {
+            print_usage_exit();
+          }
+          g_opt.nodes.push_back(std::make_pair(ip, port));
+        }
+        break;
+      }
+      case 't': g_opt.table = optarg; break;
+      case 'c': g_opt.threads = atoi(optarg); break;
+      case 'P': g_opt.pipeline = atoi(optarg); break;
+      case 'd': g_opt.duration = atoi(optarg); break;
+      case 'n': g_opt.requests = atoll(optarg); break;
+      case 'k': g_opt.keyspace = atoll(optarg); break;
+      case 's': g_opt.value_size = atoi(optarg); break;
+      case 'D':
+        if (strcmp(optarg, "uniform") == 0) {
+          g_opt.distribution = kUniform;
+        } else if (strcmp(optarg, "zipfian") == 0) {
+          g_opt.distribution = kZipfian;
+        } else if (strcmp(optarg, "hashtag") == 0) {
+          g_opt.distribution = kHashTag;
+        } else {
+          print_usage_exit();
+        }
+        break;
+      case 'z': g_opt.zipf_theta = atof(optarg); break;
+      case 'g': g_opt.hash_tags = atoi(optarg); break;
+      case 'r': g_opt.read_percent = atoi(optarg); break;
+      case 'm': g_opt.mget_percent = atoi(optarg); break;
+      case 'w': g_opt.writebatch_percent = atoi(optarg); break;
+      case 'b': g_opt.batch = atoi(optarg); break;
+      default: print_usage_exit();
+    }
+  }
+  if (g_opt.nodes.empty() || g_opt.threads <= 0 || g_opt.pipeline <= 0
+      || g_opt.keyspace <= 0 || g_opt.value_size < 0 || g_opt.batch <= 0
+      || g_opt.hash_tags <= 0 || g_opt.zipf_theta <= 0
+      || g_opt.zipf_theta >= 1
+      || g_opt.read_percent + g_opt.mget_percent
+      + g_opt.writebatch_percent > 100) {
+    print_usage_exit();
+  }
+}
+
+void Report(const std::vector<Worker*>& workers, double seconds) {
+  printf("\n%-12s %10s %10s %10s %10s %10s %10s %10s\n", "op", "count",
+      "qps", "p50(us)", "p90(us)", "p99(us)", "p999(us)", "max(us)");
+  for (int op = 0; op < kOpMax; op++) {
+    Histogram h;
+    for (auto worker : workers) {
+      h.Merge(worker->histograms()[op]);
+    }
+    if (h.total() == 0) {
+      continue;
+    }
+    printf("%-12s %10lu %10.0f %10lu %10lu %10lu %10lu %10lu\n",
+        OpName[op].c_str(), h.total(), h.total() / seconds,
+        h.Percentile(50), h.Percentile(90), h.Percentile(99),
+        h.Percentile(99.9), h.max());
+  }
+  printf("\ntotal: %ld, errors: %ld, seconds: %.2f, qps: %.0f\n",
+      g_done.load(), g_errors.load(), seconds, g_done / seconds);
+}
+
+int main(int argc, char* argv[]) {
+  ParseOptions(argc, argv);
+  if (g_opt.distribution == kZipfian) {
+    g_zipfian = new Zipfian(g_opt.keyspace, g_opt.zipf_theta);
+  }
+
+  std::vector<Worker*> workers;
+  std::vector<std::thread> threads;
+  uint64_t start = slash::NowMicros();
+  for (int i = 0; i < g_opt.threads; i++) {
+    workers.push_back(new Worker(i));
+  }
+  for (auto worker : workers) {
+    threads.push_back(std::thread(&Worker::Run, worker));
+  }
+
+  // Progress every second
+  int64_t last = 0;
+  for (int i = 0; !g_stop && (g_opt.requests > 0 || i < g_opt.duration);
+      i++) {
+    sleep(1);
+    int64_t done = g_done;
+    fprintf(stderr, "[%ds] qps: %ld, errors: %ld\n", i + 1, done - last,
+        g_errors.load());
+    last = done;
+  }
+  g_stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  Report(workers, (slash::NowMicros() - start) / 1000000.0);
+  for (auto worker : workers) {
+    delete worker;
+  }
+  delete g_zipfian;
+  return g_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,1230 @@
+#include <map>
+#include <set>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "pink/include/pink_cli.h"
+#include "slash/include/env.h"
+#include "slash/include/slash_string.h"
+#include "slash/include/slash_status.h"
+#include "include/zp_const.h"
+#include "src/meta/zp_meta.pb.h"
+#include "src/node/client.pb.h"
+
+// Start a cluster of 3 meta and N data nodes on localhost from the conf
+// templates, and drive scripted scenarios against it.
+// Peers send binlog to node port + kPortShiftSync, where a proxy listens
+// and forwards to the sync_listen_port of the node, so that latency or
+// partition could be injected on the sync link of any node.
+// Ports and layout depend only on the options, so runs are comparable.
+//
+// Port of meta i:  base + i, floyd base + i + kMetaPortShiftFY
+// Port of node i:  base + 1000 + i, sync proxy + kPortShiftSync,
+//                  rsync + kPortShiftRsync, real sync base + 1500 + i
+
+using slash::Status;
+
+const int kMetaNum = 3;
+const int kNodePortShift = 1000;
+const int kNodeSyncListenShift = 1500;
+const int kMaxNodeNum = 100;
+const int kLoadBatch = 64;
+const int kPollIntervalMs = 50;
+const std::string kLocalIp = "127.0.0.1";
+
+struct Options {
+  std::string bin_path;
+  std::string conf_path;
+  std::string work_path;
+  std::string table;
+  std::string output;
+  std::string scenario;
+  int nodes;
+  int base_port;
+  int partitions;
+  int64_t load_mb;
+  int value_size;
+  int sync_delay_ms;
+  int timeout;  // s, of every wait
+  Options()
+    : bin_path("./output/bin"), conf_path("./conf"),
+    work_path("./zp_cluster"), table("cluster_test"), nodes(4),
+    base_port(19221), partitions(12), load_mb(64), value_size(1024),
+    sync_delay_ms(0), timeout(300) {}
+};
+
+Options g_opt;
+std::atomic<bool> g_stop(false);
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./zp_cluster [-b bin_path] [-c conf_path] [-w work_path]"
+    << " [-n nodes] [-p base_port] [-P partitions] [-s load_MB]"
+    << " [-v value_size] [-d sync_delay_ms] [-T timeout_s]"
+    << " [-o result_file] scenario" << std::endl;
+  std::cout << "    scenario: start | failover | migrate | dbsync | catchup"
+    << std::endl;
+  exit(-1);
+}
+
+void IntSigHandle(const int sig) {
+  g_stop = true;
+}
+
+uint64_t NowMs() {
+  return slash::NowMicros() / 1000;
+}
+
+// Wait until cond is true, false on timeout or stopped
+bool WaitFor(const std::function<bool()>& cond) {
+  uint64_t deadline = NowMs() + g_opt.timeout * 1000ULL;
+  while (!g_stop && NowMs() < deadline) {
+    if (cond()) {
+      return true;
+    }
+    usleep(kPollIntervalMs * 1000);
+  }
+  return false;
+}
+
+/*
+ * SyncProxy
+ * Forward one port to another, with delay added or connections cut
+ */
+class SyncProxy {
+ public:
+  SyncProxy(int port, int target)
+    : port_(port), target_(target), listen_fd_(-1), delay_ms_(0),
+    cut_(false), stop_(false) {}
+  ~SyncProxy() {
+    Stop();
+  }
+
+  Status Start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+      return Status::IOError("socket failed", strerror(errno));
+    }
+    int yes = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port_);
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+          sizeof(addr)) < 0 || listen(listen_fd_, 128) < 0) {
+      return Status::IOError("bind or listen failed", strerror(errno));
+    }
+    accept_thread_ = std::thread(&SyncProxy::AcceptLoop, this);
+    return Status::OK();
+  }
+
+  void Stop() {
+    if (stop_.exchange(true)) {
+      return;
+    }
+    if (accept_thread_.joinable()) {
+      accept_thread_.join();
+    }
+    for (auto& conn : conns_) {
+      conn->Join();
+    }
+    conns_.clear();
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+    }
+  }
+
+  void set_delay_ms(int delay) {
+    delay_ms_ = delay;
+  }
+  // Close current connections and refuse new ones until healed
+  void set_cut(bool cut) {
+    cut_ = cut;
+  }
+
+ private:
+  struct Chunk {
+    uint64_t due_ms;
+    std::string data;
+  };
+
+  struct Conn {
+    int fds[2];
+    std::atomic<int> running;
+    std::thread threads[2];
+    Conn() : running(2) {
+      fds[0] = fds[1] = -1;
+    }
+    void Join() {
+      for (auto& t : threads) {
+        if (t.joinable()) {
+          t.join();
+        }
+      }
+      for (int fd : fds) {
+        if (fd >= 0) {
+          close(fd);
+        }
+      }
+    }
+  };
+
+  int port_;
+  int target_;
+  int listen_fd_;
+  std::atomic<int> delay_ms_;
+  std::atomic<bool> cut_;
+  std::atomic<bool> stop_;
+  std::thread accept_thread_;
+  std::vector<std::unique_ptr<Conn>> conns_;  // Only by accept thread
+
+  int ConnectTarget() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(target_);
+    inet_pton(AF_INET, kLocalIp.c_str(), &addr.sin_addr);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+          sizeof(addr)) < 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  void AcceptLoop() {
+    struct pollfd pfd;
+    pfd.fd = listen_fd_;
+    pfd.events = POLLIN;
+    while (!stop_) {
+      ReapConns();
+      if (poll(&pfd, 1, 100) <= 0) {
+        continue;
+      }
+      int fd = accept(listen_fd_, NULL, NULL);
+      if (fd < 0) {
+        continue;
+      }
+      int target = cut_ ? -1 : ConnectTarget();
+      if (target < 0) {
+        close(fd);
+        continue;
+      }
+      std::unique_ptr<Conn> conn(new Conn);
+      conn->fds[0] = fd;
+      conn->fds[1] = target;
+      Conn* c = conn.get();
+      c->threads[0] = std::thread(&SyncProxy::Pipe, this, c, 0, 1);
+      c->threads[1] = std::thread(&SyncProxy::Pipe, this, c, 1, 0);
+      conns_.push_back(std::move(conn));
+    }
+  }
+
+  void ReapConns() {
+    for (auto it = conns_.begin(); it != conns_.end();) {
+      if ((*it)->running == 0) {
+        (*it)->Join();
+        it = conns_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  static bool WriteAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+      ssize_t n = write(fd, data.data() + done, data.size() - done);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      } else if (n <= 0) {
+        return false;
+      }
+      done += n;
+    }
+    return true;
+  }
+
+  // Data read from fds[from] is written to fds[to] after delay_ms
+  void Pipe(Conn* conn, int from, int to) {
+    std::deque<Chunk> chunks;
+    char buf[64 * 1024];
+    bool eof = false;
+    while (!stop_ && !cut_) {
+      uint64_t now = NowMs();
+      while (!chunks.empty() && chunks.front().due_ms <= now) {
+        if (!WriteAll(conn->fds[to], chunks.front().data)) {
+          eof = true;
+          break;
+        }
+        chunks.pop_front();
+      }
+      if (eof) {
+        break;
+      }
+      int timeout = chunks.empty() ? 100
+        : static_cast<int>(chunks.front().due_ms - now);
+      struct pollfd pfd;
+      pfd.fd = conn->fds[from];
+      pfd.events = POLLIN;
+      int ret = poll(&pfd, 1, std::min(timeout, 100));
+      if (ret <= 0) {
+        continue;
+      }
+      ssize_t n = read(conn->fds[from], buf, sizeof(buf));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      } else if (n <= 0) {
+        break;
+      }
+      chunks.push_back(Chunk{NowMs() + delay_ms_, std::string(buf, n)});
+    }
+    // Pending data is dropped, as a broken link does
+    shutdown(conn->fds[from], SHUT_RDWR);
+    shutdown(conn->fds[to], SHUT_RDWR);
+    conn->running--;
+  }
+
+  SyncProxy(const SyncProxy&);
+  void operator=(const SyncProxy&);
+};
+
+/*
+ * Process of meta or node
+ */
+struct Process {
+  std::string name;
+  std::string bin;
+  std::string conf;
+  std::string dir;
+  pid_t pid;
+  Process() : pid(-1) {}
+
+  Status Start() {
+    pid = fork();
+    if (pid < 0) {
+      return Status::IOError("fork failed", strerror(errno));
+    } else if (pid == 0) {
+      int fd = open((dir + "stdout.log").c_str(),
+          O_WRONLY | O_CREAT | O_APPEND, 0644);
+      if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+      }
+      execl(bin.c_str(), bin.c_str(), "-c", conf.c_str(),
+          static_cast<char*>(NULL));
+      _exit(127);
+    }
+    return Status::OK();
+  }
+
+  void Kill(int sig) {
+    if (pid <= 0) {
+      return;
+    }
+    kill(pid, sig);
+    waitpid(pid, NULL, 0);
+    pid = -1;
+  }
+};
+
+// Replace the value of key in conf template, append if absent
+void SetConf(std::vector<std::string>* lines, const std::string& key,
+    const std::string& value) {
+  std::string item = key + " : " + value;
+  for (auto& line : *lines) {
+    size_t pos = line.find_first_of(" :");
+    if (!line.empty() && line[0] != '#'
+        && line.substr(0, pos) == key) {
+      line = item;
+      return;
+    }
+  }
+  lines->push_back(item);
+}
+
+Status WriteConf(const std::string& tmpl, const std::string& file,
+    const std::map<std::string, std::string>& items) {
+  std::ifstream in(tmpl);
+  if (!in) {
+    return Status::NotFound("conf template", tmpl);
+  }
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line);
+  }
+  for (auto& kv : items) {
+    SetConf(&lines, kv.first, kv.second);
+  }
+  std::ofstream out(file);
+  for (auto& l : lines) {
+    out << l << std::endl;
+  }
+  return out ? Status::OK() : Status::IOError("write conf", file);
+}
+
+int64_t OffsetDistance(const client::SyncOffset& from,
+    const client::SyncOffset& to) {
+  return (static_cast<int64_t>(to.filenum()) - from.filenum()) * kBinlogSize
+    + to.offset() - from.offset();
+}
+
+/*
+ * Cluster
+ */
+class Cluster {
+ public:
+  Cluster() {}
+  ~Cluster() {
+    Stop();
+  }
+
+  int node_port(int i) const {
+    return g_opt.base_port + kNodePortShift + i;
+  }
+  int NodeIndex(const ZPMeta::Node& node) const {
+    return node.port() - g_opt.base_port - kNodePortShift;
+  }
+  SyncProxy* proxy(int i) {
+    return proxies_[i].get();
+  }
+
+  Status Start();
+  void Stop();
+  void KillNode(int i) {
+    nodes_[i].Kill(SIGKILL);
+  }
+  Status RestartNode(int i) {
+    return nodes_[i].Start();
+  }
+
+  Status MetaCmd(ZPMeta::MetaCmd* req, ZPMeta::MetaCmdResponse* res);
+  Status DataCmd(int node, client::CmdRequest* req,
+      client::CmdResponse* res);
+
+  // Partition p is served by nodes p, p + 1 and p + 2 of the first count
+  Status CreateTable(int count);
+  Status Pull(ZPMeta::Table* table, int* version = NULL);
+  // Sync offsets of the table on node i by partition
+  bool Offsets(int i, std::map<int, client::SyncOffset>* offsets);
+  // Bytes all slaves behind their masters, -1 if unknown
+  int64_t Lag(const ZPMeta::Table& table);
+  Status WaitSynced();
+  // Write bytes of data to the table, with keys from begin
+  Status Load(int64_t bytes, int64_t begin);
+  // Set one key of partition p, succeed only on its master
+  bool SetPartition(const ZPMeta::Table& table, int p);
+
+ private:
+  std::vector<Process> metas_;
+  std::vector<Process> nodes_;
+  std::vector<std::unique_ptr<SyncProxy>> proxies_;
+  std::map<int, pink::PinkCli*> clis_;
+
+  pink::PinkCli* GetConnection(int port);
+  void DropConnection(int port);
+  Status Call(int port, google::protobuf::Message* req,
+      google::protobuf::Message* res);
+  bool MetaReady();
+  bool NodesReady();
+  std::string KeyOfPartition(int p, int64_t* seq);
+};
+
+pink::PinkCli* Cluster::GetConnection(int port) {
+  auto iter = clis_.find(port);
+  if (iter != clis_.end()) {
+    return iter->second;
+  }
+  pink::PinkCli* cli = pink::NewPbCli();
+  cli->set_connect_timeout(1500);
+  if (!cli->Connect(kLocalIp, port).ok()) {
+    delete cli;
+    return NULL;
+  }
+  cli->set_send_timeout(3000);
+  cli->set_recv_timeout(3000);
+  clis_[port] = cli;
+  return cli;
+}
+
+void Cluster::DropConnection(int port) {
+  auto iter = clis_.find(port);
+  if (iter != clis_.end()) {
+    delete iter->second;
+    clis_.erase(iter);
+  }
+}
+
+Status Cluster::Call(int port, google::protobuf::Message* req,
+    google::protobuf::Message* res) {
+  pink::PinkCli* cli = GetConnection(port);
+  if (cli == NULL) {
+    return Status::IOError("connect failed", std::to_string(port));
+  }
+  Status s = cli->Send(req);
+  if (s.ok()) {
+    s = cli->Recv(res);
+  }
+  if (!s.ok()) {
+    DropConnection(port);
+  }
+  return s;
+}
+
+// Followers redirect to leader, so try the metas in order
+Status Cluster::MetaCmd(ZPMeta::MetaCmd* req, ZPMeta::MetaCmdResponse* res) {
+  Status s;
+  for (int i = 0; i < kMetaNum; i++) {
+    s = Call(g_opt.base_port + i, req, res);
+    if (s.ok()) {
+      if (res->code() != ZPMeta::StatusCode::OK) {
+        return Status::Corruption(res->msg());
+      }
+      return s;
+    }
+  }
+  return s;
+}
+
+Status Cluster::DataCmd(int node, client::CmdRequest* req,
+    client::CmdResponse* res) {
+  return Call(node_port(node), req, res);
+}
+
+Status Cluster::Start() {
+  if (g_opt.nodes <= 0 || g_opt.nodes > kMaxNodeNum) {
+    return Status::InvalidArgument("node num out of range");
+  }
+  slash::DeleteDirIfExist(g_opt.work_path);
+  slash::CreatePath(g_opt.work_path);
+
+  std::string meta_addr;
+  for (int i = 0; i < kMetaNum; i++) {
+    meta_addr += (i == 0 ? "" : ",")
+      + slash::IpPortString(kLocalIp, g_opt.base_port + i);
+  }
+
+  for (int i = 0; i < kMetaNum; i++) {
+    Process meta;
+    meta.name = "meta" + std::to_string(i);
+    meta.dir = g_opt.work_path + "/" + meta.name + "/";
+    meta.bin = g_opt.bin_path + "/zp-meta";
+    meta.conf = meta.dir + "meta.conf";
+    slash::CreatePath(meta.dir);
+    Status s = WriteConf(g_opt.conf_path + "/meta.conf", meta.conf, {
+        {"meta_addr", meta_addr},
+        {"local_ip", kLocalIp},
+        {"local_port", std::to_string(g_opt.base_port + i)},
+        {"data_path", meta.dir + "data"},
+        {"log_path", meta.dir + "log"},
+        {"daemonize", "false"}});
+    if (s.ok()) {
+      s = meta.Start();
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    metas_.push_back(meta);
+  }
+  if (!WaitFor(std::bind(&Cluster::MetaReady, this))) {
+    return Status::Timeout("meta leader not elected");
+  }
+
+  for (int i = 0; i < g_opt.nodes; i++) {
+    Process node;
+    node.name = "node" + std::to_string(i);
+    node.dir = g_opt.work_path + "/" + node.name + "/";
+    node.bin = g_opt.bin_path + "/zp-node";
+    node.conf = node.dir + "node.conf";
+    slash::CreatePath(node.dir);
+    int sync_listen = g_opt.base_port + kNodeSyncListenShift + i;
+    Status s = WriteConf(g_opt.conf_path + "/node.conf", node.conf, {
+        {"meta_addr", meta_addr},
+        {"local_ip", kLocalIp},
+        {"local_port", std::to_string(node_port(i))},
+        {"sync_listen_port", std::to_string(sync_listen)},
+        {"data_path", node.dir + "data"},
+        {"log_path", node.dir + "log"},
+        {"trash_path", node.dir + "trash"},
+        {"backup_path", node.dir + "backup"},
+        {"daemonize", "false"}});
+    std::unique_ptr<SyncProxy> proxy(
+        new SyncProxy(node_port(i) + kPortShiftSync, sync_listen));
+    if (s.ok()) {
+      s = proxy->Start();
+    }
+    if (s.ok()) {
+      s = node.Start();
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    proxy->set_delay_ms(g_opt.sync_delay_ms);
+    proxies_.push_back(std::move(proxy));
+    nodes_.push_back(node);
+  }
+  if (!WaitFor(std::bind(&Cluster::NodesReady, this))) {
+    return Status::Timeout("nodes not all up");
+  }
+  return Status::OK();
+}
+
+void Cluster::Stop() {
+  for (auto& kv : clis_) {
+    delete kv.second;
+  }
+  clis_.clear();
+  for (auto& node : nodes_) {
+    node.Kill(SIGTERM);
+  }
+  for (auto& meta : metas_) {
+    meta.Kill(SIGTERM);
+  }
+  proxies_.clear();
+  nodes_.clear();
+  metas_.clear();
+}
+
+bool Cluster::MetaReady() {
+  ZPMeta::MetaCmd req;
+  ZPMeta::MetaCmdResponse res;
+  req.set_type(ZPMeta::Type::LISTMETA);
+  return MetaCmd(&req, &res).ok()
+    && res.list_meta().nodes().has_leader();
+}
+
+bool Cluster::NodesReady() {
+  ZPMeta::MetaCmd req;
+  ZPMeta::MetaCmdResponse res;
+  req.set_type(ZPMeta::Type::LISTNODE);
+  if (!MetaCmd(&req, &res).ok()) {
+    return false;
+  }
+  int up = 0;
+  for (auto& status : res.list_node().nodes().nodes()) {
+    if (status.status() == ZPMeta::NodeState::UP) {
+      up++;
+    }
+  }
+  return up == g_opt.nodes;
+}
+
+Status Cluster::CreateTable(int count) {
+  ZPMeta::MetaCmd req;
+  ZPMeta::MetaCmdResponse res;
+  req.set_type(ZPMeta::Type::INIT);
+  ZPMeta::Table* table = req.mutable_init()->mutable_table();
+  table->set_name(g_opt.table);
+  int replicas = std::min(3, count);
+  for (int p = 0; p < g_opt.partitions; p++) {
+    ZPMeta::Partitions* partition = table->add_partitions();
+    partition->set_id(p);
+    partition->set_state(ZPMeta::PState::ACTIVE);
+    for (int r = 0; r < replicas; r++) {
+      ZPMeta::Node* node = r == 0 ? partition->mutable_master()
+        : partition->add_slaves();
+      node->set_ip(kLocalIp);
+      node->set_port(node_port((p + r) % count));
+    }
+  }
+  Status s = MetaCmd(&req, &res);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Ready once every master accepts write
+  ZPMeta::Table info;
+  bool ready = WaitFor([&]() {
+    if (!Pull(&info).ok()) {
+      return false;
+    }
+    for (int p = 0; p < info.partitions_size(); p++) {
+      if (!SetPartition(info, p)) {
+        return false;
+      }
+    }
+    return true;
+  });
+  return ready ? WaitSynced() : Status::Timeout("table not ready");
+}
+
+Status Cluster::Pull(ZPMeta::Table* table, int* version) {
+  ZPMeta::MetaCmd req;
+  ZPMeta::MetaCmdResponse res;
+  req.set_type(ZPMeta::Type::PULL);
+  req.mutable_pull()->set_name(g_opt.table);
+  Status s = MetaCmd(&req, &res);
+  if (!s.ok()) {
+    return s;
+  }
+  if (res.pull().info_size() != 1) {
+    return Status::NotFound("table", g_opt.table);
+  }
+  table->CopyFrom(res.pull().info(0));
+  if (version != NULL) {
+    *version = res.pull().version();
+  }
+  return Status::OK();
+}
+
+bool Cluster::Offsets(int i, std::map<int, client::SyncOffset>* offsets) {
+  client::CmdRequest req;
+  client::CmdResponse res;
+  req.set_type(client::Type::INFOREPL);
+  req.mutable_info()->set_table_name(g_opt.table);
+  if (!DataCmd(i, &req, &res).ok()
+      || res.code() != client::StatusCode::kOk
+      || res.info_repl_size() != 1) {
+    return false;
+  }
+  offsets->clear();
+  for (auto& state : res.info_repl(0).partition_state()) {
+    (*offsets)[state.partition_id()] = state.sync_offset();
+  }
+  return true;
+}
+
+int64_t Cluster::Lag(const ZPMeta::Table& table) {
+  std::map<int, std::map<int, client::SyncOffset>> all;
+  auto offset_of = [&](const ZPMeta::Node& node, int p,
+      client::SyncOffset* offset) {
+    int i = NodeIndex(node);
+    if (all.find(i) == all.end() && !Offsets(i, &all[i])) {
+      all.erase(i);
+      return false;
+    }
+    auto iter = all[i].find(p);
+    if (iter == all[i].end()) {
+      return false;
+    }
+    *offset = iter->second;
+    return true;
+  };
+
+  int64_t lag = 0;
+  for (auto& partition : table.partitions()) {
+    client::SyncOffset master;
+    if (!offset_of(partition.master(), partition.id(), &master)) {
+      return -1;
+    }
+    for (auto& slave : partition.slaves()) {
+      client::SyncOffset offset;
+      if (!offset_of(slave, partition.id(), &offset)) {
+        return -1;
+      }
+      lag += std::max(OffsetDistance(offset, master), static_cast<int64_t>(0));
+    }
+  }
+  return lag;
+}
+
+Status Cluster::WaitSynced() {
+  ZPMeta::Table table;
+  bool synced = WaitFor([&]() {
+    return Pull(&table).ok() && Lag(table) == 0;
+  });
+  return synced ? Status::OK() : Status::Timeout("slaves not synced");
+}
+
+// Same as Table::KeyToPartitionId without hash tag
+std::string Cluster::KeyOfPartition(int p, int64_t* seq) {
+  while (true) {
+    std::string key = "key_" + std::to_string((*seq)++);
+    if (static_cast<int>(std::hash<std::string>()(key)
+          % g_opt.partitions) == p) {
+      return key;
+    }
+  }
+}
+
+bool Cluster::SetPartition(const ZPMeta::Table& table, int p) {
+  int64_t seq = 0;
+  client::CmdRequest req;
+  client::CmdResponse res;
+  req.set_type(client::Type::SET);
+  req.mutable_set()->set_table_name(g_opt.table);
+  req.mutable_set()->set_key(KeyOfPartition(p, &seq));
+  req.mutable_set()->set_value("probe");
+  return DataCmd(NodeIndex(table.partitions(p).master()), &req, &res).ok()
+    && res.code() == client::StatusCode::kOk;
+}
+
+// Pipelined to the master of every key, follow the redirect if moved
+Status Cluster::Load(int64_t bytes, int64_t begin) {
+  ZPMeta::Table table;
+  Status s = Pull(&table);
+  if (!s.ok()) {
+    return s;
+  }
+  std::string value(g_opt.value_size, 'v');
+  int64_t count = std::max(bytes / g_opt.value_size, static_cast<int64_t>(1));
+  std::map<int, std::vector<client::CmdRequest>> batches;
+  auto flush = [&](int node, std::vector<client::CmdRequest>* batch) {
+    pink::PinkCli* cli = GetConnection(node_port(node));
+    if (cli == NULL) {
+      return Status::IOError("connect failed", std::to_string(node));
+    }
+    for (auto& req : *batch) {
+      s = cli->Send(&req);
+      if (!s.ok()) {
+        DropConnection(node_port(node));
+        return s;
+      }
+    }
+    client::CmdResponse res;
+    for (auto& req : *batch) {
+      s = cli->Recv(&res);
+      if (!s.ok()) {
+        DropConnection(node_port(node));
+        return s;
+      }
+      int redirect = 3;
+      while (res.code() == client::StatusCode::kMove && redirect-- > 0) {
+        ZPMeta::Node to;
+        to.set_ip(res.redirect().ip());
+        to.set_port(res.redirect().port());
+        s = DataCmd(NodeIndex(to), &req, &res);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      if (res.code() != client::StatusCode::kOk) {
+        return Status::Corruption("set failed", res.msg());
+      }
+    }
+    batch->clear();
+    return Status::OK();
+  };
+
+  for (int64_t i = begin; i < begin + count && !g_stop; i++) {
+    std::string key = "key_" + std::to_string(i);
+    int p = std::hash<std::string>()(key) % g_opt.partitions;
+    int node = NodeIndex(table.partitions(p).master());
+    client::CmdRequest req;
+    req.set_type(client::Type::SET);
+    req.mutable_set()->set_table_name(g_opt.table);
+    req.mutable_set()->set_key(key);
+    req.mutable_set()->set_value(value);
+    std::vector<client::CmdRequest>& batch = batches[node];
+    batch.push_back(req);
+    if (batch.size() >= static_cast<size_t>(kLoadBatch)) {
+      s = flush(node, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  for (auto& kv : batches) {
+    s = flush(kv.first, &kv.second);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return g_stop ? Status::Incomplete("stopped") : Status::OK();
+}
+
+/*
+ * Scenarios, each returns the result items as json members
+ */
+typedef std::vector<std::pair<std::string, std::string>> Result;
+
+std::string Quote(const std::string& str) {
+  return "\"" + str + "\"";
+}
+
+double Rate(int64_t bytes, uint64_t ms) {
+  return bytes / 1048576.0 * 1000 / std::max(ms, static_cast<uint64_t>(1));
+}
+
+Status LoadAndSync(Cluster* cluster, int count) {
+  Status s = cluster->CreateTable(count);
+  if (s.ok()) {
+    s = cluster->Load(g_opt.load_mb << 20, 0);
+  }
+  if (s.ok()) {
+    s = cluster->WaitSynced();
+  }
+  return s;
+}
+
+// Kill the master of partition 0, time until meta elects new masters for
+// all its partitions, and until they accept write
+Status Failover(Cluster* cluster, Result* result) {
+  Status s = LoadAndSync(cluster, g_opt.nodes);
+  ZPMeta::Table table;
+  if (s.ok()) {
+    s = cluster->Pull(&table);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  int victim = cluster->NodeIndex(table.partitions(0).master());
+  std::vector<int> moved;
+  for (auto& partition : table.partitions()) {
+    if (cluster->NodeIndex(partition.master()) == victim) {
+      moved.push_back(partition.id());
+    }
+  }
+
+  uint64_t begin = NowMs();
+  cluster->KillNode(victim);
+  bool elected = WaitFor([&]() {
+    if (!cluster->Pull(&table).ok()) {
+      return false;
+    }
+    for (int p : moved) {
+      if (cluster->NodeIndex(table.partitions(p).master()) == victim) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (!elected) {
+    return Status::Timeout("new master not elected");
+  }
+  uint64_t elect_ms = NowMs() - begin;
+  bool writable = WaitFor([&]() {
+    for (int p : moved) {
+      if (!cluster->Pull(&table).ok() || !cluster->SetPartition(table, p)) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (!writable) {
+    return Status::Timeout("new master not writable");
+  }
+  result->push_back({"victim", std::to_string(victim)});
+  result->push_back({"moved_partitions", std::to_string(moved.size())});
+  result->push_back({"elect_ms", std::to_string(elect_ms)});
+  result->push_back({"writable_ms", std::to_string(NowMs() - begin)});
+  return Status::OK();
+}
+
+// Move the replicas on node 0 to the first node not serving the partition
+Status Migrate(Cluster* cluster, Result* result) {
+  if (g_opt.nodes <= 3) {
+    return Status::InvalidArgument("migrate needs more than 3 nodes");
+  }
+  Status s = LoadAndSync(cluster, g_opt.nodes);
+  ZPMeta::Table table;
+  int version = 0;
+  if (s.ok()) {
+    s = cluster->Pull(&table, &version);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  ZPMeta::MetaCmd req;
+  ZPMeta::MetaCmdResponse res;
+  req.set_type(ZPMeta::Type::MIGRATE);
+  req.mutable_migrate()->set_origin_epoch(version);
+  std::map<int, int> targets;
+  for (auto& partition : table.partitions()) {
+    std::set<int> serving = {cluster->NodeIndex(partition.master())};
+    for (auto& slave : partition.slaves()) {
+      serving.insert(cluster->NodeIndex(slave));
+    }
+    if (serving.find(0) == serving.end()) {
+      continue;
+    }
+    int to = 0;
+    while (serving.find(to) != serving.end()) {
+      to++;
+    }
+    targets[partition.id()] = to;
+    ZPMeta::RelationCmdUnit* unit = req.mutable_migrate()->add_diff();
+    unit->set_table(g_opt.table);
+    unit->set_partition(partition.id());
+    unit->mutable_left()->set_ip(kLocalIp);
+    unit->mutable_left()->set_port(cluster->node_port(0));
+    unit->mutable_right()->set_ip(kLocalIp);
+    unit->mutable_right()->set_port(cluster->node_port(to));
+  }
+
+  uint64_t begin = NowMs();
+  s = cluster->MetaCmd(&req, &res);
+  if (!s.ok()) {
+    return s;
+  }
+  bool done = WaitFor([&]() {
+    ZPMeta::MetaCmd status_req;
+    ZPMeta::MetaCmdResponse status_res;
+    status_req.set_type(ZPMeta::Type::METASTATUS);
+    if (!cluster->MetaCmd(&status_req, &status_res).ok()
+        || status_res.meta_status().has_migrate_status()
+        || !cluster->Pull(&table).ok()) {
+      return false;
+    }
+    for (auto& kv : targets) {
+      const ZPMeta::Partitions& partition = table.partitions(kv.first);
+      bool found = cluster->NodeIndex(partition.master()) == kv.second;
+      for (auto& slave : partition.slaves()) {
+        found = found || cluster->NodeIndex(slave) == kv.second;
+      }
+      if (!found) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (!done) {
+    return Status::Timeout("migrate not finished");
+  }
+  uint64_t migrate_ms = NowMs() - begin;
+  s = cluster->WaitSynced();
+  if (!s.ok()) {
+    return s;
+  }
+  result->push_back({"migrated_partitions", std::to_string(targets.size())});
+  result->push_back({"migrate_ms", std::to_string(migrate_ms)});
+  result->push_back({"synced_ms", std::to_string(NowMs() - begin)});
+  return Status::OK();
+}
+
+// Add the last node, which serves nothing, as slave of every partition.
+// Master DBSyncs it once the first binlog is purged, which needs
+// binlog_remain_min_count files written, otherwise binlog is sent
+Status DBSync(Cluster* cluster, Result* result) {
+  if (g_opt.nodes < 2) {
+    return Status::InvalidArgument("dbsync needs at least 2 nodes");
+  }
+  int fresh = g_opt.nodes - 1;
+  Status s = LoadAndSync(cluster, g_opt.nodes - 1);
+  ZPMeta::Table table;
+  if (s.ok()) {
+    s = cluster->Pull(&table);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  int purged = 0;
+  for (auto& partition : table.partitions()) {
+    std::string first_binlog = g_opt.work_path + "/node"
+      + std::to_string(cluster->NodeIndex(partition.master())) + "/log/"
+      + g_opt.table + "/" + std::to_string(partition.id()) + "/"
+      + kBinlogPrefix + "0";
+    if (!slash::FileExists(first_binlog)) {
+      purged++;
+    }
+  }
+
+  uint64_t begin = NowMs();
+  for (auto& partition : table.partitions()) {
+    ZPMeta::MetaCmd req;
+    ZPMeta::MetaCmdResponse res;
+    req.set_type(ZPMeta::Type::ADDSLAVE);
+    ZPMeta::BasicCmdUnit* basic = req.mutable_add_slave()->mutable_basic();
+    basic->set_name(g_opt.table);
+    basic->set_partition(partition.id());
+    basic->mutable_node()->set_ip(kLocalIp);
+    basic->mutable_node()->set_port(cluster->node_port(fresh));
+    s = cluster->MetaCmd(&req, &res);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  bool added = WaitFor([&]() {
+    if (!cluster->Pull(&table).ok()) {
+      return false;
+    }
+    for (auto& partition : table.partitions()) {
+      bool found = false;
+      for (auto& slave : partition.slaves()) {
+        found = found || cluster->NodeIndex(slave) == fresh;
+      }
+      if (!found) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (!added) {
+    return Status::Timeout("slave not added");
+  }
+  s = cluster->WaitSynced();
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t sync_ms = NowMs() - begin;
+  result->push_back({"purged_partitions", std::to_string(purged)});
+  result->push_back({"sync_ms", std::to_string(sync_ms)});
+  result->push_back({"sync_mb_per_s",
+      std::to_string(Rate(g_opt.load_mb << 20, sync_ms))});
+  return Status::OK();
+}
+
+// Cut the sync link of the first slave of partition 0 while loading,
+// then heal it and time until all slaves catch up
+Status Catchup(Cluster* cluster, Result* result) {
+  Status s = cluster->CreateTable(g_opt.nodes);
+  ZPMeta::Table table;
+  if (s.ok()) {
+    s = cluster->Pull(&table);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  if (table.partitions(0).slaves_size() == 0) {
+    return Status::InvalidArgument("catchup needs at least 2 nodes");
+  }
+  int victim = cluster->NodeIndex(table.partitions(0).slaves(0));
+
+  cluster->proxy(victim)->set_cut(true);
+  uint64_t load_begin = NowMs();
+  s = cluster->Load(g_opt.load_mb << 20, 0);
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t load_ms = NowMs() - load_begin;
+  int64_t lag = -1;
+  if (!WaitFor([&]() {
+        lag = cluster->Lag(table);
+        return lag >= 0;
+      })) {
+    return Status::Timeout("lag unknown");
+  }
+
+  uint64_t begin = NowMs();
+  cluster->proxy(victim)->set_cut(false);
+  s = cluster->WaitSynced();
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t catchup_ms = NowMs() - begin;
+  result->push_back({"victim", std::to_string(victim)});
+  result->push_back({"load_ms", std::to_string(load_ms)});
+  result->push_back({"lag_bytes", std::to_string(lag)});
+  result->push_back({"catchup_ms", std::to_string(catchup_ms)});
+  result->push_back({"catchup_mb_per_s",
+      std::to_string(Rate(lag, catchup_ms))});
+  return Status::OK();
+}
+
+// Keep the cluster for manual test until interrupted
+Status StartOnly(Cluster* cluster, Result* result) {
+  Status s = cluster->CreateTable(g_opt.nodes);
+  if (!s.ok()) {
+    return s;
+  }
+  std::cerr << "Cluster started, meta " << kLocalIp << ":" << g_opt.base_port
+    << ", table " << g_opt.table << ", Ctrl-C to stop" << std::endl;
+  while (!g_stop) {
+    sleep(1);
+  }
+  return Status::OK();
+}
+
+void PrintResult(const std::string& status, const Result& result) {
+  std::string line = "{\"scenario\": " + Quote(g_opt.scenario)
+    + ", \"nodes\": " + std::to_string(g_opt.nodes)
+    + ", \"partitions\": " + std::to_string(g_opt.partitions)
+    + ", \"load_mb\": " + std::to_string(g_opt.load_mb)
+    + ", \"value_size\": " + std::to_string(g_opt.value_size)
+    + ", \"sync_delay_ms\": " + std::to_string(g_opt.sync_delay_ms)
+    + ", \"version\": " + Quote(kZPVersion)
+    + ", \"status\": " + Quote(status);
+  for (auto& kv : result) {
+    line += ", " + Quote(kv.first) + ": " + kv.second;
+  }
+  line += "}";
+  if (g_opt.output.empty()) {
+    std::cout << line << std::endl;
+  } else {
+    std::ofstream out(g_opt.output, std::ios::app);
+    out << line << std::endl;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int c;
+  while ((c = getopt(argc, argv, "b:c:w:n:p:P:s:v:d:T:o:")) != -1) {
+    int64_t value = 0;
+    if (strchr("npPsvdT", c) != NULL
+        && (!slash::string2l(optarg, strlen(optarg), &value) || value < 0)) {
+      print_usage_exit();
+    }
+    switch (c) {
+      case 'b': g_opt.bin_path = optarg; break;
+      case 'c': g_opt.conf_path = optarg; break;
+      case 'w': g_opt.work_path = optarg; break;
+      case 'n': g_opt.nodes = value; break;
+      case 'p': g_opt.base_port = value; break;
+      case 'P': g_opt.partitions = value; break;
+      case 's': g_opt.load_mb = value; break;
+      case 'v': g_opt.value_size = value; break;
+      case 'd': g_opt.sync_delay_ms = value; break;
+      case 'T': g_opt.timeout = value; break;
+      case 'o': g_opt.output = optarg; break;
+      default: print_usage_exit();
+    }
+  }
+  if (optind != argc - 1 || g_opt.partitions <= 0 || g_opt.value_size <= 0) {
+    print_usage_exit();
+  }
+  g_opt.scenario = argv[optind];
+
+  std::map<std::string, std::function<Status(Cluster*, Result*)>> scenarios = {
+    {"start", StartOnly},
+    {"failover", Failover},
+    {"migrate", Migrate},
+    {"dbsync", DBSync},
+    {"catchup", Catchup}
+  };
+  auto iter = scenarios.find(g_opt.scenario);
+  if (iter == scenarios.end()) {
+    print_usage_exit();
+  }
+
+  signal(SIGINT, &IntSigHandle);
+  signal(SIGTERM, &IntSigHandle);
+  signal(SIGPIPE, SIG_IGN);
+
+  Cluster cluster;
+  Result result;
+  Status s = cluster.Start();
+  if (s.ok()) {
+    s = iter->second(&cluster, &result);
+  }
+  cluster.Stop();
+  PrintResult(s.ok() ? "ok" : s.ToString(), result);
+  if (!s.ok()) {
+    std::cerr << g_opt.scenario << " failed: " << s.ToString()
+      << ", logs under " << g_opt.work_path << std::endl;
+    return 1;
+  }
+  slash::DeleteDirIfExist(g_opt.work_path);
+  return 0;
+}
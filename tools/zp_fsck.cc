@@ -0,0 +1,556 @@
+#include <map>
+#include <set>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "rocksdb/db.h"
+#include "rocksdb/options.h"
+
+#include "slash/include/env.h"
+#include "slash/include/slash_string.h"
+#include "include/zp_const.h"
+#include "include/zp_binlog.h"
+#include "src/node/client.pb.h"
+
+// Check all partitions of a node offline, in parallel:
+// 1. binlog files are continuous, and every record and item decodable
+// 2. manifest points to the end of the last binlog, on a record boundary
+// 3. db could be opened and every key read with checksum verified
+// One json line is printed for each partition, then a summary line
+
+const uint64_t kReadChunk = 16 * kBlockSize;  // 1MB
+const int kIoprioClassIdle = 3;
+const int kIoprioClassShift = 13;
+const int kIoprioWhoProcess = 1;
+
+struct Options {
+  std::string data_path;
+  std::string log_path;
+  int threads;
+  int64_t rate;  // MB/s, 0 for unlimited
+  bool idle;
+  bool skip_db;
+  bool rebuild_index;
+  Options() : threads(4), rate(0), idle(false), skip_db(false),
+    rebuild_index(false) {}
+};
+
+// Shared by all workers, sleep when reading faster than rate
+class Throttle {
+ public:
+  explicit Throttle(int64_t rate)
+    : rate_(rate * 1024 * 1024),
+    start_(slash::NowMicros()),
+    bytes_(0) {}
+
+  void Consume(uint64_t bytes) {
+    uint64_t total = (bytes_ += bytes);
+    if (rate_ <= 0) {
+      return;
+    }
+    uint64_t expect = static_cast<double>(total) / rate_ * 1000000;
+    uint64_t elapse = slash::NowMicros() - start_;
+    if (expect > elapse) {
+      usleep(expect - elapse);
+    }
+  }
+
+  uint64_t bytes() const {
+    return bytes_;
+  }
+
+ private:
+  int64_t rate_;
+  uint64_t start_;
+  std::atomic<uint64_t> bytes_;
+};
+
+struct PartitionTask {
+  std::string table;
+  int partition_id;
+};
+
+struct Report {
+  int64_t binlog_files;
+  int64_t first_filenum;
+  int64_t last_filenum;
+  int64_t manifest_filenum;
+  int64_t manifest_offset;
+  int64_t items;
+  int64_t corrupt_records;
+  int64_t undecodable_items;
+  int64_t db_keys;
+  std::vector<std::string> errors;
+  std::vector<std::string> warnings;
+  Report()
+    : binlog_files(0), first_filenum(-1), last_filenum(-1),
+    manifest_filenum(-1), manifest_offset(-1), items(0),
+    corrupt_records(0), undecodable_items(0), db_keys(0) {}
+};
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./zp_fsck [-j threads] [-r MB/s] [-i] [-n] [-x]"
+    << " data_path log_path" << std::endl;
+  std::cout << "        -j  partitions checked in parallel, default 4"
+    << std::endl;
+  std::cout << "        -r  total read rate limit, default unlimited"
+    << std::endl;
+  std::cout << "        -i  idle io priority and lowest cpu priority"
+    << std::endl;
+  std::cout << "        -n  skip db scan" << std::endl;
+  std::cout << "        -x  rebuild binlog index files" << std::endl;
+  exit(-1);
+}
+
+std::string JsonEscape(const std::string& str) {
+  std::string res;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      res.push_back('\\');
+      res.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      res.append(buf);
+    } else {
+      res.push_back(c);
+    }
+  }
+  return res;
+}
+
+bool IsNumber(const std::string& str, int64_t* num) {
+  return !str.empty() && slash::string2l(str.data(), str.size(), num)
+    && *num >= 0;
+}
+
+// Partitions found in either data path or log path
+void ListPartitions(const Options& opt, std::vector<PartitionTask>* tasks) {
+  std::set<std::pair<std::string, int>> found;
+  for (const std::string& root : {opt.data_path, opt.log_path}) {
+    std::vector<std::string> tables;
+    slash::GetChildren(root, tables);
+    for (auto& table : tables) {
+      std::string table_path = root + "/" + table;
+      // IsDir returns 0 for directory
+      if (slash::IsDir(table_path) != 0) {
+        continue;
+      }
+      std::vector<std::string> partitions;
+      slash::GetChildren(table_path, partitions);
+      for (auto& p : partitions) {
+        int64_t pid = 0;
+        if (IsNumber(p, &pid) && slash::IsDir(table_path + "/" + p) == 0) {
+          found.insert(std::make_pair(table, static_cast<int>(pid)));
+        }
+      }
+    }
+  }
+  for (auto& item : found) {
+    tasks->push_back(PartitionTask{item.first, item.second});
+  }
+}
+
+// Same layout as Version::StableSave
+bool ReadManifest(const std::string& path, uint32_t* filenum,
+    uint64_t* offset) {
+  std::ifstream in(path, std::ios::binary);
+  char buf[sizeof(uint32_t) + sizeof(uint64_t)];
+  if (!in || !in.read(buf, sizeof(buf))) {
+    return false;
+  }
+  memcpy(filenum, buf, sizeof(uint32_t));
+  memcpy(offset, buf + sizeof(uint32_t), sizeof(uint64_t));
+  return true;
+}
+
+/**
+ * BinlogChecker
+ * Decode one binlog file sequentially, as BinlogReader does,
+ * but keep going on corruption to count all of them
+ */
+class BinlogChecker {
+ public:
+  BinlogChecker(Throttle* throttle, Report* report)
+    : throttle_(throttle), report_(report), inside_(false) {}
+
+  // Decode until bound, return the offset decoding stopped at,
+  // which is where the data ends if less than bound
+  uint64_t Check(const std::string& path, uint64_t bound);
+
+ private:
+  Throttle* throttle_;
+  Report* report_;
+  bool inside_;
+  std::string item_;
+  client::CmdRequest req_;
+
+  void OnItem();
+};
+
+uint64_t BinlogChecker::Check(const std::string& path, uint64_t bound) {
+  inside_ = false;
+  BinlogCompressedFile* cfile = NULL;
+  if (BinlogFileCompressed(path)
+      && !BinlogCompressedFile::Open(path, &cfile).ok()) {
+    report_->errors.push_back("open compressed binlog failed: " + path);
+    return 0;
+  }
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    report_->errors.push_back("open binlog failed: " + path);
+    delete cfile;
+    return 0;
+  }
+  struct stat file_stat;
+  fstat(fd, &file_stat);
+  uint64_t size = std::min(cfile != NULL ? cfile->size()
+      : static_cast<uint64_t>(file_stat.st_size), bound);
+
+  std::string chunk(kReadChunk, '\0');
+  uint64_t chunk_begin = 0;
+  uint64_t chunk_end = 0;
+  uint64_t offset = 0;
+  while (offset < size) {
+    uint64_t block_left = kBlockSize - offset % kBlockSize;
+    if (block_left <= kHeaderSize) {
+      offset += block_left;  // Trailer of block
+      continue;
+    }
+    // Records never span blocks, read the whole block in
+    if (offset + std::min(block_left, size - offset) > chunk_end) {
+      chunk_begin = offset - offset % kBlockSize;
+      ssize_t n = cfile != NULL
+        ? cfile->Pread(&chunk[0], kReadChunk, chunk_begin)
+        : pread(fd, &chunk[0], kReadChunk, chunk_begin);
+      if (n <= 0) {
+        report_->errors.push_back("read binlog failed: " + path);
+        break;
+      }
+      chunk_end = chunk_begin + n;
+      throttle_->Consume(n);
+      if (cfile == NULL) {
+        posix_fadvise(fd, chunk_begin, n, POSIX_FADV_DONTNEED);
+      }
+    }
+    if (offset + kHeaderSize > size) {
+      break;
+    }
+    const unsigned char* header =
+      reinterpret_cast<const unsigned char*>(&chunk[offset - chunk_begin]);
+    uint32_t length = header[0] | (header[1] << 8) | (header[2] << 16);
+    uint32_t type = header[3];
+    if (type == kZeroType && length == 0) {
+      break;  // Not written yet
+    }
+    if (kHeaderSize + length > block_left
+        || offset + kHeaderSize + length > size
+        || type == kZeroType || type == kEof || type == kBadRecord
+        || type > kEmptyType) {
+      report_->corrupt_records++;
+      inside_ = false;
+      offset += block_left;
+      continue;
+    }
+    const char* payload = &chunk[offset - chunk_begin + kHeaderSize];
+    offset += kHeaderSize + length;
+
+    switch (type) {
+      case kFullType:
+        if (inside_) {
+          report_->corrupt_records++;
+        }
+        inside_ = false;
+        item_.assign(payload, length);
+        OnItem();
+        break;
+      case kFirstType:
+        if (inside_) {
+          report_->corrupt_records++;
+        }
+        inside_ = true;
+        item_.assign(payload, length);
+        break;
+      case kMiddleType:
+        if (!inside_) {
+          report_->corrupt_records++;
+        } else {
+          item_.append(payload, length);
+        }
+        break;
+      case kLastType:
+        if (!inside_) {
+          report_->corrupt_records++;
+        } else {
+          inside_ = false;
+          item_.append(payload, length);
+          OnItem();
+        }
+        break;
+      default:
+        break;  // Blank
+    }
+  }
+  if (inside_) {
+    report_->corrupt_records++;
+  }
+  delete cfile;
+  close(fd);
+  return offset;
+}
+
+void BinlogChecker::OnItem() {
+  report_->items++;
+  if (!req_.ParseFromString(item_)) {
+    report_->undecodable_items++;
+  }
+}
+
+// Whether a record is written at offset
+bool HasRecordAt(const std::string& path, uint64_t offset) {
+  uint64_t block_left = kBlockSize - offset % kBlockSize;
+  if (block_left <= kHeaderSize) {
+    offset += block_left;
+  }
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  char header[kHeaderSize] = {0};
+  ssize_t n = pread(fd, header, kHeaderSize, offset);
+  close(fd);
+  return n == static_cast<ssize_t>(kHeaderSize)
+    && (header[0] != 0 || header[1] != 0 || header[2] != 0 || header[3] != 0);
+}
+
+void CheckBinlog(const std::string& path, bool rebuild_index,
+    Throttle* throttle, Report* report) {
+  std::vector<std::string> children;
+  if (slash::GetChildren(path, children) != 0) {
+    report->errors.push_back("binlog path not exist: " + path);
+    return;
+  }
+  std::set<uint32_t> filenums;
+  for (auto& child : children) {
+    int64_t num = 0;
+    if (child.compare(0, kBinlogPrefixLen, kBinlogPrefix) == 0
+        && IsNumber(child.substr(kBinlogPrefixLen), &num)) {
+      filenums.insert(num);
+    }
+  }
+  if (filenums.empty()) {
+    report->errors.push_back("no binlog file");
+    return;
+  }
+  report->binlog_files = filenums.size();
+  report->first_filenum = *filenums.begin();
+  report->last_filenum = *filenums.rbegin();
+  if (report->last_filenum - report->first_filenum + 1
+      != report->binlog_files) {
+    for (auto it = std::next(filenums.begin()); it != filenums.end(); ++it) {
+      if (*it != *std::prev(it) + 1) {
+        report->errors.push_back("binlog hole between "
+            + std::to_string(*std::prev(it)) + " and " + std::to_string(*it));
+      }
+    }
+  }
+
+  uint32_t pro_num = 0;
+  uint64_t pro_offset = 0;
+  bool manifest_ok = ReadManifest(path + kManifest, &pro_num, &pro_offset);
+  if (!manifest_ok) {
+    report->errors.push_back("read manifest failed");
+  } else {
+    report->manifest_filenum = pro_num;
+    report->manifest_offset = pro_offset;
+    if (pro_num != report->last_filenum) {
+      report->errors.push_back("manifest filenum "
+          + std::to_string(pro_num) + " is not the last binlog "
+          + std::to_string(report->last_filenum));
+    }
+  }
+
+  BinlogChecker checker(throttle, report);
+  for (uint32_t num : filenums) {
+    std::string file = NewFileName(path + kBinlogPrefix, num);
+    bool last = manifest_ok && num == pro_num;
+    uint64_t end = checker.Check(file, last ? pro_offset : UINT64_MAX);
+    if (rebuild_index) {
+      Status s = RebuildBinlogIndex(file);
+      if (!s.ok()) {
+        report->warnings.push_back("rebuild index of binlog "
+            + std::to_string(num) + " failed: " + s.ToString());
+      }
+    }
+    if (!last) {
+      continue;
+    }
+    // Manifest should point to the end of data
+    if (end != pro_offset) {
+      report->errors.push_back("manifest offset "
+          + std::to_string(pro_offset) + " is not the data end "
+          + std::to_string(end) + " of binlog " + std::to_string(num));
+    } else if (HasRecordAt(file, pro_offset)) {
+      report->warnings.push_back("record found after manifest offset");
+    }
+  }
+}
+
+void CheckDB(const std::string& path, Throttle* throttle, Report* report) {
+  if (!slash::FileExists(path)) {
+    report->errors.push_back("db path not exist: " + path);
+    return;
+  }
+  // Read only, so that it could run beside a living node
+  rocksdb::Options options;
+  rocksdb::DB* db = NULL;
+  rocksdb::Status s = rocksdb::DB::OpenForReadOnly(options, path, &db);
+  if (!s.ok()) {
+    report->errors.push_back("open db failed: " + s.ToString());
+    return;
+  }
+  rocksdb::ReadOptions read_options;
+  read_options.verify_checksums = true;
+  read_options.fill_cache = false;
+  rocksdb::Iterator* iter = db->NewIterator(read_options);
+  uint64_t bytes = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    report->db_keys++;
+    bytes += iter->key().size() + iter->value().size();
+    if (bytes >= kReadChunk) {
+      throttle->Consume(bytes);
+      bytes = 0;
+    }
+  }
+  throttle->Consume(bytes);
+  if (!iter->status().ok()) {
+    report->errors.push_back("scan db failed: " + iter->status().ToString());
+  }
+  delete iter;
+  delete db;
+}
+
+std::string ReportJson(const PartitionTask& task, const Report& report) {
+  std::string json = "{\"table\":\"" + JsonEscape(task.table) + "\""
+    + ",\"partition\":" + std::to_string(task.partition_id)
+    + ",\"status\":\"" + (report.errors.empty() ? "ok" : "error") + "\""
+    + ",\"binlog_files\":" + std::to_string(report.binlog_files)
+    + ",\"first_filenum\":" + std::to_string(report.first_filenum)
+    + ",\"last_filenum\":" + std::to_string(report.last_filenum)
+    + ",\"manifest_filenum\":" + std::to_string(report.manifest_filenum)
+    + ",\"manifest_offset\":" + std::to_string(report.manifest_offset)
+    + ",\"items\":" + std::to_string(report.items)
+    + ",\"corrupt_records\":" + std::to_string(report.corrupt_records)
+    + ",\"undecodable_items\":" + std::to_string(report.undecodable_items)
+    + ",\"db_keys\":" + std::to_string(report.db_keys);
+  const std::pair<const char*, const std::vector<std::string>*> lists[] = {
+    {"errors", &report.errors}, {"warnings", &report.warnings}};
+  for (auto& list : lists) {
+    json += std::string(",\"") + list.first + "\":[";
+    for (size_t i = 0; i < list.second->size(); i++) {
+      json += (i == 0 ? "\"" : ",\"") + JsonEscape((*list.second)[i]) + "\"";
+    }
+    json += "]";
+  }
+  return json + "}";
+}
+
+void SetIdlePriority() {
+  // Both apply to the calling thread only on linux
+  syscall(SYS_ioprio_set, kIoprioWhoProcess, 0,
+      kIoprioClassIdle << kIoprioClassShift);
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+}
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  int c;
+  int64_t num = 0;
+  while ((c = getopt(argc, argv, "j:r:inx")) != -1) {
+    switch (c) {
+      case 'j':
+        if (!slash::string2l(optarg, strlen(optarg), &num) || num <= 0) {
+          print_usage_exit();
+        }
+        opt.threads = num;
+        break;
+      case 'r':
+        if (!slash::string2l(optarg, strlen(optarg), &num) || num < 0) {
+          print_usage_exit();
+        }
+        opt.rate = num;
+        break;
+      case 'i': opt.idle = true; break;
+      case 'n': opt.skip_db = true; break;
+      case 'x': opt.rebuild_index = true; break;
+      default: print_usage_exit();
+    }
+  }
+  if (optind != argc - 2) {
+    print_usage_exit();
+  }
+  opt.data_path = argv[optind];
+  opt.log_path = argv[optind + 1];
+
+  std::vector<PartitionTask> tasks;
+  ListPartitions(opt, &tasks);
+  std::cerr << "Check " << tasks.size() << " partitions with "
+    << opt.threads << " threads" << std::endl;
+
+  Throttle throttle(opt.rate);
+  slash::Mutex out_mu;
+  std::atomic<size_t> next(0);
+  std::atomic<int> failed(0);
+  uint64_t begin = slash::NowMicros();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < opt.threads; i++) {
+    workers.push_back(std::thread([&]() {
+      if (opt.idle) {
+        SetIdlePriority();
+      }
+      size_t index;
+      while ((index = next++) < tasks.size()) {
+        const PartitionTask& task = tasks[index];
+        Report report;
+        char sub[256];
+        snprintf(sub, sizeof(sub), "/%s/%d/",
+            task.table.c_str(), task.partition_id);
+        CheckBinlog(opt.log_path + sub, opt.rebuild_index,
+            &throttle, &report);
+        if (!opt.skip_db) {
+          CheckDB(opt.data_path + sub, &throttle, &report);
+        }
+        if (!report.errors.empty()) {
+          failed++;
+        }
+        slash::MutexLock l(&out_mu);
+        std::cout << ReportJson(task, report) << std::endl;
+      }
+    }));
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  uint64_t seconds = (slash::NowMicros() - begin) / 1000000;
+  std::cout << "{\"summary\":{\"partitions\":" << tasks.size()
+    << ",\"failed\":" << failed
+    << ",\"read_bytes\":" << throttle.bytes()
+    << ",\"seconds\":" << seconds << "}}" << std::endl;
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "slash/include/env.h"
+#include "slash/include/slash_string.h"
+#include "include/db_nemo.h"
+#include "include/zp_const.h"
+#include "include/zp_binlog.h"
+#include "src/node/client.pb.h"
+
+// Restore one partition from backup, then replay archived binlogs
+// up to the target point
+
+struct Target {
+  bool by_time;
+  time_t time;
+  uint32_t filenum;
+  uint64_t offset;
+  Target() : by_time(false), time(0), filenum(UINT32_MAX), offset(0) {}
+};
+
+void print_usage_exit() {
+  std::cout << "Usage:" << std::endl;
+  std::cout << "    ./zp_restore [-s] backup_path table backup_name partition"
+    << " target_path [filenum:offset | @unix_time]" << std::endl;
+  std::cout << "    -s skip corrupt binlog blocks instead of stop,"
+    << " exit with 1 if any skipped" << std::endl;
+  exit(-1);
+}
+
+bool ParseTarget(const std::string& arg, Target* target) {
+  int64_t tmp = 0;
+  if (arg[0] == '@') {
+    if (!slash::string2l(arg.data() + 1, arg.size() - 1, &tmp) || tmp < 0) {
+      return false;
+    }
+    target->by_time = true;
+    target->time = tmp;
+    return true;
+  }
+  size_t pos = arg.find(':');
+  if (pos == std::string::npos
+      || !slash::string2l(arg.data(), pos, &tmp) || tmp < 0) {
+    return false;
+  }
+  target->filenum = tmp;
+  if (!slash::string2l(arg.data() + pos + 1, arg.size() - pos - 1, &tmp)
+      || tmp < 0) {
+    return false;
+  }
+  target->offset = tmp;
+  return true;
+}
+
+// Same format as bgsave info file
+bool ReadInfo(const std::string& path, uint32_t* filenum, uint64_t* offset) {
+  std::ifstream is(path);
+  if (!is) {
+    return false;
+  }
+  std::string line;
+  int lineno = 0;
+  int64_t tmp = 0;
+  while (std::getline(is, line)) {
+    lineno++;
+    if (lineno < 4) {
+      continue;
+    }
+    if (lineno > 5 || !slash::string2l(line.data(), line.size(), &tmp)
+        || tmp < 0) {
+      return false;
+    }
+    if (lineno == 4) {
+      *filenum = tmp;
+    } else {
+      *offset = tmp;
+    }
+  }
+  return lineno == 5;
+}
+
+bool WriteInfo(const std::string& path, uint32_t filenum, uint64_t offset) {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out.is_open()) {
+    return false;
+  }
+  out << "0s\n" << "\n" << 0 << "\n" << filenum << "\n" << offset << "\n";
+  return true;
+}
+
+bool CopyDir(const std::string& src, const std::string& dst) {
+  std::vector<std::string> files;
+  if (slash::GetChildren(src, files) != 0) {
+    return false;
+  }
+  for (auto& file : files) {
+    if (file == kBgsaveInfoFile) {
+      continue;
+    }
+    std::ifstream in(src + "/" + file, std::ios::binary);
+    std::ofstream out(dst + "/" + file, std::ios::binary | std::ios::trunc);
+    if (!in || !out || !(out << in.rdbuf())) {
+      std::cout << "Copy file failed: " << src << "/" << file << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+rocksdb::DBNemo* OpenDB(const std::string& path, bool create) {
+  rocksdb::Options options;
+  options.create_if_missing = create;
+  rocksdb::DBNemo* db = NULL;
+  rocksdb::Status s = rocksdb::DBNemo::Open(options, path, &db);
+  if (!s.ok()) {
+    std::cout << "Open db failed! path: " << path << ", " << s.ToString()
+      << std::endl;
+    return NULL;
+  }
+  return db;
+}
+
+rocksdb::Status DeleteByTag(rocksdb::DBNemo* db, const std::string& hash_tag) {
+  rocksdb::WriteBatch batch;
+  rocksdb::Iterator* iter = db->NewIterator(rocksdb::ReadOptions(),
+      db->DefaultColumnFamily());
+  for (iter->Seek(hash_tag); iter->Valid(); iter->Next()) {
+    if (memcmp(iter->key().data(), hash_tag.data(), hash_tag.size()) != 0) {
+      break;
+    }
+    batch.Delete(iter->key());
+  }
+  delete iter;
+  if (batch.Count() == 0) {
+    return rocksdb::Status::OK();
+  }
+  return db->Write(rocksdb::WriteOptions(), &batch);
+}
+
+// Apply one binlog item, as partition does on slave
+bool Apply(const std::string& db_path, rocksdb::DBNemo** db,
+    const client::CmdRequest& req) {
+  rocksdb::Status s;
+  switch (req.type()) {
+    case client::Type::SET: {
+      if (req.set().has_expire()) {
+        int ttl = req.set().expire().ttl();
+        if (req.set().expire().has_base()) {
+          ttl -= (time(NULL) - req.set().expire().base());
+        }
+        if (ttl <= 0) {
+          // Already expire
+          return true;
+        }
+        s = (*db)->Put(rocksdb::WriteOptions(), req.set().key(),
+            req.set().value(), ttl);
+      } else {
+        s = (*db)->Put(rocksdb::WriteOptions(), req.set().key(),
+            req.set().value());
+      }
+      break;
+    }
+    case client::Type::DEL:
+      s = (*db)->Delete(rocksdb::WriteOptions(), req.del().key());
+      break;
+    case client::Type::WRITEBATCH: {
+      rocksdb::WriteBatch batch;
+      const client::CmdRequest_WriteBatch& wb = req.write_batch();
+      if (wb.keys_to_add_size() != wb.values_to_add_size()) {
+        std::cout << "WriteBatch keys_to_add_size not equal values_to_add_size"
+          << std::endl;
+        return false;
+      }
+      for (int i = 0; i < wb.keys_to_add_size(); i++) {
+        batch.Put(wb.keys_to_add(i), wb.values_to_add(i));
+      }
+      for (auto& key : wb.keys_to_delete()) {
+        batch.Delete(key);
+      }
+      if (batch.Count() > 0) {
+        s = (*db)->Write(rocksdb::WriteOptions(), &batch);
+      }
+      break;
+    }
+    case client::Type::DELETEBYTAG:
+      s = DeleteByTag(*db, req.deleteby_tag().hash_tag());
+      break;
+    case client::Type::FLUSHDB:
+      delete *db;
+      *db = NULL;
+      if (!slash::DeleteDirIfExist(db_path)) {
+        std::cout << "Flush db failed, path: " << db_path << std::endl;
+        return false;
+      }
+      *db = OpenDB(db_path, true);
+      return *db != NULL;
+    case client::Type::INGEST:
+      std::cout << "Ingested files are not in binlog, could not restore"
+        << " beyond it" << std::endl;
+      return false;
+    default:
+      std::cout << "Unknown binlog item type: " << req.type() << std::endl;
+      return false;
+  }
+  if (!s.ok()) {
+    std::cout << "Apply binlog item failed: " << s.ToString() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  bool skip_corrupt = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s")) != -1) {
+    switch (opt) {
+      case 's':
+        skip_corrupt = true;
+        break;
+      default:
+        print_usage_exit();
+    }
+  }
+  argc -= optind;
+  argv += optind;
+  if (argc != 5 && argc != 6) {
+    print_usage_exit();
+  }
+  std::string backup_path(argv[0]);
+  std::string table(argv[1]);
+  std::string name(argv[2]);
+  std::string partition(argv[3]);
+  std::string target_path(argv[4]);
+  Target target;
+  if (argc == 6 && !ParseTarget(argv[5], &target)) {
+    print_usage_exit();
+  }
+
+  std::string table_path = backup_path + "/" + table + "/";
+  std::string snapshot_path = table_path + name + "/" + partition;
+  std::string archive_path = table_path + kBackupBinlogDir + "/" + partition
+    + "/";
+
+  // Backup is complete only if info file exists
+  uint32_t filenum = 0;
+  uint64_t offset = 0;
+  if (!ReadInfo(snapshot_path + "/" + kBgsaveInfoFile, &filenum, &offset)) {
+    std::cout << "Invalid or incomplete backup: " << snapshot_path
+      << std::endl;
+    return -1;
+  }
+  if (slash::FileExists(target_path)) {
+    std::cout << "Target path already exist: " << target_path << std::endl;
+    return -1;
+  }
+  slash::CreatePath(target_path, 0755);
+  if (!CopyDir(snapshot_path, target_path)) {
+    return -1;
+  }
+  std::cout << "Restore backup " << snapshot_path << " at "
+    << filenum << ":" << offset << std::endl;
+
+  rocksdb::DBNemo* db = OpenDB(target_path, false);
+  if (db == NULL) {
+    return -1;
+  }
+
+  // Replay archived binlogs
+  uint64_t count = 0;
+  uint64_t skipped = 0;  // corrupt blocks
+  bool failed = false;
+  while (!failed && filenum <= target.filenum) {
+    std::string file = NewFileName(archive_path + kBinlogPrefix, filenum);
+    struct stat file_stat;
+    if (stat(file.c_str(), &file_stat) != 0) {
+      break;  // No more archived binlog
+    }
+    // Every binlog item carries its time, and the time index gives the
+    // first one later than target directly. Without the index, items are
+    // checked one by one, unless the whole file is earlier by mtime
+    bool check_time = false;
+    if (target.by_time && file_stat.st_mtime > target.time) {
+      uint64_t stop = 0;
+      Status ts = BinlogTimeLookup(file, target.time + 1, &stop);
+      if (ts.ok()) {
+        target.filenum = filenum;
+        target.offset = std::max(stop, offset);
+      } else if (!ts.IsEndFile()) {
+        check_time = true;
+      }
+    }
+
+    slash::SequentialFile* queue = NULL;
+    if (!NewBinlogSequentialFile(file, &queue).ok()) {
+      std::cout << "Open binlog failed: " << file << std::endl;
+      failed = true;
+      break;
+    }
+    BinlogReader* reader = new BinlogReader(queue);
+    if (offset > 0 && !reader->Seek(offset).ok()) {
+      std::cout << "Seek binlog failed: " << file << ":" << offset
+        << std::endl;
+      failed = true;
+    }
+
+    std::string item;
+    client::CmdRequest req;
+    while (!failed) {
+      if (filenum == target.filenum && offset >= target.offset) {
+        break;
+      }
+      uint64_t size = 0;
+      Status s = reader->Consume(&size, &item);
+      if (s.IsEndFile()) {
+        break;
+      } else if (s.IsIncomplete()) {
+        // Blank or broken item
+      } else if (!s.ok()) {
+        // Writes in the rest of the block are lost
+        reader->SkipNextBlock(&size);
+        std::cout << "Corrupt binlog " << s.ToString() << ", "
+          << (skip_corrupt ? "skip " : "stop at ") << filenum << ":"
+          << offset << " - " << filenum << ":" << offset + size << std::endl;
+        if (!skip_corrupt) {
+          failed = true;
+          break;
+        }
+        skipped++;
+      } else if (!req.ParseFromString(item)) {
+        std::cout << "Parse binlog item failed at " << filenum << ":"
+          << offset << std::endl;
+        failed = true;
+        break;
+      } else if (check_time && (!req.has_binlog_time()
+            || req.binlog_time() > target.time)) {
+        // Items written before binlog_time is stamped carry no time,
+        // stop at them since their time is unknown
+        target.filenum = filenum;
+        target.offset = offset;
+        break;
+      } else if (!Apply(target_path, &db, req)) {
+        std::cout << "Replay failed at " << filenum << ":" << offset
+          << std::endl;
+        failed = true;
+        break;
+      } else {
+        count++;
+      }
+      offset += size;
+    }
+    delete reader;
+    delete queue;
+    if (failed || (filenum == target.filenum && offset >= target.offset)) {
+      break;
+    }
+    filenum++;
+    offset = 0;
+  }
+  delete db;
+  if (failed) {
+    return -1;
+  }
+
+  std::cout << "Replay " << count << " binlog items, skip " << skipped
+    << " corrupt blocks, restore to " << filenum << ":" << offset
+    << std::endl;
+  if (!WriteInfo(target_path + "/" + kBgsaveInfoFile, filenum, offset)) {
+    std::cout << "Write info file failed" << std::endl;
+    return -1;
+  }
+  return skipped == 0 ? 0 : 1;
+}